@@ -0,0 +1,153 @@
+/**
+ * @file: arena.c
+ * @author: Andrew Kress
+ * 
+ * @brief: Arena allocator for memory that lives as long as a command line
+ * 
+ * The parser allocates many small pieces for a single command line and all of them are
+ * released together once the line is executed. The arena allocates them from a list of
+ * blocks by moving an offset forward and is reset after each line, so the blocks allocated
+ * for the first lines are reused by every line that follows.
+ */ 
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#include "arena.h"
+
+
+// alignment of every allocation so any type can be stored
+#define ARENA_ALIGN alignof(max_align_t)
+
+
+/**
+ * Initializes an arena to an empty arena without any blocks
+ * 
+ * @param arena: arena to initialize
+ * @param block_size: size of each block, larger allocations get a block of their own
+ **/
+void arena_init(struct arena_t *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->current = NULL;
+    arena->block_size = block_size;
+    arena->blocks_allocated = 0;
+}
+
+
+/**
+ * Allocates a new block able to hold at least the given size and links it after the
+ * current block
+ * 
+ * @param arena: arena to grow
+ * @param size: number of bytes the block must hold
+ * @return the new block
+ **/
+struct arena_block_t *arena_add_block(struct arena_t *arena, size_t size) {
+    size_t block_size = (size > arena->block_size) ? size : arena->block_size;
+
+    struct arena_block_t *block = malloc(sizeof(struct arena_block_t) + block_size);
+    block->size = block_size;
+    block->used = 0;
+    arena->blocks_allocated++;
+
+    // new block goes after the current one so blocks not yet used stay in the list
+    if (arena->current == NULL) {
+        block->next = arena->head;
+        arena->head = block;
+    } else {
+        block->next = arena->current->next;
+        arena->current->next = block;
+    }
+
+    return block;
+}
+
+
+/**
+ * Allocates memory from the arena aligned for any type. The memory lives until the
+ * arena is reset.
+ * 
+ * @param arena: arena to allocate from
+ * @param size: number of bytes
+ * @return the allocated memory
+ **/
+void *arena_alloc(struct arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    // first allocation after init or reset starts at the first block
+    struct arena_block_t *block = arena->current;
+    if (block == NULL && arena->head != NULL) {
+        block = arena->current = arena->head;
+    }
+
+    // move on to the next block that is large enough, adding one if none is left
+    while (block == NULL || block->size - block->used < size) {
+        if (block != NULL && block->next != NULL) {
+            block = block->next;
+            block->used = 0;
+        } else {
+            block = arena_add_block(arena, size);
+        }
+        arena->current = block;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+
+/**
+ * Copies a string of the given length in to the arena and terminates it
+ * 
+ * @param arena: arena to allocate from
+ * @param str: string to copy
+ * @param length: number of characters to copy
+ * @return the copied string
+ **/
+char *arena_strndup(struct arena_t *arena, const char *str, size_t length) {
+    char *copy = arena_alloc(arena, length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+
+/**
+ * Releases all allocations at once. The blocks are kept and reused by later allocations.
+ * 
+ * @param arena: arena to reset
+ **/
+void arena_reset(struct arena_t *arena) {
+    if (arena->head != NULL) arena->head->used = 0;
+    arena->current = NULL;
+}
+
+
+/**
+ * Counts the blocks the arena holds, used or not
+ * 
+ * @param arena: arena to count
+ * @param usage: counters to add to
+ **/
+void arena_memory(struct arena_t *arena, struct mem_usage_t *usage) {
+    for (struct arena_block_t *block = arena->head; block != NULL; block = block->next) {
+        mem_count(usage, block);
+    }
+}
+
+
+/**
+ * Frees every block of the arena
+ * 
+ * @param arena: arena to free
+ **/
+void arena_free(struct arena_t *arena) {
+    while (arena->head != NULL) {
+        struct arena_block_t *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+    arena->current = NULL;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file: arena.h
+ * @author: Andrew Kress
+ * 
+ * @brief: Header file for the arena allocator
+ * 
+ * An arena hands out memory from large blocks by moving an offset forward. Nothing is freed
+ * on its own, the whole arena is reset at once and its blocks are reused, so memory that only
+ * lives as long as one command line costs no calls to malloc once the arena has grown.
+ */ 
+
+#include <stddef.h>
+
+#include "memstat.h"
+
+#ifndef ARENA_H
+#define ARENA_H
+
+// block of memory the arena hands out allocations from
+struct arena_block_t {
+    struct arena_block_t *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+// arena of blocks, blocks stay allocated when the arena is reset
+struct arena_t {
+    struct arena_block_t *head;
+    struct arena_block_t *current;
+    size_t block_size;
+    unsigned long blocks_allocated;  // number of times the arena called malloc
+};
+
+/**
+ * Initializes an arena to an empty arena without any blocks
+ * 
+ * @param arena: arena to initialize
+ * @param block_size: size of each block, larger allocations get a block of their own
+ **/
+void arena_init(struct arena_t *arena, size_t block_size);
+
+/**
+ * Allocates memory from the arena aligned for any type. The memory lives until the
+ * arena is reset.
+ * 
+ * @param arena: arena to allocate from
+ * @param size: number of bytes
+ * @return the allocated memory
+ **/
+void *arena_alloc(struct arena_t *arena, size_t size);
+
+/**
+ * Copies a string of the given length in to the arena and terminates it
+ * 
+ * @param arena: arena to allocate from
+ * @param str: string to copy
+ * @param length: number of characters to copy
+ * @return the copied string
+ **/
+char *arena_strndup(struct arena_t *arena, const char *str, size_t length);
+
+/**
+ * Releases all allocations at once. The blocks are kept and reused by later allocations.
+ * 
+ * @param arena: arena to reset
+ **/
+void arena_reset(struct arena_t *arena);
+
+/**
+ * Counts the blocks the arena holds, used or not
+ * 
+ * @param arena: arena to count
+ * @param usage: counters to add to
+ **/
+void arena_memory(struct arena_t *arena, struct mem_usage_t *usage);
+
+/**
+ * Frees every block of the arena
+ * 
+ * @param arena: arena to free
+ **/
+void arena_free(struct arena_t *arena);
+
+#endif
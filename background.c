@@ -4,13 +4,30 @@
  * 
  * @brief: functions for shell queue feature for background processesing of commands
  * 
- * The shell supports the ability to queue commands to run in the background one at a time.
+ * The shell supports the ability to queue commands to run in the background. Jobs are started
+ * in the order they were queued and up to SUSH_MAX_JOBS of them run at the same time.
  * This file defines the functions to support the internal commands to untilize this feature.
- * The queue is a linked list which commands are enqueued and dequeued for execution. All commands
- * output is redirected to a temporary file which can only be viewed once before the command is
- * removed from the queue and the file is deleted.
+ * The queue is a linked list which commands are enqueued and dequeued for execution. The output
+ * of each job goes to a temporary file, or with SUSH_CAPTURE set to memory through a pipe into
+ * the shell. Its head or tail can be viewed any number of times, viewing all of it removes the
+ * job from the queue and deletes its output.
+ * 
+ * Jobs are indexed by job id and by pid so finding a job never scans the queue. A job may wait
+ * for other jobs to finish, it is only added to the jobs waiting to start once all of them
+ * succeeded and is skipped if any of them failed. Each job keeps the ids of the jobs waiting
+ * for it so finishing a job only looks at its own dependents. SIGCHLD is delivered through
+ * the event loop, finished jobs are reaped and the next jobs started by background_reap in
+ * the normal flow of the shell, never in a signal handler. The shell runs the loop whenever
+ * it waits, at the prompt, in wait and output --follow, and while a foreground pipeline
+ * runs, so a job that finishes during a long foreground command frees its slot at once.
+ * The capture pipes of running jobs are watched by the loop too, so their output is read
+ * whenever the shell waits.
+ * 
+ * With SUSH_JOURNAL set every state change of a job is also written to the journal file, and
+ * jobs a previous shell left waiting to start are queued again.
  */ 
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +36,8 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
 
 #include "list.h"
 #include "runner.h"
@@ -26,20 +45,129 @@
 #include "executor.h"
 #include "error.h"
 #include "environ.h"
+#include "capture.h"
 #include "background.h"
+#include "journal.h"
+#include "eventloop.h"
+
+
+// number of jobs that may run at the same time unless SUSH_MAX_JOBS says otherwise
+#define DEFAULT_MAX_JOBS 1
+
+// environment variable holding the number of jobs that may run at the same time
+#define MAX_JOBS_VAR "SUSH_MAX_JOBS"
+
+// environment variable which selects where the output of jobs goes, `memory` or `file`
+#define CAPTURE_VAR "SUSH_CAPTURE"
+
+// environment variable holding the size at which captured output spills to a file
+#define CAPTURE_LIMIT_VAR "SUSH_CAPTURE_LIMIT"
 
+// output held in memory before it is spilled to a file unless SUSH_CAPTURE_LIMIT says otherwise
+#define DEFAULT_CAPTURE_LIMIT (1 << 20)
 
-// buffer to scan lines from output file
-#define LINE_BUFFER 512 
+// environment variable holding the path of the job journal
+#define JOURNAL_VAR "SUSH_JOURNAL"
+
+// longest command line of a job queued again from the journal, room for all dependencies
+#define RECOVER_LINE_SIZE (JOURNAL_COMMAND_SIZE + 256)
+
+// exit status of a job that could not be started
+#define EXIT_NOT_STARTED 127
+
+// interval output going to a file is checked at when inotify can not watch it
+#define FOLLOW_INTERVAL_MS 100
+
+// number of buckets in the pid table
+#define PID_BUCKETS 64
+
+// constants for pipe code readability
+#define READ_PIPE 0
+#define WRITE_PIPE 1
 
 // counter to assign job ids
 static int job_count = 0;
-// flag to signal that a job is running in background
-int job_running = false;
+// number of jobs currently running in background
+static int jobs_running = 0;
 
 // linked list to hold the queue of commands
 static LIST_HEAD(queue_list);
 
+// linked list of jobs that have not been started yet, oldest first
+static LIST_HEAD(pending_list);
+
+// jobs indexed by job id from the oldest job still in the queue, an entry is NULL once
+// the job was removed. Slots of removed jobs at the front are dropped as new jobs are added
+// so the index only spans the jobs in the queue no matter how many jobs were run.
+static struct queue_item_t **jobs_by_id = NULL;
+static int jobs_by_id_capacity = 0;
+static int jobs_by_id_base = 0;     // id of the job in the first slot
+
+// buckets of running jobs indexed by pid
+static struct list_head pid_buckets[PID_BUCKETS];
+
+// linked list of jobs whose capture pipe is still open
+static LIST_HEAD(capture_list);
+
+// signalfd that is readable when a child changed state
+static int sigchld_fd = -1;
+
+
+/**
+ * Handler the event loop runs when SIGCHLD is pending
+ * 
+ * @param fd: the signalfd
+ * @param data: unused
+ */ 
+void sigchld_ready(int fd, void *data) {
+    background_reap();
+}
+
+
+/**
+ * Reads the output a job wrote to its capture pipe, the capture is no longer
+ * watched once the job closed the pipe
+ * 
+ * @param queue_item: job to read output of
+ */ 
+void drain_capture(struct queue_item_t *queue_item) {
+    if (queue_item->capture == NULL) return;
+
+    if (capture_read(queue_item->capture))
+        list_del(&queue_item->capture_list);
+}
+
+
+/**
+ * Handler the event loop runs when the capture pipe of a job has output or was closed
+ * 
+ * @param fd: read end of the capture pipe
+ * @param data: the job
+ */ 
+void capture_ready(int fd, void *data) {
+    drain_capture(data);
+}
+
+
+/**
+ * Creates the event loop, has SIGCHLD delivered through it and initializes the job tables
+ * 
+ * @return status of initialization
+ */ 
+int background_init() {
+    for (int i = 0; i < PID_BUCKETS; i++) {
+        list_init(&pid_buckets[i]);
+    }
+
+    if (eventloop_init() < 0) return ERROR;
+
+    // finished children are reaped when the loop sees the signal
+    if (sigchld_fd < 0) sigchld_fd = eventloop_signal(SIGCHLD, sigchld_ready, NULL);
+    if (sigchld_fd < 0) return ERROR;
+
+    return SUCCESS;
+}
+
 
 /**
  * Checks that no redirection or piping is present
@@ -52,18 +180,49 @@ bool is_valid_background_command(struct command_t *command) {
         return false;
 
     // stdout cannot be changed
-    if (command->pipe_out || command->file_in != REDIRECT_NONE) 
+    if (command->pipe_out || command->file_out != REDIRECT_NONE) 
         return false;
     
     return true;
 }
 
 
+/**
+ * Checks if the output of jobs should be captured in memory. Set SUSH_CAPTURE
+ * to `memory` to capture through a pipe instead of a temp file.
+ * 
+ * @return true if output is captured in memory
+ */ 
+bool use_memory_capture() {
+    struct environ_var_t *capture = environ_get_var(CAPTURE_VAR);
+    return capture != NULL && strcmp(capture->value, "memory") == 0;
+}
+
+
+/**
+ * Returns the size at which captured output spills to a file, read from
+ * SUSH_CAPTURE_LIMIT. Invalid values fall back to the default.
+ * 
+ * @return spill size in bytes
+ */ 
+size_t get_capture_limit() {
+    struct environ_var_t *limit_var = environ_get_var(CAPTURE_LIMIT_VAR);
+    if (limit_var == NULL) return DEFAULT_CAPTURE_LIMIT;
+
+    long limit = parse_size(limit_var->value);
+    return (limit > 0) ? limit : DEFAULT_CAPTURE_LIMIT;
+}
+
+
 /**
  * Sets background command's stdin and stdout. Stdin is closed
- * and stdout always goes to a unique temp file. This configuration
+ * and stdout goes to a unique temp file. This configuration
  * is stored in the command struct prior to adding it to the queue
  * 
+ * When output is captured in memory no file is created, the command
+ * is left without an outfile and the capture pipe is created when 
+ * the job is started.
+ * 
  * @param command: command to set stdin and stdout fields
  * @return status of setup success
  */ 
@@ -72,9 +231,17 @@ int set_command_channels(struct command_t *command) {
     command->file_in = FILE_IN;
     command->infile = "/dev/null";
 
+    // stdout becomes capture pipe at execution
+    if (use_memory_capture()) {
+        command->file_out = FILE_OUT_OVERWRITE;
+        command->outfile = NULL;
+        command->fid_out = 0;
+        return SUCCESS;
+    }
+
     // create temp file with pattern
     char template[] = "/tmp/background_cmd_XXXXXXXX";
-    int temp_fid = mkstemp(template);
+    int temp_fid = mkostemp(template, O_CLOEXEC);
     if (temp_fid < 0) return ERROR;
 
     // stdout becomes unique temp file at execution
@@ -87,106 +254,509 @@ int set_command_channels(struct command_t *command) {
 
 
 /**
- * Item is dequeued and executed by child process. Parent updates
- * the pid of the queue_item and returns. Signal handler handles
- * the childs death.
+ * Forks a child which runs an internal command with stdin from /dev/null and stdout
+ * going to the jobs output.
+ * 
+ * @param command: internal command to run
+ * @return pid of the child, negative if the fork failed
  */ 
-void fork_and_execute_background(struct queue_item_t *queue_item) {
+pid_t fork_internal_background(struct command_t *command) {
     pid_t pid = fork();
 
-    if (pid < 0) return;
-    // if child, execute command
+    // if child, execute internal command
     if (pid == 0) {
-        // if internal, call internal command executor
-        if (is_internal_command(queue_item->command)) {
-            execute_internal_command(queue_item->command);
-        } 
-        // if non-internal, call external command executor
-        else {
-            struct command_t **commands_arr = malloc(sizeof(struct command_t) * 1);
-            commands_arr[0] = queue_item->command;
-            execute_external_command(commands_arr, 1);
-            exit(0);
-        }
-    // if parent, set pid of queue item being executed
+        eventloop_child();
+
+        // background jobs run in their own process group away from the terminal
+        setpgid(0, 0);
+
+        // same channels an external job gets
+        int null_fid = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        dup2(null_fid, STDIN_FILENO);
+        dup2(command->fid_out, STDOUT_FILENO);
+
+        if (command->limits != NULL && joblimits_apply(command->limits) < 0) exit(EXIT_NOT_STARTED);
+
+        int rc = execute_internal_command(command);
+        exit((rc < 0) ? 1 : 0);
+    }
+
+    return pid;
+}
+
+
+/**
+ * Item is dequeued and executed. External commands are spawned directly, internal
+ * commands need a copy of the shell so they are run by a forked child. Parent updates
+ * the pid of the queue_item and returns, the job is reaped by background_reap.
+ * 
+ * The shell closes its copy of the jobs output channel once the job started so the
+ * capture pipe sees end of file when the job exits.
+ */ 
+void fork_and_execute_background(struct queue_item_t *queue_item) {
+    struct command_t *command = queue_item->command;
+    pid_t pid;
+
+    // output goes to a new capture pipe
+    if (queue_item->capture != NULL) {
+        command->fid_out = capture_open(queue_item->capture);
+        if (command->fid_out < 0) return;
+        list_add_tail(&queue_item->capture_list, &capture_list);
+        eventloop_watch(queue_item->capture->fd, capture_ready, queue_item);
+    }
+
+    // external commands are launched without copying the shell
+    if (!is_internal_command(command)) {
+        pid = execute_background_command(command);
     } else {
-        queue_item->pid = pid;
+        pid = fork_internal_background(command);
     }
+
+    // only the job writes its output from now on, a launched command had it closed already
+    if (command->fid_out > 0) close(command->fid_out);
+    command->fid_out = 0;
+
+    // parent sets pid of queue item being executed
+    if (pid > 0) queue_item->pid = pid;
 }
 
 
 /**
- * Dequeues and executes the next job that in the queue that has not been
- * completed. Sets the job_running flag to true so the shell knows that a 
- * command is being executed in the background.
+ * Returns the number of jobs that may run at the same time. The limit is read from
+ * SUSH_MAX_JOBS so it can be changed at any time, invalid values fall back to the default.
+ * 
+ * @return maximum number of running jobs
  */ 
-void dequeue_and_execute() {
-    struct list_head *head = &queue_list;
+int get_max_jobs() {
+    struct environ_var_t *max_jobs = environ_get_var(MAX_JOBS_VAR);
+    if (max_jobs == NULL) return DEFAULT_MAX_JOBS;
+
+    int limit = atoi(max_jobs->value);
+    return (limit > 0) ? limit : DEFAULT_MAX_JOBS;
+}
+
+
+/**
+ * Returns the bucket of running jobs a pid belongs in
+ * 
+ * @param pid: pid of the job
+ * @return head of the bucket list
+ */ 
+struct list_head *pid_bucket(pid_t pid) {
+    return &pid_buckets[pid % PID_BUCKETS];
+}
+
+
+/**
+ * Returns the running job with the given pid
+ * 
+ * @param pid: pid of the job
+ * @return the job, NULL if no running job has that pid
+ */ 
+struct queue_item_t *find_job_by_pid(pid_t pid) {
+    struct list_head *head = pid_bucket(pid);
     struct list_head *curr;
     struct queue_item_t *queue_item;
 
-    if (!list_empty(head)) {
-        for (curr = head->next; curr != head; curr = curr->next) {
-            queue_item = list_entry(curr, struct queue_item_t, list);
-
-            // find first job that has not been completed
-            if (!queue_item->is_complete) {
-                job_running = true;
-                fork_and_execute_background(queue_item);
-                return;
-            }
+    for (curr = head->next; curr != head; curr = curr->next) {
+        queue_item = list_entry(curr, struct queue_item_t, pid_list);
+        if (queue_item->pid == pid)
+            return queue_item;
+    }
+    return NULL;
+}
+
+
+/**
+ * Returns the job with the given job id
+ * 
+ * @param job_id: id of the job
+ * @return the job, NULL if there is no job with that id
+ */ 
+struct queue_item_t *find_job_by_id(int job_id) {
+    if (job_id < jobs_by_id_base || job_id >= job_count) return NULL;
+    return jobs_by_id[job_id - jobs_by_id_base];
+}
+
+
+/**
+ * Checks if a finished job failed, jobs waiting for a failed job are skipped
+ * 
+ * @param queue_item: finished job
+ * @return true if the job failed, was canceled or was skipped
+ */ 
+bool job_failed(struct queue_item_t *queue_item) {
+    return queue_item->exit_status != 0 || queue_item->is_canceled || queue_item->is_skipped;
+}
+
+
+void skip_job(struct queue_item_t *queue_item);
+
+
+/**
+ * Releases the jobs waiting for a job that finished. A dependent whose last dependency
+ * finished is added to the jobs waiting to start, unless the job failed in which case
+ * the dependent is skipped.
+ * 
+ * @param queue_item: job that finished
+ */ 
+void resolve_dependents(struct queue_item_t *queue_item) {
+    bool failed = job_failed(queue_item);
+
+    for (int i = 0; i < queue_item->num_dependents; i++) {
+        struct queue_item_t *dependent = find_job_by_id(queue_item->dependents[i]);
+
+        // canceled, or skipped through another dependency already
+        if (dependent == NULL || dependent->is_complete) continue;
+
+        if (failed) 
+            skip_job(dependent);
+        else if (--dependent->waiting_on == 0) 
+            list_add_tail(&dependent->pending_list, &pending_list);
+    }
+
+    free(queue_item->dependents);
+    queue_item->dependents = NULL;
+    queue_item->num_dependents = 0;
+}
+
+
+/**
+ * Marks a job as skipped because a job it depends on failed, and skips every job
+ * that depends on it in turn
+ * 
+ * @param queue_item: job to skip
+ */ 
+void skip_job(struct queue_item_t *queue_item) {
+    queue_item->is_skipped = true;
+    queue_item->is_complete = true;
+    queue_item->exit_status = EXIT_NOT_STARTED;
+    list_del(&queue_item->pending_list);
+    journal_update(queue_item);
+
+    resolve_dependents(queue_item);
+}
+
+
+/**
+ * Dequeues and executes jobs that have not been started, oldest first, until
+ * the maximum number of jobs are running. Only jobs whose dependencies finished
+ * are waiting to start. A job that fails to start is marked complete and failed
+ * so it does not block the jobs behind it.
+ */ 
+void dequeue_and_execute() {
+    struct queue_item_t *queue_item;
+    int max_jobs = get_max_jobs();
+
+    while (!list_empty(&pending_list) && jobs_running < max_jobs) {
+        queue_item = list_entry(pending_list.next, struct queue_item_t, pending_list);
+        list_del(&queue_item->pending_list);
+
+        fork_and_execute_background(queue_item);
+
+        // running jobs are indexed by pid so the reaper can find them
+        if (queue_item->pid > 0) {
+            list_add_tail(&queue_item->pid_list, pid_bucket(queue_item->pid));
+            jobs_running++;
+        } else {
+            queue_item->is_complete = true;
+            queue_item->exit_status = EXIT_NOT_STARTED;
+        }
+        journal_update(queue_item);
+
+        if (queue_item->is_complete) resolve_dependents(queue_item);
+    }
+}
+
+
+/**
+ * Sets the maximum number of jobs that may run at the same time and starts
+ * queued jobs if the limit was raised.
+ * 
+ * @param max_jobs: maximum number of running jobs
+ */ 
+void set_max_jobs(int max_jobs) {
+    char value[16];
+    snprintf(value, sizeof(value), "%d", max_jobs);
+    environ_set_var(MAX_JOBS_VAR, value);
+
+    dequeue_and_execute();
+}
+
+
+/**
+ * Prints the number of running jobs and the maximum number of jobs that may
+ * run at the same time
+ */ 
+void print_jobs_limit() {
+    background_reap();
+    LOG_MSG(MSG_JOBS_LIMIT, jobs_running, get_max_jobs());
+}
+
+
+/**
+ * Returns the number of jobs that were started and not yet reaped
+ * 
+ * @return number of running jobs
+ */ 
+int background_jobs_running() {
+    return jobs_running;
+}
+
+
+/**
+ * Returns the id the next queued job is given
+ * 
+ * @return job id
+ */ 
+int background_next_job_id() {
+    return job_count;
+}
+
+
+/**
+ * Checks that every job a new job should wait for exists, prints an error for the first
+ * one that does not
+ * 
+ * @param job_ids: ids of the jobs
+ * @param num_ids: number of ids
+ * @return true if all jobs exist
+ */ 
+bool queue_jobs_exist(int *job_ids, int num_ids) {
+    for (int i = 0; i < num_ids; i++) {
+        if (find_job_by_id(job_ids[i]) == NULL) {
+            LOG_ERROR(ERROR_QUEUE_AFTER_JOB, job_ids[i]);
+            return false;
         }
     }
+    return true;
+}
+
+
+/**
+ * Adds a job to the jobs waiting for another job
+ * 
+ * @param queue_item: job that is waited for
+ * @param job_id: id of the job that waits
+ */ 
+void add_dependent(struct queue_item_t *queue_item, int job_id) {
+    queue_item->dependents = realloc(queue_item->dependents, (queue_item->num_dependents + 1) * sizeof(int));
+    queue_item->dependents[queue_item->num_dependents++] = job_id;
+}
+
+
+/**
+ * Drops the slots of removed jobs at the front of the job index. The queue is in order
+ * of job id so the first job in the queue is the oldest one still indexed.
+ * 
+ * @param job_id: id of the job being added, the first slot when the queue is empty
+ */ 
+void index_drop_removed(int job_id) {
+    int oldest = list_empty(&queue_list) ? job_id : list_entry(queue_list.next, struct queue_item_t, list)->job_id;
+    int dropped = oldest - jobs_by_id_base;
+    if (dropped <= 0) return;
+
+    int kept = job_count - 1 - oldest;
+    if (kept > 0) memmove(jobs_by_id, jobs_by_id + dropped, kept * sizeof(struct queue_item_t *));
+    jobs_by_id_base = oldest;
 }
 
 
 /**
  * Initialized queue_item struct and adds the item to the back of the 
- * command queue
+ * command queue. The queue takes ownership of the command, which must
+ * be a copy made with command_clone.
+ * 
+ * The job is started once every job it waits for finished successfully,
+ * if any of them failed it is skipped along with every job waiting for it.
  * 
  * @param command: command to add to queue
+ * @param options: jobs to wait for, checked with queue_jobs_exist, and limits, NULL for none
  */ 
-void add_to_queue(struct command_t *command) {
+void add_to_queue(struct command_t *command, struct queue_options_t *options) {
     struct queue_item_t *queue_item = malloc(sizeof(struct queue_item_t));
+    int *after = (options != NULL) ? options->after : NULL;
+    int num_after = (options != NULL) ? options->num_after : 0;
 
     // initialize queue item and assign next job id
     queue_item->job_id = job_count++;
+    queue_item->pid = 0;
     queue_item->is_complete = false;
-    queue_item->outfile = strdup(command->outfile);
+    queue_item->is_canceled = false;
+    queue_item->is_skipped = false;
+    queue_item->exit_status = 0;
+    queue_item->waiting_on = 0;
+    queue_item->dependents = NULL;
+    queue_item->num_dependents = 0;
     queue_item->command = command;
+    list_init(&queue_item->pending_list);
+    list_init(&queue_item->pid_list);
+    list_init(&queue_item->capture_list);
+
+    // the child of the job applies its limits, the command points at the copy the queue item owns
+    if (options != NULL) {
+        queue_item->limits = options->limits;
+        joblimits_assign_cpus(&queue_item->limits);
+    } else {
+        memset(&queue_item->limits, 0, sizeof(queue_item->limits));
+    }
+    command->limits = joblimits_active(&queue_item->limits) ? &queue_item->limits : NULL;
+
+    // queue item owns the temp file name, a command without one has its output captured in memory
+    queue_item->outfile = command->outfile;
+    if (command->outfile != NULL) {
+        queue_item->capture = NULL;
+    } else {
+        queue_item->capture = capture_create(get_capture_limit());
+    }
+
+    // index job by its id, growing the index when full
+    if (queue_item->job_id - jobs_by_id_base >= jobs_by_id_capacity) index_drop_removed(queue_item->job_id);
+    if (queue_item->job_id - jobs_by_id_base >= jobs_by_id_capacity) {
+        jobs_by_id_capacity = (jobs_by_id_capacity == 0) ? 16 : jobs_by_id_capacity * 2;
+        jobs_by_id = realloc(jobs_by_id, jobs_by_id_capacity * sizeof(struct queue_item_t *));
+    }
+    jobs_by_id[queue_item->job_id - jobs_by_id_base] = queue_item;
+    journal_add(queue_item, after, num_after);
 
     // add item to back of queue
     list_add_tail(&queue_item->list, &queue_list);
 
-    // if nothing is running in background, all commands are done or this is the first so execute
-    if (!job_running) 
-        dequeue_and_execute();
+    // wait for every dependency still running or queued, one that already failed skips the job
+    bool dependency_failed = false;
+    for (int i = 0; i < num_after; i++) {
+        struct queue_item_t *dependency = find_job_by_id(after[i]);
+        if (dependency == NULL) continue;
+
+        if (!dependency->is_complete) {
+            add_dependent(dependency, queue_item->job_id);
+            queue_item->waiting_on++;
+        } else if (job_failed(dependency)) {
+            dependency_failed = true;
+        }
+    }
+
+    // job is ready once nothing is left to wait for
+    if (dependency_failed) 
+        skip_job(queue_item);
+    else if (queue_item->waiting_on == 0) 
+        list_add_tail(&queue_item->pending_list, &pending_list);
+
+    // start the job if there is a free slot
+    dequeue_and_execute();
 }
 
 
 /**
- * Prints the status of all commands to the console except the command that is
- * currently being executed in the background
+ * Queues a job of a previous shell again. Dependencies on jobs that were queued again
+ * are kept and dependencies on jobs that succeeded are dropped, a job that depends on
+ * any other job is not queued as it would be skipped.
+ * 
+ * @param records: records of the previous shell
+ * @param num_records: number of records
+ * @param index: index of the record to recover
+ * @param new_ids: job ids recovered jobs were given, -1 for jobs that were not recovered
+ * @return job id the job was given, -1 if it was not recovered
+ */ 
+int recover_job(struct journal_record_t *records, int num_records, int index, int *new_ids) {
+    struct journal_record_t *record = &records[index];
+    char line[RECOVER_LINE_SIZE];
+    int length;
+
+    // only jobs that never started can be run again
+    if (record->flags & (JOURNAL_REMOVED | JOURNAL_NO_RECOVER)) return -1;
+    if (record->state != JOURNAL_QUEUED && record->state != JOURNAL_WAITING) return -1;
+
+    length = snprintf(line, sizeof(line), "queue");
+    for (int i = 0, kept = 0; i < record->num_after; i++) {
+        int dependency = record->after[i];
+        if (dependency < 0 || dependency >= num_records) return -1;
+
+        if (new_ids[dependency] >= 0) {
+            length += snprintf(line + length, sizeof(line) - length, "%s%d", 
+                               (kept++ == 0) ? " --after " : ",", new_ids[dependency]);
+        } else if (records[dependency].state != JOURNAL_COMPLETE || records[dependency].exit_status != 0) {
+            return -1;
+        }
+    }
+    snprintf(line + length, sizeof(line) - length, " %s", record->command);
+
+    // queued through the command line so it is set up as if it was typed
+    int job_id = job_count;
+    if (do_command(line) < 0 || job_count == job_id) return -1;
+
+    LOG_MSG(MSG_JOURNAL_RECOVER, record->job_id, job_id);
+    return job_id;
+}
+
+
+/**
+ * Opens the job journal named by SUSH_JOURNAL and queues the jobs a previous shell
+ * left waiting to start. Does nothing if SUSH_JOURNAL is not set.
+ */ 
+void background_journal_init() {
+    struct environ_var_t *path = environ_get_var(JOURNAL_VAR);
+    struct journal_record_t *records;
+
+    if (path == NULL) return;
+
+    int num_records = journal_open(path->value, &records);
+    if (num_records < 0) {
+        LOG_ERROR(ERROR_JOURNAL_OPEN, path->value, strerror(errno));
+        return;
+    }
+
+    // records are in job id order so dependencies are recovered before their dependents
+    int *new_ids = malloc(num_records * sizeof(int));
+    for (int i = 0; i < num_records; i++) {
+        new_ids[i] = recover_job(records, num_records, i, new_ids);
+    }
+
+    free(new_ids);
+    free(records);
+}
+
+
+/**
+ * Prints the status of all commands to the console, queued, running with the pid
+ * of the job or complete
  */ 
 void print_all_job_status() {
     struct list_head *head = &queue_list;
     struct list_head *curr;
     struct queue_item_t *queue_item;
+    char limits[512];
+
+    background_reap();
 
     for (curr = head->next; curr != head; curr = curr->next) {
         queue_item = list_entry(curr, struct queue_item_t, list);
 
+        // command was skipped because a job it depends on failed
+        if (queue_item->is_skipped) {
+            LOG_MSG(MSG_STATUS_SKIPPED, queue_item->job_id);
+        }
         // command is complete
-        if (queue_item->is_complete) {
+        else if (queue_item->is_complete) {
             LOG_MSG(MSG_STATUS_COMPLETE, queue_item->job_id);
         }
+        // command waits for other jobs to finish
+        else if (queue_item->waiting_on > 0) {
+            LOG_MSG(MSG_STATUS_WAITING, queue_item->job_id, queue_item->waiting_on);
+        }
         // command is queued and not running so no pid has been assigned
         else if (queue_item->pid == 0) {
             LOG_MSG(MSG_STATUS_QUEUED, queue_item->job_id);
         }
         // command is runnning and not complete
         else {
-            LOG_MSG(MSG_STATUS_RUNNING, queue_item->job_id, queue_item->job_id);
+            LOG_MSG(MSG_STATUS_RUNNING, queue_item->job_id, queue_item->pid);
+        }
+
+        // resources the job was given
+        if (queue_item->command->limits != NULL) {
+            joblimits_describe(queue_item->command->limits, limits, sizeof(limits));
+            LOG_MSG(MSG_STATUS_LIMITS, queue_item->job_id, limits);
         }
     }
 }
@@ -198,25 +768,22 @@ void print_all_job_status() {
  * memory allocated to queue item.
  */ 
 void delete_file_and_remove_command(struct queue_item_t *queue_item) {
-    // free all tokens and token array
-    int num_toks = queue_item->command->num_tokens;
-    for (int j=0;j<num_toks; j++ ) {
-        free(queue_item->command->tokens[j]);
-    }
-    free(queue_item->command->tokens);
-
-    // free filename output file template name
-    free(queue_item->command->outfile);
-    
-    // free command struct
+    // free command struct, its tokens are in the same allocation
     free(queue_item->command);
+    free(queue_item->dependents);
 
-    // remove from queue
+    // remove from queue and from every index
     list_del(&queue_item->list);
+    list_del(&queue_item->pending_list);
+    list_del(&queue_item->pid_list);
+    list_del(&queue_item->capture_list);
+    jobs_by_id[queue_item->job_id - jobs_by_id_base] = NULL;
+    journal_remove(queue_item->job_id);
 
-    // delete temp file 
-    remove(queue_item->outfile);
+    // delete temp file or free the captured output
+    if (queue_item->outfile != NULL) remove(queue_item->outfile);
     free(queue_item->outfile);
+    if (queue_item->capture != NULL) capture_free(queue_item->capture);
 
     // free memory storing output file name
     free(queue_item);
@@ -224,130 +791,375 @@ void delete_file_and_remove_command(struct queue_item_t *queue_item) {
 
 
 /**
- * Call back function to handle all signals registered in main shell function. 
- * Our shell registers this function to handle SIGCHLD in order to determine if jobs
- * from the queue have been completed and the next should be run. 
+ * Reads the output of every job whose capture pipe is still open
+ */ 
+void background_drain_captures() {
+    struct list_head *head = &capture_list;
+    struct list_head *curr = head->next;
+
+    while (curr != head) {
+        struct queue_item_t *queue_item = list_entry(curr, struct queue_item_t, capture_list);
+        curr = curr->next;
+        drain_capture(queue_item);
+    }
+}
+
+
+/**
+ * Reaps a running job if it finished, records its exit status and starts or skips the
+ * jobs waiting for it. A job that was canceled while running is removed once reaped.
  * 
- * This function is also used to confirm if a job in the background was cancelled successfully.
+ * @param queue_item: running job to check
+ * @return true if the job was reaped
+ */ 
+bool reap_job(struct queue_item_t *queue_item) {
+    int status;
+
+    if (waitpid(queue_item->pid, &status, WNOHANG) <= 0) return false;
+
+    list_del(&queue_item->pid_list);
+    drain_capture(queue_item);
+    queue_item->exit_status = wait_status_to_exit_status(status);
+    queue_item->is_complete = true;
+    jobs_running--;
+    journal_update(queue_item);
+
+    // start or skip the jobs waiting for it
+    resolve_dependents(queue_item);
+
+    // job was sent a kill signal to cancel
+    if (queue_item->is_canceled) {
+        LOG_MSG(MSG_CANCEL_OK, queue_item->job_id);
+        delete_file_and_remove_command(queue_item);
+    }
+
+    return true;
+}
+
+
+/**
+ * Checks every running job one by one and reaps the ones that finished
  * 
- * @param signal: signal id
+ * @return true if any job was reaped
  */ 
-void sig_handler(int signal) {
-    pid_t pid;
-    struct list_head *head = &queue_list;
-    struct list_head *curr;
-    struct queue_item_t *queue_item;
-    bool run_next = false; // set to true if the child was a background command
+bool reap_running_jobs() {
+    bool reaped = false;
 
-    // scan queue and check if pid matches
-    for (curr = head->next; curr != head; curr = curr->next) {
-        queue_item = list_entry(curr, struct queue_item_t, list);
-        pid_t job_pid = queue_item->pid;
-        
-        // id pid matches, this was the command that just completed
-        if ((pid = waitpid(job_pid, NULL, WNOHANG)) > 0) {
-            job_running = false;
-
-            // job completed normally
-            if (signal == SIGCHLD) {
-                queue_item->is_complete = true;
-            }
-            // job was sent a kill signal to cancel
-            if (signal == SIGKILL) {
-                delete_file_and_remove_command(queue_item);
-                LOG_MSG(MSG_CANCEL_OK, queue_item->job_id);
-            }
-
-            run_next = true;
+    for (int i = 0; i < PID_BUCKETS; i++) {
+        struct list_head *head = &pid_buckets[i];
+        struct list_head *curr = head->next;
+
+        // a reaped job leaves the bucket, the next one is found first
+        while (curr != head) {
+            struct queue_item_t *queue_item = list_entry(curr, struct queue_item_t, pid_list);
+            curr = curr->next;
+            reaped |= reap_job(queue_item);
         }
     }
+    return reaped;
+}
 
-    // child was the previous background command, run the next in queue
-    if (run_next)
+
+/**
+ * Reaps every background job that finished, records its exit status and starts
+ * queued jobs in the slots that were freed. Jobs that were canceled while running
+ * are removed from the queue once reaped. Output waiting in capture pipes is read first.
+ * 
+ * Each exited child is looked at without reaping it and found by its pid, only jobs
+ * are reaped, so reaping while a pipeline runs does not take the exit status of its
+ * commands. An exited child of the pipeline hides any child behind it, the running
+ * jobs are then checked one by one.
+ */ 
+void background_reap() {
+    struct signalfd_siginfo info;
+    bool reaped = false;
+
+    // take the pending signal, any child that exits after this raises it again
+    while (read(sigchld_fd, &info, sizeof(info)) > 0);
+
+    // jobs blocked on a full capture pipe can only finish once it is read
+    background_drain_captures();
+
+    while (true) {
+        siginfo_t child;
+        child.si_pid = 0;
+
+        // no child exited
+        if (waitid(P_ALL, 0, &child, WEXITED | WNOHANG | WNOWAIT) < 0 || child.si_pid == 0) break;
+
+        // child of a pipeline the shell waits for, it is left for the pipeline to reap
+        struct queue_item_t *queue_item = find_job_by_pid(child.si_pid);
+        if (queue_item == NULL) {
+            reaped |= reap_running_jobs();
+            break;
+        }
+
+        if (!reap_job(queue_item)) break;
+        reaped = true;
+    }
+
+    // run the next jobs in queue
+    if (reaped)
         dequeue_and_execute();
 }
 
 
 /**
- * Checks if a given command is currently in the queue. This is used when doing any
- * cleanup so we avoid double freeing a pointer.
+ * Waits in the event loop until a child of the shell changed state. Jobs that finished
+ * meanwhile are reaped and the next ones started, so the queue keeps moving while the
+ * shell waits for a pipeline.
+ * 
+ * @return status of waiting, ERROR if SIGCHLD is not delivered through the event loop
+ */ 
+int background_wait_child() {
+    if (sigchld_fd < 0) return ERROR;
+    return (eventloop_run_once(-1) < 0) ? ERROR : SUCCESS;
+}
+
+
+/**
+ * Checks that every job to wait for exists, prints an error for the first one that does not
  * 
- * @param command: command to search for in queue
+ * @param job_ids: ids of the jobs
+ * @param num_ids: number of ids
+ * @return true if all jobs exist
  */ 
-bool is_command_in_queue(struct command_t *command) {
+bool wait_jobs_exist(int *job_ids, int num_ids) {
+    for (int i = 0; i < num_ids; i++) {
+        if (find_job_by_id(job_ids[i]) == NULL) {
+            LOG_ERROR(ERROR_WAIT_JOB, job_ids[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Checks if the jobs to wait for are finished, jobs that were removed meanwhile count as
+ * finished. Without ids every job in the queue is checked.
+ * 
+ * @param job_ids: ids of the jobs
+ * @param num_ids: number of ids, 0 for every job
+ * @param failed: set to true if any of the jobs failed
+ * @return true if all jobs finished
+ */ 
+bool jobs_finished(int *job_ids, int num_ids, bool *failed) {
     struct list_head *head = &queue_list;
     struct list_head *curr;
-    struct queue_item_t *queue_item;
 
-    for (curr = head->next; curr != head; curr = curr->next) {
-        queue_item = list_entry(curr, struct queue_item_t, list);
+    *failed = false;
 
-        // queue item points to same address
-        if (queue_item->command == command) {
-            return true;
+    if (num_ids == 0) {
+        for (curr = head->next; curr != head; curr = curr->next) {
+            struct queue_item_t *queue_item = list_entry(curr, struct queue_item_t, list);
+            if (!queue_item->is_complete) return false;
+            *failed |= job_failed(queue_item);
         }
+        return true;
     }
 
-    return false;
+    for (int i = 0; i < num_ids; i++) {
+        struct queue_item_t *queue_item = find_job_by_id(job_ids[i]);
+        if (queue_item == NULL) continue;
+        if (!queue_item->is_complete) return false;
+        *failed |= job_failed(queue_item);
+    }
+    return true;
 }
 
 
 /**
- * Prints contents of an output file given the file name/path
+ * Waits until the given jobs finished, or every job in the queue without ids. Queued jobs
+ * are started as slots free up while waiting. The shell sleeps in the event loop until a
+ * job exits or writes output instead of checking the jobs over and over.
  * 
- * @param fname: name/path to file
+ * @param job_ids: ids of the jobs
+ * @param num_ids: number of ids, 0 for every job
+ * @return SUCCESS if all jobs succeeded, ERROR if a job does not exist or any failed
  */ 
-void print_output_file(char *fname) {
-    FILE *fp = fopen(fname, "r");
+int wait_for_jobs(int *job_ids, int num_ids) {
+    bool failed;
+
+    background_reap();
+    if (!wait_jobs_exist(job_ids, num_ids)) return ERROR;
+
+    while (!jobs_finished(job_ids, num_ids, &failed)) {
+        // a forked copy of the shell has no loop and none of the jobs are its children
+        if (eventloop_run_once(-1) < 0) return ERROR;
+    }
+
+    return failed ? ERROR : SUCCESS;
+}
+
+
+/**
+ * Handler the event loop runs when inotify reports the output file of a followed job
+ * changed, the events are read so the watch is not readable until the file changes again
+ * 
+ * @param fd: inotify instance
+ * @param data: unused
+ */ 
+void drain_events(int fd, void *data) {
+    char events[4096];
+    while (read(fd, events, sizeof(events)) > 0);
+}
+
+
+/**
+ * Writes the output a job produced since the last call, from memory or from its file
+ * 
+ * @param queue_item: job to write output of
+ * @param fd: output file of the job, -1 when its output is captured
+ * @param offset: number of bytes already written, moved past the bytes written
+ */ 
+void write_new_output(struct queue_item_t *queue_item, int fd, size_t *offset) {
+    if (queue_item->capture != NULL) {
+        capture_write_from(queue_item->capture, offset, STDOUT_FILENO);
+    } else if (fd >= 0) {
+        off_t file_offset = *offset;
+        copy_file_from(fd, &file_offset, STDOUT_FILENO);
+        *offset = file_offset;
+    }
+}
+
+
+/**
+ * Writes the output of a job as it is produced, like tail -f, until the job finished.
+ * A queued job is waited for until it starts. Captured output is written whenever the
+ * capture pipe is read, output going to a file is written when inotify reports the file
+ * was written to, or on a timer if inotify can not watch it. The job is removed once all
+ * of its output was written, like output N. If waiting fails before the job finished the
+ * job is left in the queue.
+ * 
+ * @param job_id: id of job to follow
+ */ 
+void follow_output(int job_id) {
+    background_reap();
+
+    struct queue_item_t *queue_item = find_job_by_id(job_id);
+    if (queue_item == NULL) return;
+
+    // a job writing to a file is followed through the file
+    int fd = -1;
+    int watch_fd = -1;
+    if (queue_item->capture == NULL) {
+        fd = open(queue_item->outfile, O_RDONLY | O_CLOEXEC);
+        watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watch_fd >= 0 && (inotify_add_watch(watch_fd, queue_item->outfile, IN_MODIFY) < 0 ||
+                eventloop_watch(watch_fd, drain_events, NULL) < 0)) {
+            close(watch_fd);
+            watch_fd = -1;
+        }
+
+        // without inotify the file is checked on a timer
+        if (watch_fd < 0) watch_fd = eventloop_timer(FOLLOW_INTERVAL_MS, NULL, NULL);
+    }
+
+    size_t offset = 0;
+
+    // anything already printed comes before the output
+    fflush(stdout);
+
+    while (true) {
+        write_new_output(queue_item, fd, &offset);
+        if (queue_item->is_complete) break;
+
+        // the job exits, writes output or its file changed
+        if (eventloop_run_once(-1) < 0) break;
+
+        // a job canceled before it was followed is removed once reaped
+        queue_item = find_job_by_id(job_id);
+        if (queue_item == NULL) break;
+    }
+
+    if (fd >= 0) close(fd);
+    if (watch_fd >= 0) {
+        eventloop_unwatch(watch_fd);
+        close(watch_fd);
+    }
+
+    if (queue_item == NULL) return;
 
-    // read and print each line of file
-    char line[LINE_BUFFER];
-    while (fgets(line, LINE_BUFFER, fp)) {
-        printf("%s", line);
+    // waiting failed while the job runs, it stays queued and is reaped like any other job
+    if (!queue_item->is_complete) {
+        LOG_ERROR(ERROR_OUTPUT_FOLLOW, job_id);
+        return;
     }
+
+    if (queue_item->capture != NULL && queue_item->capture->truncated)
+        LOG_ERROR(ERROR_OUTPUT_TRUNCATED, job_id);
+
+    // all output was viewed
+    delete_file_and_remove_command(queue_item);
+}
+
+
+/**
+ * Writes contents of an output file to stdout given the file name/path. Anything
+ * already printed through stdio is flushed first so the output stays in order.
+ * 
+ * @param fname: name/path to file
+ * @param range: part of the file to print
+ * @param lines: number of lines for OUTPUT_HEAD and OUTPUT_TAIL
+ */ 
+void print_output_file(char *fname, enum output_range_e range, long lines) {
+    int fid = open(fname, O_RDONLY);
+    if (fid < 0) return;
+
+    fflush(stdout);
+    file_write_range(fid, range, lines, STDOUT_FILENO);
+
     // close file
-    fclose(fp);
+    close(fid);
 }
 
 
 /**
  * Prints the output of the command with the specified job id if the command is complete. 
- * The output of the command is stored in a temporary file and the contents is printed to 
- * the console. Once commands output is viewed, the command is removed from queue and file
- * deleted.
+ * The output of the command is stored in a temporary file or in memory and the contents
+ * is written to the console. Once commands whole output is viewed, the command is removed 
+ * from queue and file deleted. Printing only the head or tail of the output keeps the job
+ * so the rest can still be viewed.
  * 
  * @param job_id: id of job to print output file and remove from queue
+ * @param range: part of the output to print
+ * @param lines: number of lines for OUTPUT_HEAD and OUTPUT_TAIL
  */ 
-void print_output_and_remove(int job_id) {
-    struct list_head *head = &queue_list;
-    struct list_head *curr;
-    struct queue_item_t *queue_item;
+void print_output_and_remove(int job_id, enum output_range_e range, long lines) {
+    background_reap();
 
-    for (curr = head->next; curr != head; curr = curr->next) {
-        queue_item = list_entry(curr, struct queue_item_t, list);
+    struct queue_item_t *queue_item = find_job_by_id(job_id);
+    if (queue_item == NULL) return;
 
-        if (job_id == queue_item->job_id) {
-
-            // job is still running
-            if (queue_item->pid != 0 && !queue_item->is_complete) {
-                // Print error if there is one or more args
-                LOG_ERROR(ERROR_OUTPUT_RUNNING, queue_item->job_id);
-            }
-            // job still in queue and not complete
-            else if (queue_item->pid == 0 && !queue_item->is_complete) {
-                // Print error if there is one or more args
-                LOG_ERROR(ERROR_OUTPUT_QUEUED, queue_item->job_id);
-            }
-            // job is complete, display output and remove file and queue item
-            else {
-                // print contents of file
-                print_output_file(queue_item->outfile);
-                // delete file and remove command from queue 
-                delete_file_and_remove_command(queue_item);
-            }
-            break;
-        }
+    // job is still running
+    if (queue_item->pid != 0 && !queue_item->is_complete) {
+        // Print error if there is one or more args
+        LOG_ERROR(ERROR_OUTPUT_RUNNING, queue_item->job_id);
+        return;
     }
+    // job still in queue and not complete
+    else if (queue_item->pid == 0 && !queue_item->is_complete) {
+        // Print error if there is one or more args
+        LOG_ERROR(ERROR_OUTPUT_QUEUED, queue_item->job_id);
+        return;
+    }
+
+    // job is complete, display output
+    if (queue_item->capture != NULL) {
+        // write captured output after anything already printed
+        fflush(stdout);
+        drain_capture(queue_item);
+        capture_write_range(queue_item->capture, range, lines, STDOUT_FILENO);
+        if (queue_item->capture->truncated) LOG_ERROR(ERROR_OUTPUT_TRUNCATED, queue_item->job_id);
+    } else {
+        // print contents of file
+        print_output_file(queue_item->outfile, range, lines);
+    }
+
+    // delete file and remove command from queue once all output was viewed
+    if (range == OUTPUT_ALL)
+        delete_file_and_remove_command(queue_item);
 }
 
 
@@ -359,28 +1171,51 @@ void print_output_and_remove(int job_id) {
  * @param job_id: id of job to attempt cancel
  */ 
 void attempt_cancel_command(int job_id) {
+    background_reap();
+
+    struct queue_item_t *queue_item = find_job_by_id(job_id);
+    if (queue_item == NULL) return;
+
+    // unable to cancel, job is done
+    if (queue_item->is_complete && queue_item->pid != 0) {
+        LOG_ERROR(ERROR_CANCEL_DONE, job_id, job_id);
+    } 
+    // attempt kill, job is running. It is removed once reaped
+    else if (!queue_item->is_complete && queue_item->pid != 0) {
+        LOG_ERROR(MSG_CANCEL_KILL, job_id, queue_item->pid);
+        queue_item->is_canceled = true;
+        kill(queue_item->pid, SIGKILL);
+        journal_update(queue_item);
+    } 
+    // able to cancel, remove from queue. Jobs waiting for it will never run
+    else {
+        queue_item->is_canceled = true;
+        journal_update(queue_item);
+        if (!queue_item->is_complete) resolve_dependents(queue_item);
+        delete_file_and_remove_command(queue_item);
+    }
+}
+
+
+/**
+ * Counts the memory held by the jobs in the queue, their commands and captured output
+ * 
+ * @param usage: counters to add to
+ */ 
+void background_memory(struct mem_usage_t *usage) {
     struct list_head *head = &queue_list;
     struct list_head *curr;
-    struct queue_item_t *queue_item;
+
+    mem_count(usage, jobs_by_id);
 
     for (curr = head->next; curr != head; curr = curr->next) {
-        queue_item = list_entry(curr, struct queue_item_t, list);
-        
-        if (job_id == queue_item->job_id) {
-            // unable to cancel, job is done
-            if (queue_item->is_complete && queue_item->pid != 0) {
-                LOG_ERROR(ERROR_CANCEL_DONE, job_id, job_id);
-            } 
-            // attempt kill, job is running
-            else if (!queue_item->is_complete && queue_item->pid != 0) {
-                LOG_ERROR(MSG_CANCEL_KILL, job_id, queue_item->pid);
-                kill(queue_item->pid, SIGKILL);
-            } 
-            // able to cancel, remove from queue
-            else {
-                delete_file_and_remove_command(queue_item);
-            }
-        }
+        struct queue_item_t *queue_item = list_entry(curr, struct queue_item_t, list);
+
+        mem_count(usage, queue_item);
+        mem_count(usage, queue_item->command);
+        mem_count(usage, queue_item->outfile);
+        mem_count(usage, queue_item->dependents);
+        if (queue_item->capture != NULL) capture_memory(queue_item->capture, usage);
     }
 }
 
@@ -392,14 +1227,21 @@ void attempt_cancel_command(int job_id) {
  */ 
 void queue_cleanup() {
     struct list_head *head = &queue_list;
-    struct list_head *curr;
-    struct queue_item_t *queue_item;
-
-    for (curr = head->next; curr != head; curr = curr->next) {
-        queue_item = list_entry(curr, struct queue_item_t, list);
 
-        curr = curr->prev;
+    // records are kept as they are so the next shell can recover waiting jobs
+    journal_close();
 
-        delete_file_and_remove_command(queue_item);
+    while (!list_empty(head)) {
+        delete_file_and_remove_command(list_entry(head->next, struct queue_item_t, list));
     }
-}
\ No newline at end of file
+
+    free(jobs_by_id);
+    jobs_by_id = NULL;
+    jobs_by_id_capacity = 0;
+    jobs_by_id_base = job_count;
+
+    // children are reaped by whoever sets the queue up again
+    eventloop_unwatch(sigchld_fd);
+    if (sigchld_fd >= 0) close(sigchld_fd);
+    sigchld_fd = -1;
+}
@@ -8,17 +8,30 @@
  * Functions include validators, queueing and dequeing commands, seeing that status and viewing
  * output of a command.
  * 
- * There is a signal handler used by the queue to handle dequeuing the next process. The shell
- * registers the handler on initialization.
+ * SIGCHLD wakes the event loop when a job finished and the shell reaps jobs with background_reap
+ * whenever it waits, at the prompt and while a foreground pipeline runs.
  */ 
 
 #include <stddef.h>
 #include <stdbool.h>
 #include <signal.h>
 
+#include "list.h"
+#include "capture.h"
+#include "joblimits.h"
+
 #ifndef BACKGROUND_H
 #define BACKGROUND_H
 
+// most jobs a queued job can wait for
+#define QUEUE_MAX_AFTER 64
+
+// options of the queue command
+struct queue_options_t {
+    int after[QUEUE_MAX_AFTER];     // ids of the jobs that must finish first
+    int num_after;
+    struct job_limits_t limits;     // resources the job is limited to
+};
 
 // structure that wraps each command that is in the queue
 struct queue_item_t {
@@ -26,30 +39,72 @@ struct queue_item_t {
     int job_id;
     char *outfile;
     bool is_complete;
+    bool is_canceled;
+    bool is_skipped;                // a job it depends on failed so it was never started
+    int exit_status;
+
+    int waiting_on;                 // number of jobs it depends on that have not finished
+    int *dependents;                // ids of the jobs that wait for this one
+    int num_dependents;
 
     struct command_t *command;
-    struct list_head list;
+    struct list_head list;          // position in the queue
+    struct list_head pending_list;  // position among jobs waiting to start
+    struct list_head pid_list;      // position in pid bucket while running
+
+    struct capture_t *capture;      // output held in memory, NULL if output goes to outfile
+    struct list_head capture_list;  // position among jobs whose capture pipe is open
+
+    struct job_limits_t limits;     // resources the job is limited to, applied in its child
 };
 
 /**
- * Checks that no redirection or piping is present
+ * Creates the event loop, has SIGCHLD delivered through it so finished jobs are reaped by
+ * the loop, and initializes the job tables
  * 
- * @param command: command to validate
+ * @return status of initialization
  */ 
-bool is_valid_background_command(struct command_t *command);
+int background_init();
+
+/**
+ * Opens the job journal named by SUSH_JOURNAL and queues the jobs a previous shell
+ * left waiting to start. Does nothing if SUSH_JOURNAL is not set.
+ */ 
+void background_journal_init();
+
+/**
+ * Reaps every background job that finished, records its exit status and starts
+ * queued jobs in the slots that were freed. Jobs that were canceled while running
+ * are removed from the queue once reaped.
+ */ 
+void background_reap();
 
 /**
- * Checks if a given command is currently in the queue. This is used when doing any
- * cleanup so we avoid double freeing a pointer.
+ * Waits in the event loop until a child of the shell changed state. Jobs that finished
+ * meanwhile are reaped and the next ones started, only the pids of jobs are reaped.
  * 
- * @param command: command to search for in queue
+ * @return status of waiting, ERROR if SIGCHLD is not delivered through the event loop
  */ 
-bool is_command_in_queue(struct command_t *command);
+int background_wait_child();
+
+/**
+ * Reads the output of every job whose capture pipe is still open
+ */ 
+void background_drain_captures();
+
+/**
+ * Checks that no redirection or piping is present
+ * 
+ * @param command: command to validate
+ */ 
+bool is_valid_background_command(struct command_t *command);
 
 /**
  * Sets background command's stdin and stdout. Stdin is closed
- * and stdout always goes to a unique temp file. This configuration
- * is stored in the command struct prior to adding it to the queue
+ * and stdout goes to a unique temp file. This configuration
+ * is stored in the command struct prior to adding it to the queue.
+ * With SUSH_CAPTURE=memory, stdout is captured through a pipe in
+ * to memory instead and only spilled to a file past SUSH_CAPTURE_LIMIT.
  * 
  * @param command: command to set stdin and stdout fields
  * @return status of setup success
@@ -57,38 +112,93 @@ bool is_command_in_queue(struct command_t *command);
 int set_command_channels(struct command_t *command);
 
 /**
- * Initialized queue_item struct and adds the item to the back of the command queue
+ * Checks that every job a new job should wait for exists, prints an error for the first
+ * one that does not
+ * 
+ * @param job_ids: ids of the jobs
+ * @param num_ids: number of ids
+ * @return true if all jobs exist
+ */ 
+bool queue_jobs_exist(int *job_ids, int num_ids);
+
+/**
+ * Initialized queue_item struct and adds the item to the back of the command queue.
+ * The queue takes ownership of the command, which must be a copy made with command_clone.
+ * 
+ * The job is started once every job it waits for finished successfully, if any of them
+ * failed it is skipped along with every job waiting for it. Its limits are applied by the
+ * child process that runs it, --cpus auto picks the cpus of the next NUMA node here.
  * 
  * @param command: command to add to queue
+ * @param options: jobs to wait for, checked with queue_jobs_exist, and limits, NULL for none
  */ 
-void add_to_queue(struct command_t *command);
+void add_to_queue(struct command_t *command, struct queue_options_t *options);
 
 /**
- * Prints the status of all commands to the console except the command that is
- * currently being executed in the background
+ * Prints the status of all commands to the console, queued, running with the pid
+ * of the job or complete
  */ 
 void print_all_job_status();
 
 /**
- * Call back function to handle all signals registered in main shell function. 
- * Our shell registers this function to handle SIGCHLD in order to determine if jobs
- * from the queue have been completed and the next should be run. 
+ * Sets the maximum number of jobs that may run at the same time and starts
+ * queued jobs if the limit was raised. The limit is stored in SUSH_MAX_JOBS.
  * 
- * This function is also used to confirm if a job in the background was cancelled successfully.
+ * @param max_jobs: maximum number of running jobs
+ */ 
+void set_max_jobs(int max_jobs);
+
+/**
+ * Prints the number of running jobs and the maximum number of jobs that may
+ * run at the same time
+ */ 
+void print_jobs_limit();
+
+/**
+ * Returns the id the next queued job is given
+ * 
+ * @return job id
+ */ 
+int background_next_job_id();
+
+/**
+ * Returns the number of jobs that were started and not yet reaped
  * 
- * @param signal: signal id
+ * @return number of running jobs
  */ 
-void sig_handler(int signal);
+int background_jobs_running();
 
 /**
  * Prints the output of the command with the specified job id if the command is complete. 
- * The output of the command is stored in a temporary file and the contents is printed to 
- * the console. Once commands output is viewed, the command is removed from queue and file
- * deleted.
+ * The output of the command is stored in a temporary file or in memory and the contents
+ * is written to the console. Once commands whole output is viewed, the command is removed 
+ * from queue and file deleted. Printing only the head or tail of the output keeps the job
+ * so the rest can still be viewed.
  * 
  * @param job_id: id of job to print output file and remove from queue
+ * @param range: part of the output to print
+ * @param lines: number of lines for OUTPUT_HEAD and OUTPUT_TAIL
  */ 
-void print_output_and_remove(int job_id);
+void print_output_and_remove(int job_id, enum output_range_e range, long lines);
+
+/**
+ * Writes the output of a job as it is produced, like tail -f, until the job finished.
+ * A queued job is waited for until it starts. The job is removed once all of its output
+ * was written, like print_output_and_remove.
+ * 
+ * @param job_id: id of job to follow
+ */ 
+void follow_output(int job_id);
+
+/**
+ * Waits until the given jobs finished, or every job in the queue without ids. The shell
+ * sleeps until a job exits or writes output instead of polling the job table.
+ * 
+ * @param job_ids: ids of the jobs
+ * @param num_ids: number of ids, 0 for every job
+ * @return SUCCESS if all jobs succeeded, ERROR if a job does not exist or any failed
+ */ 
+int wait_for_jobs(int *job_ids, int num_ids);
 
 /**
  * Attempts to cancel command if not yet complete. If not yet complete the command is removed
@@ -100,6 +210,13 @@ void print_output_and_remove(int job_id);
  */ 
 void attempt_cancel_command(int job_id);
 
+/**
+ * Counts the memory held by the jobs in the queue, their commands and captured output
+ * 
+ * @param usage: counters to add to
+ */ 
+void background_memory(struct mem_usage_t *usage);
+
 /**
  * Removes all items from queue and frees memory when exiting the shell
  */ 
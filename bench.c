@@ -0,0 +1,717 @@
+/**
+ * @file: bench.c
+ * @author: Michael Permyashkin
+ *
+ * @brief: Micro-benchmarks for the hot paths of the shell
+ *
+ * Links against the same units as the shell and drives them directly without the prompt
+ * loop. Each benchmark prints one JSON object per measurement on stdout so results can be
+ * collected and compared between builds. The benchmarks cover parsing, command lookup,
+ * building the environment, launching commands, builtins, pipeline throughput, command
+ * lists, queue scheduling, startup and memory growth over a long session.
+ *
+ * The benchmark is linked with malloc, calloc, realloc and strdup wrapped so the number of
+ * allocations made by the shell code can be counted.
+ *
+ * usage: ./bench [benchmark] [iterations]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "runner.h"
+#include "arena.h"
+#include "parsecache.h"
+#include "environ.h"
+#include "executor.h"
+#include "background.h"
+#include "builtins.h"
+#include "internal.h"
+#include "memstat.h"
+#include "eventloop.h"
+#include "profile.h"
+
+
+// default number of iterations each benchmark runs
+#define DEFAULT_ITERATIONS 2000
+
+// size of memory the shell is grown to before launching commands, fork copies its page tables
+#define BALLAST_MB 256
+
+// number of lines the parse benchmark parses for each iteration
+#define PARSE_LINES_PER_ITERATION 500
+
+// sizes of the environment make_environ is measured with
+static int environ_sizes[] = { 16, 256, 4096 };
+
+// number of make_environ calls for each iteration
+#define ENVIRON_CALLS_PER_ITERATION 100
+
+// size of the data pushed through each pipeline and numbers of cat stages measured
+#define PIPELINE_MB 64
+static int pipeline_stages[] = { 1, 2, 4, 8 };
+
+// pipe sizes each pipeline is measured with, NULL for the kernel default
+static char *pipeline_pipe_sizes[] = { NULL, "1M" };
+
+// iterations for each time the data is pushed through a pipeline
+#define PIPELINE_ITERATIONS_PER_RUN 1000
+
+// number of command lines the list benchmark runs for each iteration
+#define LIST_LINES_PER_ITERATION 50
+
+// iterations for each job run by the queue benchmark
+#define QUEUE_ITERATIONS_PER_JOB 10
+
+// share of the soak commands run before the memory of the shell is first measured
+#define SOAK_WARMUP_FRACTION 10
+
+// a job is queued, waited for and its output viewed once every this many soak commands
+#define SOAK_COMMANDS_PER_JOB 1000
+
+// growth of the heap or resident size the soak allows, a fixed slack for allocator and page
+// granularity and a byte for each command, so even the smallest block leaked for each command fails
+#define SOAK_GROWTH_SLACK (256 * 1024)
+#define SOAK_GROWTH_PER_COMMAND 1
+
+// set by a benchmark that checks its results when they are wrong, bench then exits with 1
+static bool bench_failed = false;
+
+// variable naming the shell binary the startup benchmark launches
+#define SUSH_BIN_VAR "SUSH_BIN"
+#define DEFAULT_SUSH_BIN "./sush"
+
+extern char **environ;
+
+
+// benchmark struct holds name of benchmark and function that runs it
+struct benchmark_t {
+    char *name;
+    void (*run)(int iterations);
+};
+
+
+// number of allocations made since the benchmark started
+static unsigned long allocations = 0;
+
+
+// allocation functions wrapped by the linker, __real_ calls the libc function
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *str);
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    allocations++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *str) {
+    allocations++;
+    return __real_strdup(str);
+}
+
+
+/**
+ * Parses a command line for use by a benchmark. Exits if the command line is invalid.
+ * The commands live in the given arena.
+ *
+ * @param arena: arena to allocate the commands from
+ * @param cmdline: command line to parse
+ * @return array of commands
+ */
+struct command_t **bench_parse(struct arena_t *arena, char *cmdline) {
+    struct command_t **commands_arr;
+    if (parse_command(arena, &commands_arr, cmdline) <= 0) {
+        fprintf(stderr, "bench: could not parse %s\n", cmdline);
+        exit(1);
+    }
+    return commands_arr;
+}
+
+
+/**
+ * Measures lines parsed per second and allocations made per line for a pipeline with
+ * quotes and redirections, parsed every time and then copied from the parse cache. The
+ * arena is reset after each line like the prompt loop does.
+ *
+ * @param iterations: number of batches of lines to parse
+ */
+void bench_parse_lines(int iterations) {
+    char *cmdline = "grep -v \"foo bar\" < input.txt | sort -k 2 | uniq -c > out.txt\n";
+    struct arena_t arena = { .block_size = 16384 };
+    struct command_t **commands_arr;
+    long lines = (long)iterations * PARSE_LINES_PER_ITERATION;
+
+    // first line grows the arena and token array to their final size
+    parse_command(&arena, &commands_arr, cmdline);
+    arena_reset(&arena);
+
+    unsigned long start_allocations = allocations;
+    double start = profile_now();
+    for (long i = 0; i < lines; i++) {
+        parse_command(&arena, &commands_arr, cmdline);
+        arena_reset(&arena);
+    }
+    double elapsed = profile_now() - start;
+
+    printf("{\"bench\":\"parse\",\"cache\":false,\"lines\":%ld,\"lines_per_sec\":%.1f,\"allocations_per_line\":%.3f}\n",
+        lines, lines / elapsed, (double)(allocations - start_allocations) / lines);
+    fflush(stdout);
+
+    // remember the line, every lookup after is a hit
+    int num_commands = parse_command(&arena, &commands_arr, cmdline);
+    parsecache_insert(cmdline, commands_arr, num_commands);
+    arena_reset(&arena);
+
+    start_allocations = allocations;
+    start = profile_now();
+    for (long i = 0; i < lines; i++) {
+        parsecache_lookup(&arena, &commands_arr, cmdline);
+        arena_reset(&arena);
+    }
+    elapsed = profile_now() - start;
+
+    printf("{\"bench\":\"parse\",\"cache\":true,\"lines\":%ld,\"lines_per_sec\":%.1f,\"allocations_per_line\":%.3f}\n",
+        lines, lines / elapsed, (double)(allocations - start_allocations) / lines);
+    fflush(stdout);
+
+    parsecache_clear();
+
+    arena_free(&arena);
+}
+
+
+/**
+ * Measures commands per second launched with a given backend
+ *
+ * @param backend: value of SUSH_SPAWN
+ * @param iterations: number of commands to run
+ * @param ballast_mb: size the shell was grown to
+ */
+void bench_spawn_backend(char *backend, int iterations, int ballast_mb) {
+    struct arena_t arena = { .block_size = 4096 };
+    struct command_t **commands_arr = bench_parse(&arena, "/bin/true");
+
+    environ_set_var("SUSH_SPAWN", backend);
+
+    double start = profile_now();
+    for (int i=0; i<iterations; i++) {
+        execute_external_command(commands_arr, 1);
+    }
+    double elapsed = profile_now() - start;
+
+    printf("{\"bench\":\"spawn\",\"backend\":\"%s\",\"ballast_mb\":%d,\"commands\":%d,\"commands_per_sec\":%.1f}\n",
+        backend, ballast_mb, iterations, iterations / elapsed);
+    fflush(stdout);
+
+    arena_free(&arena);
+}
+
+
+/**
+ * Measures lookups per second of command names in the internal command table, for
+ * internal commands found in it and external commands that are not
+ *
+ * @param iterations: number of batches of lookups
+ */
+void bench_dispatch(int iterations) {
+    char *names[] = { "cd", "setenv", "output", "enable", "ls", "grep", "make", NULL };
+    struct command_t command;
+    long lookups = 0;
+    int found = 0;
+
+    double start = profile_now();
+    for (int i = 0; i < iterations * 100; i++) {
+        for (int n = 0; names[n] != NULL; n++) {
+            // a fresh command is looked up every time
+            command.cmd_name = names[n];
+            command.handler_resolved = false;
+            found += is_internal_command(&command);
+            lookups++;
+        }
+    }
+    double elapsed = profile_now() - start;
+
+    printf("{\"bench\":\"dispatch\",\"lookups\":%ld,\"found\":%d,\"lookups_per_sec\":%.1f}\n",
+        lookups, found, lookups / elapsed);
+    fflush(stdout);
+}
+
+
+/**
+ * Measures commands per second for builtins run in the shell and for the same commands
+ * run as executables with the builtins disabled
+ *
+ * @param iterations: number of commands to run per measurement
+ */
+void bench_builtin(int iterations) {
+    char *cmdlines[] = { "true", "echo hello > /dev/null", NULL };
+    struct arena_t arena = { .block_size = 4096 };
+
+    for (int enabled = 1; enabled >= 0; enabled--) {
+        builtin_set_enabled("true", enabled);
+        builtin_set_enabled("echo", enabled);
+
+        for (int c = 0; cmdlines[c] != NULL; c++) {
+            struct command_t **commands_arr = bench_parse(&arena, cmdlines[c]);
+
+            double start = profile_now();
+            for (int i = 0; i < iterations; i++) {
+                execute_external_command(commands_arr, 1);
+            }
+            double elapsed = profile_now() - start;
+
+            printf("{\"bench\":\"builtin\",\"cmdline\":\"%s\",\"builtin\":%s,\"commands\":%d,\"commands_per_sec\":%.1f}\n",
+                cmdlines[c], enabled ? "true" : "false", iterations, iterations / elapsed);
+            fflush(stdout);
+
+            arena_reset(&arena);
+        }
+    }
+
+    arena_free(&arena);
+}
+
+
+/**
+ * Compares the fork and posix_spawn backends, first with the shell at its normal size and
+ * then after growing it so fork has more page tables to copy.
+ *
+ * @param iterations: number of commands to run per measurement
+ */
+void bench_spawn(int iterations) {
+    bench_spawn_backend("fork", iterations, 0);
+    bench_spawn_backend("spawn", iterations, 0);
+
+    // touch every page so the memory is really mapped
+    char *ballast = malloc((size_t)BALLAST_MB << 20);
+    memset(ballast, 1, (size_t)BALLAST_MB << 20);
+
+    bench_spawn_backend("fork", iterations, BALLAST_MB);
+    bench_spawn_backend("spawn", iterations, BALLAST_MB);
+
+    free(ballast);
+    environ_remove_var("SUSH_SPAWN");
+}
+
+
+/**
+ * Measures the cost of make_environ for environments of growing size, both when the
+ * snapshot is reused and when a variable changed so the snapshot is rebuilt.
+ *
+ * @param iterations: number of batches of calls for each size
+ */
+void bench_environ(int iterations) {
+    long calls = (long)iterations * ENVIRON_CALLS_PER_ITERATION;
+    char name[32];
+
+    for (size_t s = 0; s < sizeof(environ_sizes) / sizeof(environ_sizes[0]); s++) {
+        // grow the environment to the size being measured
+        for (int i = 0; i < environ_sizes[s]; i++) {
+            snprintf(name, sizeof(name), "BENCH_VAR_%d", i);
+            environ_set_var(name, "value");
+        }
+
+        make_environ();
+        double start = profile_now();
+        for (long i = 0; i < calls; i++) {
+            make_environ();
+        }
+        double cached = profile_now() - start;
+
+        // changing a variable makes the next call rebuild the snapshot
+        start = profile_now();
+        for (long i = 0; i < calls; i++) {
+            environ_set_var("BENCH_VAR_0", (i & 1) ? "odd" : "even");
+            make_environ();
+        }
+        double rebuilt = profile_now() - start;
+
+        printf("{\"bench\":\"environ\",\"vars\":%d,\"calls\":%ld,\"cached_ns\":%.1f,\"rebuilt_ns\":%.1f}\n",
+            environ_sizes[s], calls, cached * 1e9 / calls, rebuilt * 1e9 / calls);
+        fflush(stdout);
+
+        for (int i = 0; i < environ_sizes[s]; i++) {
+            snprintf(name, sizeof(name), "BENCH_VAR_%d", i);
+            environ_remove_var(name);
+        }
+    }
+}
+
+
+/**
+ * Measures the throughput of pipelines of cat stages. A temporary file is filled with
+ * data which the first cat reads and the last writes to /dev/null. Each pipeline is
+ * measured with the default pipe size and again with large pipes.
+ *
+ * @param iterations: number of iterations, the data is pushed through each pipeline once
+ * for every PIPELINE_ITERATIONS_PER_RUN
+ */
+void bench_pipeline(int iterations) {
+    int runs = iterations / PIPELINE_ITERATIONS_PER_RUN;
+    if (runs < 1) runs = 1;
+
+    // fill the input file
+    char template[] = "/tmp/sush_bench_XXXXXX";
+    int fd = mkstemp(template);
+    if (fd < 0) {
+        fprintf(stderr, "bench: could not create input file\n");
+        return;
+    }
+    char *block = malloc(1 << 20);
+    memset(block, 'x', 1 << 20);
+    for (int i = 0; i < PIPELINE_MB; i++) {
+        if (write(fd, block, 1 << 20) != 1 << 20) break;
+    }
+    free(block);
+    close(fd);
+
+    struct arena_t arena = { .block_size = 4096 };
+    char cmdline[512];
+
+    for (size_t p = 0; p < sizeof(pipeline_pipe_sizes) / sizeof(pipeline_pipe_sizes[0]); p++) {
+        char *pipe_size = pipeline_pipe_sizes[p];
+
+        for (size_t s = 0; s < sizeof(pipeline_stages) / sizeof(pipeline_stages[0]); s++) {
+            // a single stage has no pipe to size
+            if (pipe_size != NULL && pipeline_stages[s] == 1) continue;
+
+            // cat file | cat | ... > /dev/null, every pipe written as |{size} when sized
+            int length = snprintf(cmdline, sizeof(cmdline), "cat %s", template);
+            for (int i = 1; i < pipeline_stages[s]; i++) {
+                if (pipe_size != NULL) 
+                    length += snprintf(cmdline + length, sizeof(cmdline) - length, " |{%s} cat", pipe_size);
+                else 
+                    length += snprintf(cmdline + length, sizeof(cmdline) - length, " | cat");
+            }
+            snprintf(cmdline + length, sizeof(cmdline) - length, " > /dev/null");
+
+            struct command_t **commands_arr = bench_parse(&arena, cmdline);
+
+            double start = profile_now();
+            for (int i = 0; i < runs; i++) {
+                execute_external_command(commands_arr, pipeline_stages[s]);
+            }
+            double elapsed = profile_now() - start;
+
+            printf("{\"bench\":\"pipeline\",\"stages\":%d,\"pipe_size\":\"%s\",\"mb\":%d,\"runs\":%d,\"mb_per_sec\":%.1f}\n",
+                pipeline_stages[s], (pipe_size != NULL) ? pipe_size : "default", PIPELINE_MB, runs,
+                (double)PIPELINE_MB * runs / elapsed);
+            fflush(stdout);
+
+            arena_reset(&arena);
+        }
+    }
+
+    remove(template);
+    arena_free(&arena);
+}
+
+
+/**
+ * Queues a copy of a parsed job
+ *
+ * @param command: parsed command to queue
+ */
+void bench_queue_job(struct command_t *command) {
+    struct command_t *job = command_clone(command);
+    if (set_command_channels(job) < 0) {
+        free(job);
+        return;
+    }
+    add_to_queue(job, NULL);
+}
+
+
+/**
+ * Waits in the event loop, which reaps finished jobs, until no job is running the same
+ * way the prompt loop does
+ */
+void bench_wait_for_jobs() {
+    while (background_jobs_running() > 0) {
+        if (eventloop_run_once(-1) < 0) return;
+    }
+}
+
+
+/**
+ * Measures queue scheduling latency. Each job is queued alone to measure the time until
+ * it started and until it was reaped, then a batch of jobs is queued with one job slot
+ * so every job is started by the reaper of the one before it.
+ *
+ * @param iterations: number of iterations, one job is run for every QUEUE_ITERATIONS_PER_JOB
+ */
+void bench_queue(int iterations) {
+    int jobs = iterations / QUEUE_ITERATIONS_PER_JOB;
+    if (jobs < 1) jobs = 1;
+
+    struct arena_t arena = { .block_size = 4096 };
+    struct command_t **commands_arr = bench_parse(&arena, "/bin/true");
+
+    if (background_init() < 0) {
+        fprintf(stderr, "bench: could not set up the queue\n");
+        return;
+    }
+
+    // a free slot starts the job as soon as it is queued
+    double started = 0, completed = 0;
+    for (int i = 0; i < jobs; i++) {
+        double start = profile_now();
+        bench_queue_job(commands_arr[0]);
+        started += profile_now() - start;
+        bench_wait_for_jobs();
+        completed += profile_now() - start;
+    }
+
+    printf("{\"bench\":\"queue\",\"mode\":\"single\",\"jobs\":%d,\"start_latency_us\":%.1f,\"complete_latency_us\":%.1f}\n",
+        jobs, started * 1e6 / jobs, completed * 1e6 / jobs);
+    fflush(stdout);
+
+    // jobs wait in the queue for the one slot
+    set_max_jobs(1);
+    double start = profile_now();
+    for (int i = 0; i < jobs; i++) {
+        bench_queue_job(commands_arr[0]);
+    }
+    bench_wait_for_jobs();
+    double elapsed = profile_now() - start;
+
+    printf("{\"bench\":\"queue\",\"mode\":\"backlog\",\"jobs\":%d,\"jobs_per_sec\":%.1f}\n",
+        jobs, jobs / elapsed);
+    fflush(stdout);
+
+    environ_remove_var("SUSH_MAX_JOBS");
+    queue_cleanup();
+    arena_free(&arena);
+}
+
+
+/**
+ * Measures pipelines run per second when the pipelines of a list are given as one
+ * command line joined by `;`, `&&` and `||`, and when each is given as a line of its
+ * own. The pipelines are builtins so the time is spent in the shell, not in processes.
+ *
+ * @param iterations: number of batches of lines to run
+ */
+void bench_list(int iterations) {
+    char *list = "true && true; false || true > /dev/null";
+    char *lines[] = { "true", "true", "false", "true > /dev/null", NULL };
+    long runs = (long)iterations * LIST_LINES_PER_ITERATION;
+
+    double start = profile_now();
+    for (long i = 0; i < runs; i++) {
+        do_command(list);
+    }
+    double elapsed = profile_now() - start;
+
+    printf("{\"bench\":\"list\",\"mode\":\"one_line\",\"pipelines\":%ld,\"pipelines_per_sec\":%.1f}\n",
+        runs * 4, runs * 4 / elapsed);
+    fflush(stdout);
+
+    start = profile_now();
+    for (long i = 0; i < runs; i++) {
+        for (int l = 0; lines[l] != NULL; l++) {
+            do_command(lines[l]);
+        }
+    }
+    elapsed = profile_now() - start;
+
+    printf("{\"bench\":\"list\",\"mode\":\"line_each\",\"pipelines\":%ld,\"pipelines_per_sec\":%.1f}\n",
+        runs * 4, runs * 4 / elapsed);
+    fflush(stdout);
+
+    parsecache_clear();
+}
+
+
+/**
+ * Runs a command line through do_command like the prompt loop, with its output thrown away
+ *
+ * @param format: printf format of the command line
+ * @param value: number the format takes
+ */
+void soak_command(char *format, int value) {
+    char cmdline[256];
+    snprintf(cmdline, sizeof(cmdline), format, value);
+    do_command(cmdline);
+}
+
+
+/**
+ * Runs a long mix of command lines through do_command and measures how much the heap and
+ * resident size of the shell grow once warmed up. The mix covers variables set, expanded
+ * and removed, malformed lines, internal commands, builtins with redirections and jobs that
+ * are queued, waited for and viewed. A shell that holds no more memory for each command
+ * shows no growth no matter how many commands run, growth past SOAK_GROWTH_SLACK and
+ * SOAK_GROWTH_PER_COMMAND for each command fails the benchmark.
+ *
+ * @param iterations: number of command lines to run
+ */
+void bench_soak(int iterations) {
+    char *lines[] = {
+        "setenv SOAK_%d value",
+        "echo $SOAK_3 \"quoted %d\" > /dev/null",
+        "unsetenv SOAK_%d",
+        "echo \"unterminated %d",
+        "| %d",
+        "cd /tmp",
+        "pwd",
+        "getenv SOAK_%d",
+        "false && echo %d || setenv SOAK_LIST 1; echo $SOAK_LIST > /dev/null",
+        NULL
+    };
+    int num_lines = 0;
+    while (lines[num_lines] != NULL) num_lines++;
+
+    if (background_init() < 0) {
+        fprintf(stderr, "bench: could not set up the queue\n");
+        return;
+    }
+
+    // commands print and fail as they would at the prompt, none of it is shown
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+
+    int warmup = iterations / SOAK_WARMUP_FRACTION;
+    size_t heap_start = 0;
+    long rss_start = 0;
+    double start = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        if (i == warmup) {
+            heap_start = memstat_heap_in_use();
+            rss_start = memstat_resident();
+            start = profile_now();
+        }
+
+        if (i % SOAK_COMMANDS_PER_JOB == 0) {
+            int job_id = background_next_job_id();
+            soak_command("queue echo job %d", i);
+            soak_command("wait %d", job_id);
+            soak_command("output %d", job_id);
+        }
+        soak_command(lines[i % num_lines], i % 64);
+    }
+
+    double elapsed = profile_now() - start;
+    size_t heap_end = memstat_heap_in_use();
+    long rss_end = memstat_resident();
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+
+    int measured = iterations - warmup;
+    long heap_growth = (long) heap_end - (long) heap_start;
+    long rss_growth = rss_end - rss_start;
+    printf("{\"bench\":\"soak\",\"commands\":%d,\"commands_per_sec\":%.1f,\"heap_start\":%zu,\"heap_growth\":%ld,\"rss_start\":%ld,\"rss_growth\":%ld}\n",
+        measured, measured / elapsed, heap_start, heap_growth, rss_start, rss_growth);
+    fflush(stdout);
+
+    // memory that keeps growing with the commands run is a leak
+    long max_growth = SOAK_GROWTH_SLACK + (long) measured * SOAK_GROWTH_PER_COMMAND;
+    if (heap_growth > max_growth || rss_growth > max_growth) {
+        fprintf(stderr, "bench: soak memory grew by more than %ld bytes over %d commands\n", max_growth, measured);
+        bench_failed = true;
+    }
+
+    queue_cleanup();
+}
+
+
+/**
+ * Measures the time from launching the shell to its first command finishing by running
+ * `sush -c /bin/true` until it exits. The shell binary is ./sush unless SUSH_BIN is set.
+ *
+ * @param iterations: number of times to launch the shell
+ */
+void bench_startup(int iterations) {
+    char *sush = getenv(SUSH_BIN_VAR);
+    if (sush == NULL) sush = DEFAULT_SUSH_BIN;
+
+    char *argv[] = { sush, "-c", "/bin/true", NULL };
+    int status;
+
+    double start = profile_now();
+    for (int i = 0; i < iterations; i++) {
+        pid_t pid;
+        if (posix_spawn(&pid, sush, NULL, NULL, argv, environ) != 0) {
+            fprintf(stderr, "bench: could not launch %s\n", sush);
+            return;
+        }
+        waitpid(pid, &status, 0);
+    }
+    double elapsed = profile_now() - start;
+
+    printf("{\"bench\":\"startup\",\"launches\":%d,\"startup_to_exec_ms\":%.3f}\n",
+        iterations, elapsed * 1000 / iterations);
+    fflush(stdout);
+}
+
+
+/**
+ * The array of available benchmarks.
+ */
+struct benchmark_t benchmarks[] = {
+    { .name = "parse", .run = bench_parse_lines },
+    { .name = "environ", .run = bench_environ },
+    { .name = "dispatch", .run = bench_dispatch },
+    { .name = "spawn", .run = bench_spawn },
+    { .name = "builtin", .run = bench_builtin },
+    { .name = "pipeline", .run = bench_pipeline },
+    { .name = "list", .run = bench_list },
+    { .name = "queue", .run = bench_queue },
+    { .name = "startup", .run = bench_startup },
+    { .name = "soak", .run = bench_soak },
+    { .name = NULL }
+};
+
+
+/**
+ * Runs the benchmark given on the command line, or all benchmarks if none was given
+ */
+int main(int argc, char *argv[], char *envp[]) {
+    char *name = (argc > 1) ? argv[1] : NULL;
+    int iterations = (argc > 2) ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+    bool found = false;
+
+    environ_init(envp);
+
+    for (int i = 0; benchmarks[i].name != NULL; i++) {
+        if (name == NULL || strcmp(name, "all") == 0 || strcmp(name, benchmarks[i].name) == 0) {
+            benchmarks[i].run(iterations);
+            found = true;
+        }
+    }
+
+    environ_clean_up();
+
+    if (!found) {
+        fprintf(stderr, "bench: unknown benchmark %s\n", name);
+        return 1;
+    }
+    return bench_failed ? 1 : 0;
+}
@@ -0,0 +1,853 @@
+/**
+ * @file: builtins.c
+ * @author: Andrew Kress
+ *
+ * @brief: Runs the small utilities the shell implements itself.
+ *
+ * Scripts call echo, true, false, test and printf in tight loops and launching an
+ * executable for each call costs more than the work it does. The executor runs these
+ * builtins in the shell when they are the only command of a line and in a forked child
+ * when they are a stage of a pipeline. Each builtin writes to the file descriptor it is
+ * given through a small buffer, so redirections work the same as for executables.
+ *
+ * Any builtin can be disabled with `enable -n name` which makes the shell run the
+ * executable found in PATH again.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "runner.h"
+#include "builtins.h"
+#include "capture.h"
+#include "perfhash.h"
+#include "error.h"
+
+
+// size of the buffer output is collected in before it is written
+#define BUILTIN_OUT_BUFFER 4096
+
+// size of the buffer a single printf conversion is formatted in
+#define PRINTF_CONVERSION_BUFFER 256
+
+// exit status of test for an invalid expression
+#define TEST_SYNTAX_ERROR 2
+
+
+// output of a builtin collected so it is written with as few writes as possible
+struct builtin_out_t {
+    int fd;
+    size_t length;
+    char data[BUILTIN_OUT_BUFFER];
+};
+
+
+// state of the expression being evaluated by test
+struct test_state_t {
+    char **args;
+    int argc;
+    int pos;
+    bool error;
+};
+
+
+/**
+ * Writes the collected output to the file descriptor
+ *
+ * @param out - Output to write
+ */
+void out_flush(struct builtin_out_t *out) {
+    if (out->length > 0) write_all(out->fd, out->data, out->length);
+    out->length = 0;
+}
+
+
+/**
+ * Adds bytes to the output, writing the buffer out when it is full
+ *
+ * @param out - Output to add to
+ * @param data - Bytes to add
+ * @param length - Number of bytes
+ */
+void out_write(struct builtin_out_t *out, char *data, size_t length) {
+    if (out->length + length > sizeof(out->data)) {
+        out_flush(out);
+
+        // too large to buffer, write it directly
+        if (length > sizeof(out->data)) {
+            write_all(out->fd, data, length);
+            return;
+        }
+    }
+
+    memcpy(out->data + out->length, data, length);
+    out->length += length;
+}
+
+
+/**
+ * Adds a single character to the output
+ *
+ * @param out - Output to add to
+ * @param c - Character to add
+ */
+void out_char(struct builtin_out_t *out, char c) {
+    out_write(out, &c, 1);
+}
+
+
+/**
+ * Formats a value with a printf conversion and adds it to the output
+ *
+ * @param out - Output to add to
+ * @param spec - Conversion to format the value with
+ */
+void out_format(struct builtin_out_t *out, char *spec, ...) {
+    char buffer[PRINTF_CONVERSION_BUFFER];
+    va_list args, args_copy;
+
+    va_start(args, spec);
+    va_copy(args_copy, args);
+    int length = vsnprintf(buffer, sizeof(buffer), spec, args);
+
+    if (length >= (int)sizeof(buffer)) {
+        // conversion is wider than the buffer
+        char *large = malloc(length + 1);
+        vsnprintf(large, length + 1, spec, args_copy);
+        out_write(out, large, length);
+        free(large);
+    } else if (length > 0) {
+        out_write(out, buffer, length);
+    }
+
+    va_end(args_copy);
+    va_end(args);
+}
+
+
+/**
+ * Writes the character of an escape sequence like \n or \101 to the output
+ *
+ * @param out - Output to add to
+ * @param pos - Points at the backslash, moved to the last character of the sequence
+ * @param octal_zero - True if octal sequences start with 0 like in echo, false for printf
+ *
+ * @return False if the sequence was \c which stops all further output
+ */
+bool write_escape(struct builtin_out_t *out, char **pos, bool octal_zero) {
+    char *c = *pos + 1;
+    int value = 0, digits = 0;
+
+    switch (*c) {
+        case 'a': out_char(out, '\a'); break;
+        case 'b': out_char(out, '\b'); break;
+        case 'e': out_char(out, '\033'); break;
+        case 'f': out_char(out, '\f'); break;
+        case 'n': out_char(out, '\n'); break;
+        case 'r': out_char(out, '\r'); break;
+        case 't': out_char(out, '\t'); break;
+        case 'v': out_char(out, '\v'); break;
+        case '\\': out_char(out, '\\'); break;
+        case 'c': return false;
+
+        // up to two hex digits
+        case 'x':
+            while (digits < 2 && c[1] != '\0' && strchr("0123456789abcdefABCDEF", c[1]) != NULL) {
+                c++;
+                value = value * 16 + ((*c <= '9') ? *c - '0' : (*c | 0x20) - 'a' + 10);
+                digits++;
+            }
+            if (digits == 0) out_write(out, "\\x", 2);
+            else out_char(out, value);
+            break;
+
+        // backslash at the end is kept
+        case '\0':
+            out_char(out, '\\');
+            return true;
+
+        default:
+            // up to three octal digits, after a leading zero in echo
+            if (octal_zero ? *c == '0' : (*c >= '0' && *c <= '7')) {
+                if (!octal_zero) {
+                    value = *c - '0';
+                    digits = 1;
+                }
+                while (digits < 3 && c[1] >= '0' && c[1] <= '7') {
+                    c++;
+                    value = value * 8 + (*c - '0');
+                    digits++;
+                }
+                out_char(out, value);
+                break;
+            }
+
+            // unknown sequences are written as they are
+            out_char(out, '\\');
+            out_char(out, *c);
+            break;
+    }
+
+    *pos = c;
+    return true;
+}
+
+
+/**
+ * Handles the true utility which does nothing successfully.
+ *
+ * @param cmd - The command for arguments
+ * @param out_fd - File descriptor to write output to
+ *
+ * @return Exit status 0
+ */
+int handle_true(struct command_t *cmd, int out_fd) {
+    return 0;
+}
+
+
+/**
+ * Handles the false utility which does nothing unsuccessfully.
+ *
+ * @param cmd - The command for arguments
+ * @param out_fd - File descriptor to write output to
+ *
+ * @return Exit status 1
+ */
+int handle_false(struct command_t *cmd, int out_fd) {
+    return 1;
+}
+
+
+/**
+ * Handles the echo utility to write its arguments separated by spaces. Like the echo
+ * of coreutils -n leaves out the newline, -e interprets escapes and -E does not.
+ *
+ * @param cmd - The command for arguments
+ * @param out_fd - File descriptor to write output to
+ *
+ * @return Exit status 0
+ */
+int handle_echo(struct command_t *cmd, int out_fd) {
+    struct builtin_out_t out = { .fd = out_fd, .length = 0 };
+    bool newline = true;
+    bool escapes = false;
+    int i;
+
+    // an argument is only an option if echo knows every letter of it
+    for (i = 1; cmd->tokens[i] != NULL && cmd->tokens[i][0] == '-' && cmd->tokens[i][1] != '\0'; i++) {
+        char *c = cmd->tokens[i] + 1;
+        if (strspn(c, "neE") != strlen(c)) break;
+
+        for (; *c != '\0'; c++) {
+            if (*c == 'n') newline = false;
+            else escapes = (*c == 'e');
+        }
+    }
+
+    for (int first = i; cmd->tokens[i] != NULL; i++) {
+        if (i > first) out_char(&out, ' ');
+
+        if (!escapes) {
+            out_write(&out, cmd->tokens[i], strlen(cmd->tokens[i]));
+            continue;
+        }
+
+        for (char *c = cmd->tokens[i]; *c != '\0'; c++) {
+            if (*c != '\\') {
+                out_char(&out, *c);
+            } else if (!write_escape(&out, &c, true)) {
+                // \c stops the output and the newline
+                out_flush(&out);
+                return 0;
+            }
+        }
+    }
+
+    if (newline) out_char(&out, '\n');
+    out_flush(&out);
+    return 0;
+}
+
+
+/**
+ * Takes the next argument of printf
+ *
+ * @param args - Remaining arguments, moved past the argument taken
+ *
+ * @return the argument, an empty string once all arguments are used
+ */
+char *printf_next_arg(char ***args) {
+    char *arg = **args;
+    if (arg == NULL) return "";
+
+    (*args)++;
+    return arg;
+}
+
+
+/**
+ * Takes the next argument of printf as a number. A leading quote gives the value of
+ * the character after it.
+ *
+ * @param args - Remaining arguments, moved past the argument taken
+ * @param is_signed - True to read a signed number
+ * @param status - Set to 1 if the argument is not a number
+ *
+ * @return value of the argument
+ */
+long long printf_int_arg(char ***args, bool is_signed, int *status) {
+    char *arg = printf_next_arg(args);
+    char *end;
+
+    if (*arg == '\0') return 0;
+    if (*arg == '\'' || *arg == '"') return (unsigned char)arg[1];
+
+    errno = 0;
+    long long value = is_signed ? strtoll(arg, &end, 0) : (long long)strtoull(arg, &end, 0);
+    if (*end != '\0' || errno != 0) {
+        LOG_ERROR(ERROR_PRINTF_NUMBER, arg);
+        *status = 1;
+    }
+    return value;
+}
+
+
+/**
+ * Takes the next argument of printf as a floating point number
+ *
+ * @param args - Remaining arguments, moved past the argument taken
+ * @param status - Set to 1 if the argument is not a number
+ *
+ * @return value of the argument
+ */
+double printf_double_arg(char ***args, int *status) {
+    char *arg = printf_next_arg(args);
+    char *end;
+
+    if (*arg == '\0') return 0;
+
+    errno = 0;
+    double value = strtod(arg, &end);
+    if (*end != '\0' || errno != 0) {
+        LOG_ERROR(ERROR_PRINTF_NUMBER, arg);
+        *status = 1;
+    }
+    return value;
+}
+
+
+/**
+ * Writes the format of printf once, taking an argument for each conversion
+ *
+ * @param out - Output to add to
+ * @param format - Format given to printf
+ * @param args - Remaining arguments, moved past the arguments taken
+ * @param status - Set to 1 if an argument or conversion is invalid
+ *
+ * @return False if output was stopped by \c
+ */
+bool printf_format(struct builtin_out_t *out, char *format, char ***args, int *status) {
+    for (char *c = format; *c != '\0'; c++) {
+        if (*c == '\\') {
+            if (!write_escape(out, &c, false)) return false;
+            continue;
+        }
+        if (*c != '%') {
+            out_char(out, *c);
+            continue;
+        }
+        if (c[1] == '%') {
+            out_char(out, '%');
+            c++;
+            continue;
+        }
+
+        // copy the flags, width and precision of the conversion so snprintf can apply them,
+        // leaving room for the length modifier and conversion
+        char spec[64];
+        int length = 0;
+        spec[length++] = '%';
+
+        char *d = c + 1;
+        while (*d != '\0' && strchr("-+ #0", *d) != NULL && length < 8) spec[length++] = *d++;
+
+        for (int part = 0; part < 2; part++) {
+            // precision follows a dot
+            if (part == 1) {
+                if (*d != '.') break;
+                spec[length++] = *d++;
+            }
+
+            if (*d == '*') {
+                length += snprintf(spec + length, 16, "%d", (int)printf_int_arg(args, true, status));
+                d++;
+            } else {
+                while (*d >= '0' && *d <= '9' && length < 40) spec[length++] = *d++;
+            }
+        }
+
+        char conversion = *d;
+        if (conversion == '\0') {
+            LOG_ERROR(ERROR_PRINTF_CONVERSION, '%');
+            *status = 1;
+            return true;
+        }
+        c = d;
+
+        switch (conversion) {
+            case 'd': case 'i':
+                memcpy(spec + length, "ll", 2);
+                spec[length + 2] = conversion;
+                spec[length + 3] = '\0';
+                out_format(out, spec, printf_int_arg(args, true, status));
+                break;
+
+            case 'o': case 'u': case 'x': case 'X':
+                memcpy(spec + length, "ll", 2);
+                spec[length + 2] = conversion;
+                spec[length + 3] = '\0';
+                out_format(out, spec, (unsigned long long)printf_int_arg(args, false, status));
+                break;
+
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                spec[length] = conversion;
+                spec[length + 1] = '\0';
+                out_format(out, spec, printf_double_arg(args, status));
+                break;
+
+            case 'c':
+                spec[length] = 'c';
+                spec[length + 1] = '\0';
+                out_format(out, spec, printf_next_arg(args)[0]);
+                break;
+
+            case 's':
+                spec[length] = 's';
+                spec[length + 1] = '\0';
+                out_format(out, spec, printf_next_arg(args));
+                break;
+
+            // argument with escapes interpreted like echo -e
+            case 'b': {
+                char *arg = printf_next_arg(args);
+                for (char *e = arg; *e != '\0'; e++) {
+                    if (*e != '\\') out_char(out, *e);
+                    else if (!write_escape(out, &e, true)) return false;
+                }
+                break;
+            }
+
+            default:
+                LOG_ERROR(ERROR_PRINTF_CONVERSION, conversion);
+                *status = 1;
+                return true;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Handles the printf utility to write its arguments with a format. The format is
+ * used again while arguments are left, like the printf of coreutils.
+ *
+ * @param cmd - The command for arguments
+ * @param out_fd - File descriptor to write output to
+ *
+ * @return Exit status 0, 1 if an argument was invalid
+ */
+int handle_printf(struct command_t *cmd, int out_fd) {
+    if (cmd->tokens[1] == NULL) {
+        LOG_ERROR(ERROR_PRINTF_ARG);
+        return 1;
+    }
+
+    struct builtin_out_t out = { .fd = out_fd, .length = 0 };
+    char **args = cmd->tokens + 2;
+    int status = 0;
+
+    while (true) {
+        char **start = args;
+        if (!printf_format(&out, cmd->tokens[1], &args, &status)) break;
+
+        // stop once all arguments are used or the format takes none
+        if (*args == NULL || args == start) break;
+    }
+
+    out_flush(&out);
+    return status;
+}
+
+
+/**
+ * Checks if an argument of test is an operator taking one operand
+ *
+ * @param arg - Argument to check
+ *
+ * @return True if the argument is a unary operator
+ */
+bool test_is_unary(char *arg) {
+    return arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0' && strchr("nzefdrwxsLhpSbct", arg[1]) != NULL;
+}
+
+
+/**
+ * Checks if an argument of test is an operator taking two operands
+ *
+ * @param arg - Argument to check
+ *
+ * @return True if the argument is a binary operator
+ */
+bool test_is_binary(char *arg) {
+    static char *operators[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL };
+
+    for (int i = 0; operators[i] != NULL; i++) {
+        if (strcmp(arg, operators[i]) == 0) return true;
+    }
+    return false;
+}
+
+
+/**
+ * Reads an integer operand of test
+ *
+ * @param t - State of the expression, marked as an error if the operand is not an integer
+ * @param arg - Operand to read
+ *
+ * @return value of the operand
+ */
+long long test_integer(struct test_state_t *t, char *arg) {
+    char *end;
+
+    errno = 0;
+    long long value = strtoll(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || errno != 0) {
+        LOG_ERROR(ERROR_TEST_INTEGER, arg);
+        t->error = true;
+    }
+    return value;
+}
+
+
+/**
+ * Evaluates a test operator with one operand
+ *
+ * @param t - State of the expression
+ * @param op - Letter of the operator
+ * @param arg - Operand
+ *
+ * @return Result of the test
+ */
+bool test_unary(struct test_state_t *t, char op, char *arg) {
+    struct stat sfile;
+
+    switch (op) {
+        case 'n': return arg[0] != '\0';
+        case 'z': return arg[0] == '\0';
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+        case 't': return isatty(test_integer(t, arg));
+        case 'L': case 'h': return lstat(arg, &sfile) == 0 && S_ISLNK(sfile.st_mode);
+    }
+
+    // remaining operators look at the type or size of the file
+    if (stat(arg, &sfile) != 0) return false;
+
+    switch (op) {
+        case 'e': return true;
+        case 'f': return S_ISREG(sfile.st_mode);
+        case 'd': return S_ISDIR(sfile.st_mode);
+        case 's': return sfile.st_size > 0;
+        case 'p': return S_ISFIFO(sfile.st_mode);
+        case 'S': return S_ISSOCK(sfile.st_mode);
+        case 'b': return S_ISBLK(sfile.st_mode);
+        case 'c': return S_ISCHR(sfile.st_mode);
+    }
+    return false;
+}
+
+
+/**
+ * Evaluates a test operator with two operands
+ *
+ * @param t - State of the expression
+ * @param left - First operand
+ * @param op - Operator
+ * @param right - Second operand
+ *
+ * @return Result of the test
+ */
+bool test_binary(struct test_state_t *t, char *left, char *op, char *right) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(left, right) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(left, right) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(left, right) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(left, right) > 0;
+
+    // file comparisons, a missing file is older than any other
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        struct stat sleft, sright;
+        bool has_left = stat(left, &sleft) == 0;
+        bool has_right = stat(right, &sright) == 0;
+
+        if (op[1] == 'e') return has_left && has_right && sleft.st_dev == sright.st_dev && sleft.st_ino == sright.st_ino;
+        if (!has_left || !has_right) return (op[1] == 'n') ? has_left : has_right;
+
+        struct timespec *newer = (op[1] == 'n') ? &sleft.st_mtim : &sright.st_mtim;
+        struct timespec *older = (op[1] == 'n') ? &sright.st_mtim : &sleft.st_mtim;
+        return newer->tv_sec > older->tv_sec || (newer->tv_sec == older->tv_sec && newer->tv_nsec > older->tv_nsec);
+    }
+
+    // integer comparisons
+    long long a = test_integer(t, left);
+    long long b = test_integer(t, right);
+
+    if (strcmp(op, "-eq") == 0) return a == b;
+    if (strcmp(op, "-ne") == 0) return a != b;
+    if (strcmp(op, "-lt") == 0) return a < b;
+    if (strcmp(op, "-le") == 0) return a <= b;
+    if (strcmp(op, "-gt") == 0) return a > b;
+    return a >= b;
+}
+
+
+bool test_or(struct test_state_t *t);
+
+
+/**
+ * Evaluates a primary of a test expression, a group in parentheses, an operator with
+ * its operands or a single string which is true if not empty
+ *
+ * @param t - State of the expression
+ *
+ * @return Result of the primary
+ */
+bool test_primary(struct test_state_t *t) {
+    int remaining = t->argc - t->pos;
+    char **args = t->args + t->pos;
+
+    if (remaining <= 0) {
+        LOG_ERROR(ERROR_TEST_EXPECTED);
+        t->error = true;
+        return false;
+    }
+
+    // binary operators are checked first so `test ( = (` compares strings
+    if (remaining >= 3 && test_is_binary(args[1])) {
+        t->pos += 3;
+        return test_binary(t, args[0], args[1], args[2]);
+    }
+
+    if (remaining >= 2 && strcmp(args[0], "(") == 0) {
+        t->pos++;
+        bool result = test_or(t);
+        if (t->pos >= t->argc || strcmp(t->args[t->pos], ")") != 0) {
+            LOG_ERROR(ERROR_TEST_PAREN);
+            t->error = true;
+            return false;
+        }
+        t->pos++;
+        return result;
+    }
+
+    if (remaining >= 2 && test_is_unary(args[0])) {
+        t->pos += 2;
+        return test_unary(t, args[0][1], args[1]);
+    }
+
+    t->pos++;
+    return args[0][0] != '\0';
+}
+
+
+/**
+ * Evaluates a negation of a test expression
+ *
+ * @param t - State of the expression
+ *
+ * @return Result of the negation
+ */
+bool test_not(struct test_state_t *t) {
+    int remaining = t->argc - t->pos;
+    char **args = t->args + t->pos;
+
+    // `test ! = x` compares the string !
+    if (remaining >= 2 && strcmp(args[0], "!") == 0 && !(remaining >= 3 && test_is_binary(args[1]))) {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+
+/**
+ * Evaluates test expressions joined by -a
+ *
+ * @param t - State of the expression
+ *
+ * @return Result of the expressions
+ */
+bool test_and(struct test_state_t *t) {
+    bool result = test_not(t);
+
+    while (!t->error && t->pos < t->argc && strcmp(t->args[t->pos], "-a") == 0) {
+        t->pos++;
+        result = test_not(t) && result;
+    }
+    return result;
+}
+
+
+/**
+ * Evaluates test expressions joined by -o
+ *
+ * @param t - State of the expression
+ *
+ * @return Result of the expressions
+ */
+bool test_or(struct test_state_t *t) {
+    bool result = test_and(t);
+
+    while (!t->error && t->pos < t->argc && strcmp(t->args[t->pos], "-o") == 0) {
+        t->pos++;
+        result = test_and(t) || result;
+    }
+    return result;
+}
+
+
+/**
+ * Handles the test utility, also run as [ which needs ] as its last argument, to
+ * evaluate an expression of string, integer and file tests.
+ *
+ * @param cmd - The command for arguments
+ * @param out_fd - File descriptor to write output to
+ *
+ * @return Exit status 0 if the expression is true, 1 if false, 2 if invalid
+ */
+int handle_test(struct command_t *cmd, int out_fd) {
+    struct test_state_t t = { .args = cmd->tokens + 1, .argc = cmd->num_tokens - 2, .pos = 0, .error = false };
+
+    if (strcmp(cmd->cmd_name, "[") == 0) {
+        if (t.argc == 0 || strcmp(t.args[t.argc - 1], "]") != 0) {
+            LOG_ERROR(ERROR_TEST_BRACKET);
+            return TEST_SYNTAX_ERROR;
+        }
+        t.argc--;
+    }
+
+    // no expression is false
+    if (t.argc == 0) return 1;
+
+    bool result = test_or(&t);
+    if (!t.error && t.pos < t.argc) {
+        LOG_ERROR(ERROR_TEST_UNEXPECTED, t.args[t.pos]);
+        t.error = true;
+    }
+
+    if (t.error) return TEST_SYNTAX_ERROR;
+    return result ? 0 : 1;
+}
+
+
+/**
+ * The array of available builtins.
+ */
+struct builtin_t builtins[] = {
+    { .name = "echo", .handler = handle_echo, .enabled = true },
+    { .name = "true", .handler = handle_true, .enabled = true },
+    { .name = "false", .handler = handle_false, .enabled = true },
+    { .name = "test", .handler = handle_test, .enabled = true },
+    { .name = "[", .handler = handle_test, .enabled = true },
+    { .name = "printf", .handler = handle_printf, .enabled = true },
+    { .name = NULL }
+};
+
+
+// perfect hash table of the builtins, built on first lookup
+static struct perfhash_t builtin_table;
+
+
+/**
+ * Finds a builtin by name, enabled or not
+ *
+ * @param name - Name of the builtin
+ *
+ * @return the builtin, NULL if there is no builtin with the name
+ */
+struct builtin_t *builtin_lookup(char *name) {
+    // build the table from the array of builtins once
+    if (!builtin_table.built) {
+        char *names[PERFHASH_SLOTS];
+        void *values[PERFHASH_SLOTS];
+        int count;
+
+        for (count = 0; builtins[count].name != NULL; count++) {
+            names[count] = builtins[count].name;
+            values[count] = &builtins[count];
+        }
+        perfhash_build(&builtin_table, names, values, count);
+    }
+
+    return perfhash_lookup(&builtin_table, name);
+}
+
+
+/**
+ * Finds the builtin that runs the given command
+ *
+ * @param cmd - The command to find the builtin for
+ *
+ * @return the builtin, NULL if the command is not a builtin or the builtin is disabled
+ */
+struct builtin_t *builtin_find(struct command_t *cmd) {
+    // look the name up once, whether it is enabled is checked each time so enable
+    // takes effect on commands that were already looked up
+    if (!cmd->builtin_resolved) {
+        cmd->builtin = builtin_lookup(cmd->cmd_name);
+        cmd->builtin_resolved = true;
+    }
+
+    if (cmd->builtin == NULL || !cmd->builtin->enabled) return NULL;
+    return cmd->builtin;
+}
+
+
+/**
+ * Enables or disables a builtin. A disabled builtin runs the executable found in PATH.
+ *
+ * @param name - Name of the builtin
+ * @param enabled - True to run the builtin in the shell
+ *
+ * @return SUCCESS or ERROR if there is no builtin with the name
+ */
+int builtin_set_enabled(char *name, bool enabled) {
+    struct builtin_t *builtin = builtin_lookup(name);
+
+    if (builtin == NULL) {
+        LOG_ERROR(ERROR_ENABLE_NAME, name);
+        return ERROR;
+    }
+
+    builtin->enabled = enabled;
+    return SUCCESS;
+}
+
+
+/**
+ * Prints every builtin as the enable command that gives its current state
+ */
+void builtin_print() {
+    for (int i = 0; builtins[i].name != NULL; i++) {
+        printf("enable %s%s\n", builtins[i].enabled ? "" : "-n ", builtins[i].name);
+    }
+}
@@ -0,0 +1,54 @@
+/**
+ * @file: builtins.h
+ * @author: Andrew Kress
+ *
+ * @brief: Header file for the builtin utilities
+ *
+ * Defines functions to find and run the small utilities the shell implements itself
+ * instead of launching the executable, and to switch each of them off so the
+ * executable found in PATH is run instead.
+ */
+
+#include <stdbool.h>
+
+#include "runner.h"
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+// builtin struct holds name of the utility and handler that runs it
+struct builtin_t {
+    char *name;
+
+    // runs the utility writing its output to out_fd, returns the exit status of the utility
+    int (*handler)(struct command_t *cmd, int out_fd);
+
+    bool enabled;
+};
+
+/**
+ * Finds the builtin that runs the given command. The name is looked up once and kept on the
+ * command, whether the builtin is enabled is checked on every call.
+ *
+ * @param cmd - The command to find the builtin for
+ *
+ * @return the builtin, NULL if the command is not a builtin or the builtin is disabled
+ */
+struct builtin_t *builtin_find(struct command_t *cmd);
+
+/**
+ * Enables or disables a builtin. A disabled builtin runs the executable found in PATH.
+ *
+ * @param name - Name of the builtin
+ * @param enabled - True to run the builtin in the shell
+ *
+ * @return SUCCESS or ERROR if there is no builtin with the name
+ */
+int builtin_set_enabled(char *name, bool enabled);
+
+/**
+ * Prints every builtin as the enable command that gives its current state
+ */
+void builtin_print();
+
+#endif
@@ -0,0 +1,468 @@
+/**
+ * @file: capture.c
+ * @author: Michael Permyashkin
+ *
+ * @brief: Captures the output of background jobs in memory
+ *
+ * Instead of writing every job to a temporary file, the job writes to a pipe and the shell
+ * reads the pipe into a buffer whenever output is available. The buffer grows up to a size
+ * limit, once the output is larger it is spilled to a temporary file so memory use stays
+ * bounded no matter how much a job writes.
+ *
+ * Output is written back out without stdio. Files are handed to the kernel with sendfile
+ * and the first or last lines of an output are found in a memory mapping, so showing the
+ * tail of a large log does not read the whole file.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "runner.h"
+#include "error.h"
+#include "capture.h"
+#include "eventloop.h"
+
+
+// constants for pipe code readability
+#define READ_PIPE 0
+#define WRITE_PIPE 1
+
+// size of the buffer when the first output arrives
+#define CAPTURE_INITIAL_CAPACITY 4096
+
+// size of each read from a pipe once output goes to the spill file
+#define SPILL_CHUNK 65536
+
+// size of the buffer used when a file can not be copied by the kernel
+#define COPY_BUFFER (1 << 20)
+
+
+/**
+ * Creates a capture that holds up to the given number of bytes in memory
+ *
+ * @param limit: size at which output is spilled to a file
+ * @return the new capture
+ */
+struct capture_t *capture_create(size_t limit) {
+    struct capture_t *capture = malloc(sizeof(struct capture_t));
+
+    capture->fd = -1;
+    capture->buffer = NULL;
+    capture->length = 0;
+    capture->capacity = 0;
+    capture->limit = limit;
+    capture->spill_fd = -1;
+    capture->spill_file = NULL;
+    capture->truncated = false;
+
+    return capture;
+}
+
+
+/**
+ * Creates the pipe the job writes its output to. The shell keeps the read end
+ * which never blocks so output can be collected whenever it is available.
+ *
+ * @param capture: capture to open
+ * @return write end of the pipe for the job, negative on error
+ */
+int capture_open(struct capture_t *capture) {
+    int pipes_fd[2];
+
+    if (pipe2(pipes_fd, O_CLOEXEC) < 0) return ERROR;
+
+    fcntl(pipes_fd[READ_PIPE], F_SETFL, O_NONBLOCK);
+    capture->fd = pipes_fd[READ_PIPE];
+
+    return pipes_fd[WRITE_PIPE];
+}
+
+
+/**
+ * Writes a block of bytes fully, retrying partial writes
+ *
+ * @param fd: file descriptor to write to
+ * @param data: bytes to write
+ * @param length: number of bytes
+ * @return status of the write
+ */
+int write_all(int fd, char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return ERROR;
+        }
+        data += written;
+        length -= written;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Moves the output held in memory to a temporary file. Output that arrives after
+ * this is appended to the file.
+ *
+ * @param capture: capture to spill
+ * @return status of the spill
+ */
+int capture_spill(struct capture_t *capture) {
+    char template[] = "/tmp/background_cmd_XXXXXXXX";
+    int fd = mkostemp(template, O_CLOEXEC);
+    if (fd < 0) return ERROR;
+
+    if (write_all(fd, capture->buffer, capture->length) < 0) {
+        int write_errno = errno;
+        close(fd);
+        remove(template);
+        errno = write_errno;
+        return ERROR;
+    }
+
+    capture->spill_fd = fd;
+    capture->spill_file = strdup(template);
+
+    // memory is no longer needed
+    free(capture->buffer);
+    capture->buffer = NULL;
+    capture->capacity = 0;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Makes room in the buffer for at least one more byte, doubling the buffer up to
+ * the limit. Spills to a file when the limit is reached.
+ *
+ * @param capture: capture to grow
+ * @return status of growing the buffer
+ */
+int capture_grow(struct capture_t *capture) {
+    if (capture->length < capture->capacity) return SUCCESS;
+
+    // buffer is as large as it may get
+    if (capture->capacity >= capture->limit) return capture_spill(capture);
+
+    size_t capacity = (capture->capacity == 0) ? CAPTURE_INITIAL_CAPACITY : capture->capacity * 2;
+    if (capacity > capture->limit) capacity = capture->limit;
+
+    capture->buffer = realloc(capture->buffer, capacity);
+    capture->capacity = capacity;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Stops keeping output once it can not be spilled, the error is reported once and
+ * output that arrives after is read and discarded
+ *
+ * @param capture: capture that failed to spill
+ */
+void capture_truncate(struct capture_t *capture) {
+    LOG_ERROR(ERROR_CAPTURE_SPILL, capture->length, strerror(errno));
+    capture->truncated = true;
+}
+
+
+/**
+ * Reads all output that is available without blocking. Output is read straight
+ * into the buffer, or through a chunk into the spill file once spilled. Once the
+ * output is truncated it is still read so the pipe drains, but is discarded.
+ *
+ * @param capture: capture to read in to
+ * @return true if the job closed its end of the pipe
+ */
+bool capture_read(struct capture_t *capture) {
+    char chunk[SPILL_CHUNK];
+    ssize_t bytes;
+
+    if (capture->fd < 0) return true;
+
+    while (true) {
+        // spilled output goes to the file, truncated output is dropped
+        if (capture->truncated || capture->spill_fd >= 0) {
+            bytes = read(capture->fd, chunk, sizeof(chunk));
+            if (bytes > 0) {
+                if (capture->truncated) continue;
+
+                if (write_all(capture->spill_fd, chunk, bytes) < 0) capture_truncate(capture);
+                else capture->length += bytes;
+                continue;
+            }
+        } else {
+            if (capture_grow(capture) < 0) {
+                capture_truncate(capture);
+                continue;
+            }
+            if (capture->spill_fd >= 0) continue;
+
+            bytes = read(capture->fd, capture->buffer + capture->length, capture->capacity - capture->length);
+            if (bytes > 0) {
+                capture->length += bytes;
+                continue;
+            }
+        }
+
+        if (bytes < 0 && errno == EINTR) continue;
+
+        // nothing more to read for now
+        if (bytes < 0 && errno == EAGAIN) return false;
+
+        // job closed the pipe or it failed, nothing more will arrive
+        eventloop_unwatch(capture->fd);
+        close(capture->fd);
+        capture->fd = -1;
+        return true;
+    }
+}
+
+
+/**
+ * Writes a file from an offset to its current end to a file descriptor. The kernel
+ * copies the data with sendfile or copy_file_range where possible, otherwise it is
+ * copied with large reads and writes.
+ *
+ * @param in_fd: file to copy from
+ * @param offset: offset to start at, moved past the bytes written
+ * @param out_fd: file descriptor to write to
+ * @return status of the copy
+ */
+int copy_file_from(int in_fd, off_t *offset, int out_fd) {
+    struct stat sfile;
+    if (fstat(in_fd, &sfile) < 0) return ERROR;
+    if (sfile.st_size <= *offset) return SUCCESS;
+
+    size_t remaining = sfile.st_size - *offset;
+    ssize_t bytes;
+
+    // kernel copies the pages straight to the output
+    while (remaining > 0) {
+        bytes = sendfile(out_fd, in_fd, offset, remaining);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) break;
+        remaining -= bytes;
+    }
+
+    // output sendfile does not support, try copy_file_range between files
+    while (remaining > 0) {
+        bytes = copy_file_range(in_fd, offset, out_fd, NULL, remaining, 0);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) break;
+        remaining -= bytes;
+    }
+
+    // copy the rest through a large buffer
+    if (remaining > 0) {
+        char *buffer = malloc(COPY_BUFFER);
+        while ((bytes = pread(in_fd, buffer, COPY_BUFFER, *offset)) > 0) {
+            if (write_all(out_fd, buffer, bytes) < 0) break;
+            *offset += bytes;
+        }
+        free(buffer);
+        if (bytes != 0) return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Writes a whole file to a file descriptor. The kernel copies the data with sendfile or
+ * copy_file_range where possible, otherwise it is copied with large reads and writes.
+ *
+ * @param in_fd: file to copy from its start
+ * @param out_fd: file descriptor to write to
+ * @return status of the copy
+ */
+int copy_file_out(int in_fd, int out_fd) {
+    off_t offset = 0;
+    return copy_file_from(in_fd, &offset, out_fd);
+}
+
+
+/**
+ * Writes the first or last lines of a block of output to a file descriptor. The line
+ * boundaries are found from the start for OUTPUT_HEAD and from the end for OUTPUT_TAIL
+ * so only the bytes of the lines written are looked at.
+ *
+ * @param data: output to write lines of
+ * @param length: size of the output
+ * @param range: part of the output to write
+ * @param lines: number of lines for OUTPUT_HEAD and OUTPUT_TAIL
+ * @param out_fd: file descriptor to write to
+ * @return status of writing the lines
+ */
+int write_range_out(char *data, size_t length, enum output_range_e range, long lines, int out_fd) {
+    size_t start = 0, end = length;
+
+    if (range == OUTPUT_HEAD) {
+        // output ends after the newline of the last line wanted
+        char *pos = data;
+        for (long i = 0; i < lines && pos != NULL; i++) {
+            pos = memchr(pos, '\n', data + length - pos);
+            if (pos != NULL) pos++;
+        }
+        if (pos != NULL) end = pos - data;
+        if (lines <= 0) end = 0;
+    }
+    else if (range == OUTPUT_TAIL) {
+        // output starts after the newline before the first line wanted, the newline
+        // ending the final line does not start another line
+        size_t search = (length > 0 && data[length - 1] == '\n') ? length - 1 : length;
+        char *pos = NULL;
+        for (long i = 0; i < lines; i++) {
+            pos = memrchr(data, '\n', search);
+            if (pos == NULL) break;
+            search = pos - data;
+        }
+        if (pos != NULL) start = pos - data + 1;
+        if (lines <= 0) start = length;
+    }
+
+    return write_all(out_fd, data + start, end - start);
+}
+
+
+/**
+ * Writes the first or last lines of a file to a file descriptor. The file is mapped in
+ * to memory so only the pages holding the lines are read.
+ *
+ * @param in_fd: file to write lines of
+ * @param range: part of the file to write
+ * @param lines: number of lines for OUTPUT_HEAD and OUTPUT_TAIL
+ * @param out_fd: file descriptor to write to
+ * @return status of writing the lines
+ */
+int file_write_range(int in_fd, enum output_range_e range, long lines, int out_fd) {
+    if (range == OUTPUT_ALL) return copy_file_out(in_fd, out_fd);
+
+    struct stat sfile;
+    if (fstat(in_fd, &sfile) < 0) return ERROR;
+    if (sfile.st_size == 0) return SUCCESS;
+
+    char *data = mmap(NULL, sfile.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+    if (data == MAP_FAILED) return ERROR;
+
+    int rc = write_range_out(data, sfile.st_size, range, lines, out_fd);
+
+    munmap(data, sfile.st_size);
+    return rc;
+}
+
+
+/**
+ * Writes all captured output to a file descriptor. Output held in memory is written
+ * with a single write, spilled output is copied from the file by the kernel.
+ *
+ * @param capture: capture to write out
+ * @param out_fd: file descriptor to write to
+ * @return status of writing the output
+ */
+int capture_write_out(struct capture_t *capture, int out_fd) {
+    if (capture->spill_fd < 0)
+        return write_all(out_fd, capture->buffer, capture->length);
+
+    return copy_file_out(capture->spill_fd, out_fd);
+}
+
+
+/**
+ * Writes the first or last lines of the captured output to a file descriptor
+ *
+ * @param capture: capture to write out
+ * @param range: part of the output to write
+ * @param lines: number of lines for OUTPUT_HEAD and OUTPUT_TAIL
+ * @param out_fd: file descriptor to write to
+ * @return status of writing the output
+ */
+int capture_write_range(struct capture_t *capture, enum output_range_e range, long lines, int out_fd) {
+    if (range == OUTPUT_ALL) return capture_write_out(capture, out_fd);
+
+    if (capture->spill_fd >= 0)
+        return file_write_range(capture->spill_fd, range, lines, out_fd);
+
+    return write_range_out(capture->buffer, capture->length, range, lines, out_fd);
+}
+
+
+/**
+ * Writes the output captured after an offset to a file descriptor, used to follow
+ * the output of a running job
+ *
+ * @param capture: capture to write out
+ * @param offset: number of bytes already written, moved past the bytes written
+ * @param out_fd: file descriptor to write to
+ * @return status of writing the output
+ */
+int capture_write_from(struct capture_t *capture, size_t *offset, int out_fd) {
+    if (*offset >= capture->length) return SUCCESS;
+
+    // spilled output is all in the file, including what was in memory before
+    if (capture->spill_fd >= 0) {
+        off_t file_offset = *offset;
+        int rc = copy_file_from(capture->spill_fd, &file_offset, out_fd);
+        *offset = file_offset;
+        return rc;
+    }
+
+    if (write_all(out_fd, capture->buffer + *offset, capture->length - *offset) < 0) return ERROR;
+    *offset = capture->length;
+    return SUCCESS;
+}
+
+
+/**
+ * Returns the number of bytes captured so far
+ *
+ * @param capture: capture to check
+ * @return size of the output
+ */
+size_t capture_size(struct capture_t *capture) {
+    return capture->length;
+}
+
+
+/**
+ * Counts the memory held by a capture and the output it holds in memory
+ *
+ * @param capture: capture to count
+ * @param usage: counters to add to
+ */
+void capture_memory(struct capture_t *capture, struct mem_usage_t *usage) {
+    mem_count(usage, capture);
+    mem_count(usage, capture->buffer);
+    mem_count(usage, capture->spill_file);
+}
+
+
+/**
+ * Closes the pipe, deletes any spilled file and frees the capture
+ *
+ * @param capture: capture to free
+ */
+void capture_free(struct capture_t *capture) {
+    if (capture->fd >= 0) {
+        eventloop_unwatch(capture->fd);
+        close(capture->fd);
+    }
+
+    if (capture->spill_fd >= 0) {
+        close(capture->spill_fd);
+        remove(capture->spill_file);
+        free(capture->spill_file);
+    }
+
+    free(capture->buffer);
+    free(capture);
+}
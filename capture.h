@@ -0,0 +1,169 @@
+/**
+ * @file: capture.h
+ * @author: Michael Permyashkin
+ *
+ * @brief: Header file for capturing the output of background jobs in memory
+ *
+ * A capture reads the output of a job through a pipe into a buffer held by the shell. Once
+ * the output grows past a size limit the buffer is spilled to a temporary file and the rest
+ * of the output is appended to the file. If the output can not be spilled the capture keeps
+ * what it holds and discards the rest, so the job still runs to its end.
+ *
+ * Also defines the functions that write job output, captured or in a file, back out to the
+ * console without copying it through stdio.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "memstat.h"
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+// which part of a jobs output is written out
+enum output_range_e {
+    OUTPUT_ALL,
+    OUTPUT_HEAD,
+    OUTPUT_TAIL
+};
+
+// output of a single job that is captured through a pipe
+struct capture_t {
+    int fd;             // read end of the pipe, -1 once the job closed its end
+
+    char *buffer;       // output held in memory
+    size_t length;
+    size_t capacity;
+    size_t limit;       // size at which output is spilled to a file
+
+    int spill_fd;       // temporary file output was spilled to, -1 if not spilled
+    char *spill_file;
+    bool truncated;     // spilling failed, output past what is held was discarded
+};
+
+/**
+ * Creates a capture that holds up to the given number of bytes in memory
+ *
+ * @param limit: size at which output is spilled to a file
+ * @return the new capture
+ */
+struct capture_t *capture_create(size_t limit);
+
+/**
+ * Creates the pipe the job writes its output to
+ *
+ * @param capture: capture to open
+ * @return write end of the pipe for the job, negative on error
+ */
+int capture_open(struct capture_t *capture);
+
+/**
+ * Reads all output that is available without blocking
+ *
+ * @param capture: capture to read in to
+ * @return true if the job closed its end of the pipe
+ */
+bool capture_read(struct capture_t *capture);
+
+/**
+ * Writes all captured output to a file descriptor. Output held in memory is written
+ * with a single write, spilled output is copied from the file by the kernel.
+ *
+ * @param capture: capture to write out
+ * @param out_fd: file descriptor to write to
+ * @return status of writing the output
+ */
+int capture_write_out(struct capture_t *capture, int out_fd);
+
+/**
+ * Writes the first or last lines of the captured output to a file descriptor
+ *
+ * @param capture: capture to write out
+ * @param range: part of the output to write
+ * @param lines: number of lines for OUTPUT_HEAD and OUTPUT_TAIL
+ * @param out_fd: file descriptor to write to
+ * @return status of writing the output
+ */
+int capture_write_range(struct capture_t *capture, enum output_range_e range, long lines, int out_fd);
+
+/**
+ * Writes the output captured after an offset to a file descriptor, used to follow
+ * the output of a running job
+ *
+ * @param capture: capture to write out
+ * @param offset: number of bytes already written, moved past the bytes written
+ * @param out_fd: file descriptor to write to
+ * @return status of writing the output
+ */
+int capture_write_from(struct capture_t *capture, size_t *offset, int out_fd);
+
+/**
+ * Writes a file from an offset to its current end to a file descriptor. The kernel
+ * copies the data with sendfile or copy_file_range where possible, otherwise it is
+ * copied with large reads and writes.
+ *
+ * @param in_fd: file to copy from
+ * @param offset: offset to start at, moved past the bytes written
+ * @param out_fd: file descriptor to write to
+ * @return status of the copy
+ */
+int copy_file_from(int in_fd, off_t *offset, int out_fd);
+
+/**
+ * Writes a whole file to a file descriptor. The kernel copies the data with sendfile or
+ * copy_file_range where possible, otherwise it is copied with large reads and writes.
+ *
+ * @param in_fd: file to copy from its start
+ * @param out_fd: file descriptor to write to
+ * @return status of the copy
+ */
+int copy_file_out(int in_fd, int out_fd);
+
+/**
+ * Writes the first or last lines of a file to a file descriptor. The file is mapped in
+ * to memory so only the pages holding the lines are read.
+ *
+ * @param in_fd: file to write lines of
+ * @param range: part of the file to write
+ * @param lines: number of lines for OUTPUT_HEAD and OUTPUT_TAIL
+ * @param out_fd: file descriptor to write to
+ * @return status of writing the lines
+ */
+int file_write_range(int in_fd, enum output_range_e range, long lines, int out_fd);
+
+/**
+ * Writes a block of bytes fully, retrying partial writes
+ *
+ * @param fd: file descriptor to write to
+ * @param data: bytes to write
+ * @param length: number of bytes
+ * @return status of the write
+ */
+int write_all(int fd, char *data, size_t length);
+
+/**
+ * Returns the number of bytes captured so far
+ *
+ * @param capture: capture to check
+ * @return size of the output
+ */
+size_t capture_size(struct capture_t *capture);
+
+/**
+ * Counts the memory held by a capture and the output it holds in memory
+ *
+ * @param capture: capture to count
+ * @param usage: counters to add to
+ */
+void capture_memory(struct capture_t *capture, struct mem_usage_t *usage);
+
+/**
+ * Closes the pipe, deletes any spilled file and frees the capture
+ *
+ * @param capture: capture to free
+ */
+void capture_free(struct capture_t *capture);
+
+#endif
@@ -0,0 +1,248 @@
+/**
+ * @file: cmdhash.c
+ * @author: Andrew Kress
+ *
+ * @brief: Hash table of command names to executable paths.
+ *
+ * Searching PATH for every command means trying each directory until the executable
+ * is found. The result of each search is stored in a table of buckets, each bucket a
+ * linked list of entries, so a command is only searched for the first time it is run.
+ * The table is cleared whenever PATH is changed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "list.h"
+#include "cmdhash.h"
+#include "environ.h"
+#include "error.h"
+
+
+// number of buckets in the hash table
+#define CMDHASH_BUCKETS 64
+
+
+// struct to store a command name and the path it resolved to in a bucket list
+struct cmdhash_entry_t {
+    char *name;
+    char *path;
+    int hits;
+    struct list_head list;
+};
+
+
+// buckets of the hash table, initialized on first use
+static struct list_head buckets[CMDHASH_BUCKETS];
+static bool buckets_initialized = false;
+
+
+/**
+ * Returns the bucket a command name belongs in
+ *
+ * @param name - Name of the command
+ * @return head of the bucket list
+ **/
+struct list_head *cmdhash_bucket(char *name) {
+    // initialize every bucket as an empty list
+    if (!buckets_initialized) {
+        for (int i = 0; i < CMDHASH_BUCKETS; i++) {
+            list_init(&buckets[i]);
+        }
+        buckets_initialized = true;
+    }
+
+    // djb2 string hash
+    unsigned long hash = 5381;
+    for (char *c = name; *c != '\0'; c++) {
+        hash = hash * 33 + (unsigned char)*c;
+    }
+
+    return &buckets[hash % CMDHASH_BUCKETS];
+}
+
+
+/**
+ * Returns the entry of a command name if it is in the table
+ *
+ * @param name - Name of the command
+ * @return the entry, NULL if the name is not in the table
+ **/
+struct cmdhash_entry_t *cmdhash_find(char *name) {
+    struct list_head *head = cmdhash_bucket(name);
+    struct list_head *curr;
+    struct cmdhash_entry_t *entry;
+
+    for (curr = head->next; curr != head; curr = curr->next) {
+        entry = list_entry(curr, struct cmdhash_entry_t, list);
+        if (strcmp(entry->name, name) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+
+/**
+ * Searches each directory of PATH for an executable with the given name
+ *
+ * @param name - Name of the command
+ * @return allocated path of the executable, NULL if no directory has it
+ **/
+char *search_path(char *name) {
+    struct environ_var_t *path_var = environ_get_var("PATH");
+    if (path_var == NULL) return NULL;
+
+    char *dirs = path_var->value;
+    int name_len = strlen(name);
+
+    while (true) {
+        // directory ends at next colon or end of PATH
+        char *end = strchr(dirs, ':');
+        int dir_len = (end != NULL) ? end - dirs : strlen(dirs);
+
+        // an empty entry in PATH is the current directory
+        char *candidate = malloc(dir_len + name_len + 3);
+        if (dir_len == 0) {
+            strcpy(candidate, ".");
+        } else {
+            memcpy(candidate, dirs, dir_len);
+            candidate[dir_len] = '\0';
+        }
+        strcat(candidate, "/");
+        strcat(candidate, name);
+
+        // found regular file that we are allowed to execute
+        struct stat sfile;
+        if (stat(candidate, &sfile) == 0 && S_ISREG(sfile.st_mode) && access(candidate, X_OK) == 0)
+            return candidate;
+        free(candidate);
+
+        if (end == NULL) break;
+        dirs = end + 1;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Returns the absolute path of the executable for a command name. Names that contain a
+ * slash are returned as they are. Otherwise the hash table is checked first and PATH
+ * is only searched the first time a name is looked up.
+ *
+ * @param name - Name of the command
+ *
+ * @return path of the executable, NULL if it was not found in PATH
+ **/
+char *cmdhash_lookup(char *name) {
+    if (name == NULL || name[0] == '\0') return NULL;
+
+    // paths are executed as given
+    if (strchr(name, '/') != NULL) return name;
+
+    // already resolved
+    struct cmdhash_entry_t *entry = cmdhash_find(name);
+    if (entry != NULL) {
+        entry->hits++;
+        return entry->path;
+    }
+
+    // search PATH and remember the result
+    char *path = search_path(name);
+    if (path == NULL) return NULL;
+
+    entry = malloc(sizeof(struct cmdhash_entry_t));
+    entry->name = strdup(name);
+    entry->path = path;
+    entry->hits = 1;
+    list_add_tail(&entry->list, cmdhash_bucket(name));
+
+    return entry->path;
+}
+
+
+/**
+ * Removes an entry from its bucket and frees it
+ *
+ * @param entry - Entry to remove
+ **/
+void cmdhash_delete_entry(struct cmdhash_entry_t *entry) {
+    list_del(&entry->list);
+    free(entry->name);
+    free(entry->path);
+    free(entry);
+}
+
+
+/**
+ * Forgets the remembered path of a single command, used when the path turned out to
+ * be stale
+ *
+ * @param name - Name of the command
+ **/
+void cmdhash_remove(char *name) {
+    struct cmdhash_entry_t *entry = cmdhash_find(name);
+    if (entry != NULL)
+        cmdhash_delete_entry(entry);
+}
+
+
+/**
+ * Forgets all remembered paths. Called whenever PATH changes.
+ **/
+void cmdhash_clear() {
+    if (!buckets_initialized) return;
+
+    for (int i = 0; i < CMDHASH_BUCKETS; i++) {
+        // delete entries until bucket is empty
+        while (!list_empty(&buckets[i])) {
+            cmdhash_delete_entry(list_entry(buckets[i].next, struct cmdhash_entry_t, list));
+        }
+    }
+}
+
+
+/**
+ * Prints the remembered commands with the number of times each was looked up
+ **/
+void cmdhash_print() {
+    bool empty = true;
+
+    for (int i = 0; buckets_initialized && i < CMDHASH_BUCKETS; i++) {
+        struct list_head *curr;
+        for (curr = buckets[i].next; curr != &buckets[i]; curr = curr->next) {
+            struct cmdhash_entry_t *entry = list_entry(curr, struct cmdhash_entry_t, list);
+
+            // print header before first entry
+            if (empty) printf("hits\tcommand\n");
+            empty = false;
+
+            printf("%4d\t%s\n", entry->hits, entry->path);
+        }
+    }
+
+    if (empty) LOG_MSG(MSG_HASH_EMPTY);
+}
+
+
+/**
+ * Counts the memory held by the remembered commands
+ *
+ * @param usage: counters to add to
+ **/
+void cmdhash_memory(struct mem_usage_t *usage) {
+    struct list_head *curr;
+
+    for (int i = 0; buckets_initialized && i < CMDHASH_BUCKETS; i++) {
+        for (curr = buckets[i].next; curr != &buckets[i]; curr = curr->next) {
+            struct cmdhash_entry_t *entry = list_entry(curr, struct cmdhash_entry_t, list);
+            mem_count(usage, entry);
+            mem_count(usage, entry->name);
+            mem_count(usage, entry->path);
+        }
+    }
+}
@@ -0,0 +1,54 @@
+/**
+ * @file: cmdhash.h
+ * @author: Andrew Kress
+ *
+ * @brief: Header file for the command hash table
+ *
+ * Defines functions to resolve command names to the absolute path of the executable
+ * found in PATH. Resolved paths are remembered so later lookups do not search PATH again.
+ */
+
+#include <stddef.h>
+
+#include "memstat.h"
+
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+/**
+ * Returns the absolute path of the executable for a command name. Names that contain a
+ * slash are returned as they are. Otherwise the hash table is checked first and PATH
+ * is only searched the first time a name is looked up.
+ *
+ * @param name - Name of the command
+ *
+ * @return path of the executable, NULL if it was not found in PATH
+ **/
+char *cmdhash_lookup(char *name);
+
+/**
+ * Forgets the remembered path of a single command, used when the path turned out to
+ * be stale
+ *
+ * @param name - Name of the command
+ **/
+void cmdhash_remove(char *name);
+
+/**
+ * Forgets all remembered paths. Called whenever PATH changes.
+ **/
+void cmdhash_clear();
+
+/**
+ * Prints the remembered commands with the number of times each was looked up
+ **/
+void cmdhash_print();
+
+/**
+ * Counts the memory held by the remembered commands
+ *
+ * @param usage: counters to add to
+ **/
+void cmdhash_memory(struct mem_usage_t *usage);
+
+#endif
@@ -8,6 +8,10 @@
  * variables can be created, modified, deleted, and retrieved. The internal
  * environment can also be created by a NULL terminated string array and a 
  * NULL terminated string array can be created from the internal environment.
+ * 
+ * Variables are kept in a linked list which holds the order they are exported in
+ * and an open addressing hash index over the list makes lookups by name constant
+ * time. The envp array is cached and rebuilt only after the environment changed.
  */ 
 
 #include <stdio.h>
@@ -19,11 +23,136 @@
 #include "environ.h"
 #include "internal.h"
 #include "runner.h"
+#include "cmdhash.h"
 
 
-// linked list to hold environment variables
+// linked list to hold environment variables in the order they are exported
 static LIST_HEAD(environment);
 
+// starting number of slots in the hash index, always a power of two
+#define INDEX_INITIAL_CAPACITY 64
+
+// open addressing hash index over the variables in the environment list
+static struct environ_var_t **env_index = NULL;
+static int index_capacity = 0;
+static int index_used = 0;   // slots holding a variable or a tombstone
+static int num_vars = 0;
+
+// marks an index slot whose variable was removed so probing continues past it
+static struct environ_var_t tombstone;
+
+// incremented each time a variable is added, changed or removed
+static unsigned long generation = 1;
+
+// envp array built from the environment and the generation it was built for
+static char **envp_snapshot = NULL;
+static unsigned long snapshot_generation = 0;
+
+
+/**
+ * Returns the FNV-1a hash of a variable name
+ * 
+ * @param name - Environment variable name
+ * @return hash of the name
+ **/
+unsigned long hash_name(char *name) {
+    unsigned long hash = 14695981039346656037UL;
+    for (char *c = name; *c != '\0'; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+
+/**
+ * Returns the index slot of the variable with the given name. If the variable
+ * is not in the index, the empty slot it would be inserted in is returned.
+ * 
+ * @param name - Environment variable name
+ * @return slot in the hash index
+ **/
+int index_find_slot(char *name) {
+    int mask = index_capacity - 1;
+    int slot = hash_name(name) & mask;
+    int insert_slot = -1;
+
+    // linear probing until the name or an empty slot is found
+    while (env_index[slot] != NULL) {
+        if (env_index[slot] == &tombstone) {
+            // remember first reusable slot
+            if (insert_slot < 0) insert_slot = slot;
+        } else if (strcmp(env_index[slot]->name, name) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return (insert_slot >= 0) ? insert_slot : slot;
+}
+
+
+/**
+ * Allocates a new hash index with the given capacity and inserts every variable
+ * of the environment list into it. Tombstones of the old index are dropped.
+ * 
+ * @param capacity - Number of slots, must be a power of two
+ **/
+void index_rebuild(int capacity) {
+    free(env_index);
+    env_index = calloc(capacity, sizeof(struct environ_var_t *));
+    index_capacity = capacity;
+    index_used = 0;
+
+    struct list_head *head = &environment;
+    struct list_head *curr;
+    for (curr = head->next; curr != head; curr = curr->next) {
+        struct environ_var_t *env_var = list_entry(curr, struct environ_var_t, list);
+        env_index[index_find_slot(env_var->name)] = env_var;
+        index_used++;
+    }
+}
+
+
+/**
+ * Adds a variable that is already in the environment list to the hash index.
+ * The index grows once more than 70% of the slots are in use.
+ * 
+ * @param var - Environment variable to add
+ **/
+void index_insert(struct environ_var_t *var) {
+    // keep the load low so probe sequences stay short, the rebuild includes var
+    if (env_index == NULL || (index_used + 1) * 10 > index_capacity * 7) {
+        int capacity = (index_capacity == 0) ? INDEX_INITIAL_CAPACITY : index_capacity;
+        while ((num_vars + 1) * 10 > capacity * 5) capacity *= 2;
+        index_rebuild(capacity);
+        return;
+    }
+
+    int slot = index_find_slot(var->name);
+    if (env_index[slot] == NULL) index_used++;
+    env_index[slot] = var;
+}
+
+
+/**
+ * Builds the `name=value` string of a variable which is shared by every envp snapshot
+ * 
+ * @param var - Environment variable
+ **/
+void set_env_str(struct environ_var_t *var) {
+    int name_len = strlen(var->name);
+    int value_len = strlen(var->value);
+
+    free(var->env_str);
+    var->env_str = malloc(name_len + value_len + 2); // space for `=` and `\0`
+
+    // build string with pattern `name=value`
+    memcpy(var->env_str, var->name, name_len);
+    var->env_str[name_len] = '=';
+    memcpy(var->env_str + name_len + 1, var->value, value_len + 1);
+}
+
 
 /**
  * Returns a string array of the name and value for an evironment variable
@@ -54,12 +183,19 @@ char **split_environ_var(char *env_var_str) {
 
 /**
  * Returns a null terminated string array for the environment variables from 
- * the environment linked list
+ * the environment linked list. The array is cached and only rebuilt after the
+ * environment changed, callers must not modify or free it.
  * 
  * @return null terminated string array of environment variables
  **/
 char **make_environ() {
-    char **envp = calloc(list_size(&environment) + 1, sizeof(char *));
+    // environment has not changed since the snapshot was built
+    if (envp_snapshot != NULL && snapshot_generation == generation)
+        return envp_snapshot;
+
+    free(envp_snapshot);
+    envp_snapshot = malloc((num_vars + 1) * sizeof(char *));
+
     struct list_head *head = &environment;
     struct list_head *curr;
     struct environ_var_t *env_var;
@@ -67,20 +203,26 @@ char **make_environ() {
     int i = 0;
     for (curr = head->next; curr != head; curr = curr->next) {
         env_var = list_entry(curr, struct environ_var_t, list);
-        char *env_var_str = malloc(strlen(env_var->name) + strlen(env_var->value) + 2); // space for `=` and `\0`
-
-        // build string with pattern `name=value`
-        strcpy(env_var_str, env_var->name);
-        strcat(env_var_str, "=");
-        strcat(env_var_str, env_var->value);
-
-        // add to array
-        envp[i++] = env_var_str;
+        // add prebuilt `name=value` string to array
+        envp_snapshot[i++] = env_var->env_str;
     }
     // terminate array with NULL
-    envp[i] = NULL;
+    envp_snapshot[i] = NULL;
+
+    snapshot_generation = generation;
+
+    return envp_snapshot;
+}
+
 
-    return envp;
+/**
+ * Returns the generation of the environment. The generation changes each time
+ * a variable is added, changed or removed.
+ * 
+ * @return generation of the environment
+ **/
+unsigned long environ_generation() {
+    return generation;
 }
 
 
@@ -92,20 +234,15 @@ char **make_environ() {
 void environ_init(char **envp) {
 
     for (int i = 0; envp[i] != NULL; i++) {
-        // Create a new environment variable.
-        struct environ_var_t *var = malloc(sizeof(struct environ_var_t));
-
         // Create a string array of the variable name and value.
         char **environ_var_val = split_environ_var(envp[i]);
 
-        // Set the variable name and value.
-        var->name = environ_var_val[0];
-        var->value = environ_var_val[1];
-        
-        // add environment variable to list
-        list_add(&var->list, &environment);
+        // add environment variable to list, keeping the order it was given in
+        environ_set_var(environ_var_val[0], environ_var_val[1]);
 
         // Free the name and value string array.
+        free(environ_var_val[0]);
+        free(environ_var_val[1]);
         free(environ_var_val);
     }
 }
@@ -118,22 +255,7 @@ void environ_init(char **envp) {
  * @return true if variable exists in the environment; false if it doesn't
  **/
 bool environ_var_exist(char *name) {
-    // Loop through the internal environment.
-    struct list_head *head = &environment;
-    struct list_head *curr;
-    struct environ_var_t *env_var;
-
-    for (curr = head->next; curr != head; curr = curr->next) {
-        // Get the environment variable for the current list item.
-        env_var = list_entry(curr, struct environ_var_t, list);
-
-        // If the environment variable's name matches, return true;
-        if (env_var != NULL && strcmp(env_var->name, name) == 0)
-            return true;
-    }
-
-    // not found, return false.
-    return false;
+    return environ_get_var(name) != NULL;
 }
 
 
@@ -150,25 +272,30 @@ void environ_add_var(char *name, char *value) {
     // Assign environment variable's name and value from params
     var->name = strdup(name);
     var->value = strdup(value);
+    var->env_str = NULL;
+    set_env_str(var);
 
-    // Add to end of list
+    // Add to end of list and to the index
     list_add_tail(&var->list, &environment);
+    num_vars++;
+    index_insert(var);
+    generation++;
 }
 
 
 /**
  * Update an existing environment variable struct in the linked list
  * 
- * @param name - Name of the environment variable
+ * @param var - The environment variable
  * @param value - Value of the environment variable
  **/
-void environ_update_var(char *name, char *value) {
-    // Get the requested environment variable.
-    struct environ_var_t *var = environ_get_var(name);
+void environ_update_var(struct environ_var_t *var, char *value) {
     // Free the old value.
     free(var->value);
     // Set the value to equal the given value.
     var->value = strdup(value);
+    set_env_str(var);
+    generation++;
 }
 
 
@@ -180,9 +307,15 @@ void environ_update_var(char *name, char *value) {
  * @param value - Value of the environment variable
  **/
 void environ_set_var(char *name, char *value) {
+    // remembered command paths are only valid for the PATH they were found in
+    if (strcmp(name, "PATH") == 0)
+        cmdhash_clear();
+
+    struct environ_var_t *var = environ_get_var(name);
+
     // If the requested environment variable exists, update value
-    if (environ_var_exist(name))
-        environ_update_var(name, value);
+    if (var != NULL)
+        environ_update_var(var, value);
     // doesn't exist yet, add it to the list with the given value.
     else
         environ_add_var(name, value);
@@ -196,10 +329,19 @@ void environ_set_var(char *name, char *value) {
  * @param name - Name of the environment variable
  **/
 void environ_remove_var(char *name) {
+    // remembered command paths are only valid for the PATH they were found in
+    if (strcmp(name, "PATH") == 0)
+        cmdhash_clear();
+
     // If the requested environment variable exists, remove it from the list.
-    if (environ_var_exist(name)) {
-        // Get the given environment variable.
-        struct environ_var_t *var = environ_get_var(name);
+    if (env_index == NULL) return;
+    int slot = index_find_slot(name);
+    struct environ_var_t *var = env_index[slot];
+
+    if (var != NULL && var != &tombstone) {
+        // Leave a tombstone so lookups probing past this slot still work.
+        env_index[slot] = &tombstone;
+        num_vars--;
 
         // Remove the list item from the internal environment.
         list_del(&var->list);
@@ -207,7 +349,9 @@ void environ_remove_var(char *name) {
         // Free the environment variable.
         free(var->name);
         free(var->value);
+        free(var->env_str);
         free(var);
+        generation++;
     }
 }
 
@@ -220,24 +364,12 @@ void environ_remove_var(char *name) {
  * @return The environment variable
  **/
 struct environ_var_t *environ_get_var(char *name) {
+    if (env_index == NULL) return NULL;
+
     // If the requested environment variable exists, return variables struct
-    if (environ_var_exist(name)) {
-        // Loop through the environment variables.
-        struct list_head *head = &environment;
-        struct list_head *curr;
-        struct environ_var_t *env_var;
-
-        for (curr = head->next; curr != head; curr = curr->next) {
-            // Get the value of the environment variable for the
-            // current list item.
-            env_var = list_entry(curr, struct environ_var_t, list);
-            // Check if the environment variable's name matches
-            // the requested variable and return if it matches.
-            if (strcmp(env_var->name, name) == 0)
-                return env_var;
-        }
-    }
-    return NULL;
+    struct environ_var_t *var = env_index[index_find_slot(name)];
+    if (var == &tombstone) return NULL;
+    return var;
 }
 
 
@@ -250,9 +382,7 @@ void environ_print() {
     char **env = make_environ();
     for (int i = 0; env[i] != NULL; i++) {
         printf("%s\n", env[i]);
-        free(env[i]);
     }
-    free(env);
 }
 
 
@@ -274,6 +404,39 @@ void environ_clean_up() {
         // Free the environment variable.
         free(env_var->name);
         free(env_var->value);
+        free(env_var->env_str);
         free(env_var);
     }
-}
\ No newline at end of file
+
+    // Free the index and the cached envp array.
+    free(env_index);
+    env_index = NULL;
+    index_capacity = 0;
+    index_used = 0;
+    num_vars = 0;
+
+    free(envp_snapshot);
+    envp_snapshot = NULL;
+    generation++;
+}
+
+
+/**
+ * Counts the memory held by the variables, the index over them and the cached envp array
+ * 
+ * @param usage: counters to add to
+ */
+void environ_memory(struct mem_usage_t *usage) {
+    struct list_head *curr;
+
+    for (curr = environment.next; curr != &environment; curr = curr->next) {
+        struct environ_var_t *var = list_entry(curr, struct environ_var_t, list);
+        mem_count(usage, var);
+        mem_count(usage, var->name);
+        mem_count(usage, var->value);
+        mem_count(usage, var->env_str);
+    }
+
+    mem_count(usage, env_index);
+    mem_count(usage, envp_snapshot);
+}
@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "list.h"
+#include "memstat.h"
 
 #ifndef ENVIRON_H
 #define ENVIRON_H
@@ -19,17 +20,29 @@
 struct environ_var_t {
     char *name;
     char *value;
+    char *env_str;  // `name=value` string used in envp arrays
     struct list_head list;
 };
 
 /**
  * Returns a null terminated string array for the environment variables from 
- * the environment linked list
+ * the environment linked list. The array is a cached snapshot which is only 
+ * rebuilt after a variable was added, changed or removed. Callers must not 
+ * modify or free it and it is only valid until the environment changes.
  * 
  * @return null terminated string array of environment variables
  **/
 char **make_environ();
 
+/**
+ * Returns the generation of the environment. The generation changes each time
+ * a variable is added, changed or removed, so anything derived from the environment
+ * can be cached along with the generation it was derived from.
+ * 
+ * @return generation of the environment
+ **/
+unsigned long environ_generation();
+
 /**
  * Initialized environment linked list with array passed to shell 
  * 
@@ -83,4 +96,11 @@ void environ_print();
  */
 void environ_clean_up();
 
+/**
+ * Counts the memory held by the variables, the index over them and the cached envp array
+ * 
+ * @param usage: counters to add to
+ **/
+void environ_memory(struct mem_usage_t *usage);
+
 #endif
\ No newline at end of file
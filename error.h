@@ -36,24 +36,80 @@
 #define ERROR_CD_NOHOME "Error - cd no home directory\n"
 #define ERROR_PWD_ARG "Error - pwd takes no arguments\n"
 #define ERROR_EXIT_ARG "Rrror - exit takes no arguments\n"
+#define ERROR_HASH_ARG "Error - hash takes no arguments or -r\n"
+#define MSG_HASH_EMPTY "hash table empty\n"
+#define ERROR_STATS_ARG "Error - stats takes no arguments\n"
+#define ERROR_TIME_ARG "Error - time requires a command\n"
+#define MSG_TIME_STAGE "%d %s: real %.6fs user %.6fs sys %.6fs maxrss %ldK status %d\n"   // stage, name, real, user, sys, rss, status
+#define MSG_TIME_TOTAL "total: real %.6fs shell parse %.6fs setup %.6fs launch %.6fs wait %.6fs\n"
+#define ERROR_FDS_ARG "Error - fds takes no arguments\n"
+#define ERROR_FDS_LIST "Error - could not list file descriptors : %s\n"          // strerror(errno)
+#define MSG_FDS_ENTRY "%d %s%s\n"                                                  // fd, target, cloexec
+#define ERROR_MEM_ARG "Error - mem takes no arguments\n"
+#define ERROR_MEM_RSS "Error - could not read resident size : %s\n"              // strerror(errno)
+#define MSG_MEM_USAGE "%-8s %12zu bytes in %lu allocations\n"                     // part of the shell, bytes, allocations
+#define MSG_MEM_HEAP "heap     %12zu bytes in use, %zu bytes held\n"              // bytes in use, bytes held
+#define MSG_MEM_RSS "rss      %12ld bytes\n"                                      // resident size
+#define ERROR_HISTORY_ARG "Error - history takes a number of entries or -s and a prefix\n"
+#define ERROR_HISTORY_OPEN "Error - could not open history %s : %s\n"            // filename, strerror(errno)
+#define ERROR_HISTORY_NONE "Error - no history is kept, set SUSH_HISTORY to a file to keep one\n"
+#define ERROR_HISTORY_READ "Error - could not read history : %s\n"               // strerror(errno)
+#define ERROR_HISTORY_EVENT "Error - !%s : event not found\n"                     // event
+#define MSG_HISTORY_ENTRY "%5ld  %.*s\n"                                          // entry #, length, line
+#define MSG_HISTORY_RECALL "%s\n"                                                 // recalled line
+#define MSG_STATS_PARSECACHE "parse cache: %lu hits, %lu misses, %d of %d lines\n" // hits, misses, lines, capacity
+
+
+// errors for builtin utilities
+#define ERROR_ENABLE_ARG "Error - enable takes builtin names, optionally after -n\n"
+#define ERROR_ENABLE_NAME "Error - enable %s is not a builtin\n"                  // builtin name
+#define ERROR_PRINTF_ARG "Error - printf requires a format\n"
+#define ERROR_PRINTF_NUMBER "Error - printf invalid number %s\n"                  // argument
+#define ERROR_PRINTF_CONVERSION "Error - printf invalid conversion %c\n"          // conversion character
+#define ERROR_TEST_BRACKET "Error - [ missing ]\n"
+#define ERROR_TEST_EXPECTED "Error - test argument expected\n"
+#define ERROR_TEST_PAREN "Error - test missing )\n"
+#define ERROR_TEST_UNEXPECTED "Error - test unexpected argument %s\n"             // argument
+#define ERROR_TEST_INTEGER "Error - test integer expected : %s\n"                 // argument
 
 
 // errors for command queue and background execution
 #define ERROR_QUEUE_ARG  "Error - queue requires at least two arguments\n"
-#define ERROR_OUTPUT_ARG "Error - output takes one argument\n"
+#define ERROR_QUEUE_AFTER "Error - queue --after takes a comma separated list of job ids\n"
+#define ERROR_QUEUE_AFTER_JOB "Error - queue --after job %d does not exist\n"      // task #
+#define ERROR_QUEUE_CPUS "Error - queue --cpus takes a cpu list such as 0-7,16 or auto\n"
+#define ERROR_QUEUE_NICE "Error - queue --nice takes a number from -20 to 19\n"
+#define ERROR_QUEUE_MEM "Error - queue --mem takes a size such as 4G\n"
+#define ERROR_QUEUE_OPTION "Error - queue unknown option %s\n"                    // option
+#define ERROR_OUTPUT_ARG "Error - output takes one argument, optionally followed by --head N or --tail N, or --follow N\n"
 #define ERROR_OUTPUT_QUEUED   "Error - task %d is still queued.\n"                  // task # 0, 1, ...
 #define ERROR_OUTPUT_RUNNING "Error - task %d is still running\n"                   // task # 
+#define ERROR_OUTPUT_FOLLOW "Error - could not wait for task %d, it is left in the queue\n"     // task #
+#define ERROR_OUTPUT_TRUNCATED "Error - task %d output was truncated, it could not be spilled to a file\n" // task #
+#define ERROR_CAPTURE_SPILL "Error - could not spill job output to a file, output past %zu bytes is discarded : %s\n" // bytes kept, reason
+#define ERROR_WAIT_ARG "Error - wait takes job ids\n"
+#define ERROR_WAIT_JOB "Error - wait job %d does not exist\n"                       // task #
 #define ERROR_STATUS_ARG "Error - status takes 0 arguments\n"
 #define ERROR_CANCEL_ARG "Error - cancel takes one argument\n"
 #define ERROR_CANCEL_DONE "%d is already finished, use output %d to show results\n" // task #, task #
+#define ERROR_JOBS_ARG "Error - jobs takes no arguments or -j followed by a positive number\n"
 
 
 // errors for command queue and background execution
 #define MSG_STATUS_QUEUED "%d - is queued\n"                                        // task #
 #define MSG_STATUS_RUNNING "%d is running as pid %d\n"                              // task #
 #define MSG_STATUS_COMPLETE "%d is complete\n"                                      // task #
+#define MSG_STATUS_WAITING "%d - is waiting for %d jobs\n"                          // task #, jobs left
+#define MSG_STATUS_SKIPPED "%d was skipped, a job it depends on failed\n"           // task #
+#define MSG_STATUS_LIMITS "%d - limited to %s\n"                                    // task #, limits
 #define MSG_CANCEL_OK "%d is canceled\n"                                            // task #
 #define MSG_CANCEL_KILL "%d sending kill signal to pid %d\n"                        // task #, pid_t
+#define MSG_JOBS_LIMIT "%d running, at most %d at a time\n"                         // running, limit
+#define ERROR_JOURNAL_OPEN "Error - could not open job journal %s : %s\n"          // filename, strerror(errno)
+#define ERROR_LIMIT_CPUS "Error - could not set cpus of job : %s\n"              // strerror(errno)
+#define ERROR_LIMIT_NICE "Error - could not set nice value of job : %s\n"        // strerror(errno)
+#define ERROR_LIMIT_MEM "Error - could not set memory limit of job : %s\n"       // strerror(errno)
+#define MSG_JOURNAL_RECOVER "%d from the journal is queued again as %d\n"          // old task #, new task #
 
 
 // errors for command execution
@@ -64,4 +120,9 @@
 #define ERROR_INVALID_CMD "Error could not execute : %s\n"                          // strerror(errno)
 #define ERROR_INVALID_CMDLINE "Error - malformed command line.\n"
 
+
+// errors for starting the shell
+#define ERROR_USAGE "usage: sush [-n] [-c command | script]\n"
+#define ERROR_SCRIPT_OPEN "Error - could not open script %s : %s\n"              // filename, strerror(errno)
+
 #endif
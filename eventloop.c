@@ -0,0 +1,269 @@
+/**
+ * @file: eventloop.c
+ * @author: Michael Permyashkin
+ *
+ * @brief: Event loop the shell waits in
+ *
+ * The shell waits for input, for background jobs to change state and for their output in one
+ * epoll instance. File descriptors stay watched between waits so waiting never rebuilds a list
+ * of them and there is no limit to how many are watched. The handler of each one is kept in a
+ * table indexed by the file descriptor, an event is only handled if its file descriptor is
+ * still watched when the loop gets to it, so a handler may stop watching any file descriptor.
+ *
+ * Signals the loop delivers are blocked and read from a signalfd, the shell has no signal
+ * handlers doing work while it is interrupted. Children inherit the signal mask through fork
+ * and exec, so every child is started with the mask the shell had before.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "runner.h"
+#include "eventloop.h"
+
+// most events handled for each wait
+#define EVENTLOOP_MAX_EVENTS 64
+
+// smallest table of watched file descriptors
+#define EVENTLOOP_MIN_WATCHES 64
+
+// handler of a watched file descriptor
+struct event_watch_t {
+    event_handler_t handler;
+    void *data;
+
+    bool active;        // file descriptor is in the epoll instance
+    bool timer;         // expirations are read before the handler runs
+};
+
+// epoll instance, -1 before the loop is created and in forked children
+static int epoll_fd = -1;
+
+// handlers indexed by file descriptor
+static struct event_watch_t *watches = NULL;
+static int watches_capacity = 0;
+
+// signal mask children start with, read before the loop blocks any signal
+static sigset_t child_mask;
+static bool child_mask_saved = false;
+
+
+/**
+ * Reads the signal mask of the shell the first time it is needed
+ */
+void save_child_mask() {
+    if (child_mask_saved) return;
+
+    sigprocmask(SIG_BLOCK, NULL, &child_mask);
+    child_mask_saved = true;
+}
+
+
+/**
+ * Creates the epoll instance of the loop. Calling it again once the loop exists does nothing.
+ *
+ * @return status of creating the loop
+ */
+int eventloop_init() {
+    if (epoll_fd >= 0) return SUCCESS;
+
+    save_child_mask();
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return (epoll_fd < 0) ? ERROR : SUCCESS;
+}
+
+
+/**
+ * Grows the table of watched file descriptors so it holds the given one
+ *
+ * @param fd: file descriptor the table has to hold
+ */
+void grow_watches(int fd) {
+    if (fd < watches_capacity) return;
+
+    int capacity = (watches_capacity > 0) ? watches_capacity : EVENTLOOP_MIN_WATCHES;
+    while (capacity <= fd) capacity *= 2;
+
+    watches = realloc(watches, capacity * sizeof(struct event_watch_t));
+    memset(watches + watches_capacity, 0, (capacity - watches_capacity) * sizeof(struct event_watch_t));
+    watches_capacity = capacity;
+}
+
+
+/**
+ * Watches a file descriptor, the handler runs each time the loop finds it readable or
+ * closed by the other end. Watching a file descriptor again replaces its handler.
+ *
+ * @param fd: file descriptor to watch
+ * @param handler: function to run, NULL to only wake the loop
+ * @param data: passed to the handler
+ * @return status of watching the file descriptor
+ */
+int eventloop_watch(int fd, event_handler_t handler, void *data) {
+    if (epoll_fd < 0 || fd < 0) return ERROR;
+
+    grow_watches(fd);
+
+    // level triggered, a handler that leaves input unread is run again on the next wait
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+    int op = watches[fd].active ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epoll_fd, op, fd, &event) < 0) return ERROR;
+
+    watches[fd] = (struct event_watch_t){ .handler = handler, .data = data, .active = true };
+    return SUCCESS;
+}
+
+
+/**
+ * Stops watching a file descriptor, file descriptors that are not watched are ignored
+ *
+ * @param fd: file descriptor to stop watching
+ */
+void eventloop_unwatch(int fd) {
+    if (fd < 0 || fd >= watches_capacity || !watches[fd].active) return;
+
+    if (epoll_fd >= 0) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    watches[fd].active = false;
+}
+
+
+/**
+ * Delivers a signal through a signalfd instead of a signal handler. The signal is blocked
+ * in the shell and removed from the mask children start with.
+ *
+ * @param signal: signal to deliver
+ * @param handler: function to run when the signal is pending
+ * @param data: passed to the handler
+ * @return the signalfd, negative on error
+ */
+int eventloop_signal(int signal, event_handler_t handler, void *data) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, signal);
+
+    // signal stays pending for the signalfd instead of interrupting the shell
+    save_child_mask();
+    if (sigprocmask(SIG_BLOCK, &set, NULL) < 0) return ERROR;
+    sigdelset(&child_mask, signal);
+
+    int fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) return ERROR;
+
+    if (eventloop_watch(fd, handler, data) < 0) {
+        close(fd);
+        return ERROR;
+    }
+    return fd;
+}
+
+
+/**
+ * Starts a timer that expires after an interval and again every interval after
+ *
+ * @param interval_ms: interval in milliseconds
+ * @param handler: function to run when the timer expired, NULL to only wake the loop
+ * @param data: passed to the handler
+ * @return the timerfd, negative on error
+ */
+int eventloop_timer(long interval_ms, event_handler_t handler, void *data) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) return ERROR;
+
+    struct timespec interval = { .tv_sec = interval_ms / 1000, .tv_nsec = (interval_ms % 1000) * 1000000 };
+    struct itimerspec spec = { .it_interval = interval, .it_value = interval };
+
+    if (timerfd_settime(fd, 0, &spec, NULL) < 0 || eventloop_watch(fd, handler, data) < 0) {
+        close(fd);
+        return ERROR;
+    }
+    watches[fd].timer = true;
+    return fd;
+}
+
+
+/**
+ * Waits until at least one watched file descriptor is readable and runs the handler of
+ * every one that is
+ *
+ * @param timeout_ms: longest time to wait in milliseconds, -1 to wait without a limit
+ * @return number of events handled, 0 on timeout or interruption, ERROR if there is no loop
+ */
+int eventloop_run_once(int timeout_ms) {
+    struct epoll_event events[EVENTLOOP_MAX_EVENTS];
+
+    if (epoll_fd < 0) return ERROR;
+
+    int count = epoll_wait(epoll_fd, events, EVENTLOOP_MAX_EVENTS, timeout_ms);
+    if (count < 0) return (errno == EINTR) ? 0 : ERROR;
+
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+
+        // a handler run before may have stopped watching it
+        if (fd >= watches_capacity || !watches[fd].active) continue;
+
+        // timer is not readable again until it expires again
+        if (watches[fd].timer) {
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) < 0) continue;
+        }
+
+        if (watches[fd].handler != NULL) watches[fd].handler(fd, watches[fd].data);
+    }
+
+    return count;
+}
+
+
+/**
+ * Returns the signal mask children of the shell start with
+ *
+ * @return signal mask for posix_spawn
+ */
+sigset_t *eventloop_child_mask() {
+    save_child_mask();
+    return &child_mask;
+}
+
+
+/**
+ * Leaves the loop in a forked child, the signals the loop blocked are unblocked and the
+ * copy of the epoll instance is closed
+ */
+void eventloop_child() {
+    if (child_mask_saved) sigprocmask(SIG_SETMASK, &child_mask, NULL);
+
+    if (epoll_fd >= 0) close(epoll_fd);
+    epoll_fd = -1;
+}
+
+
+/**
+ * Counts the memory held by the table of watched file descriptors
+ *
+ * @param usage: counters to add to
+ */
+void eventloop_memory(struct mem_usage_t *usage) {
+    mem_count(usage, watches);
+}
+
+
+/**
+ * Closes the epoll instance and frees the table of watched file descriptors
+ */
+void eventloop_close() {
+    if (epoll_fd >= 0) close(epoll_fd);
+    epoll_fd = -1;
+
+    free(watches);
+    watches = NULL;
+    watches_capacity = 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file: eventloop.h
+ * @author: Michael Permyashkin
+ *
+ * @brief: Header file for the event loop the shell waits in
+ *
+ * Every file descriptor the shell waits on is watched by one epoll instance, the input
+ * being read, the capture pipes of background jobs, timers and signals delivered through a
+ * signalfd. Each watched file descriptor has a handler which the loop runs when it is
+ * readable, in the normal flow of the shell and never from a signal handler, so handlers
+ * may print, allocate and change the job lists.
+ */
+
+#include <signal.h>
+
+#include "memstat.h"
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+// function run when a watched file descriptor is readable, data is given when watching
+typedef void (*event_handler_t)(int fd, void *data);
+
+/**
+ * Creates the epoll instance of the loop. Calling it again once the loop exists does nothing.
+ *
+ * @return status of creating the loop
+ */
+int eventloop_init();
+
+/**
+ * Watches a file descriptor, the handler runs each time the loop finds it readable or
+ * closed by the other end. Watching a file descriptor again replaces its handler. Regular
+ * files can not be watched, they are always readable.
+ *
+ * @param fd: file descriptor to watch
+ * @param handler: function to run, NULL to only wake the loop
+ * @param data: passed to the handler
+ * @return status of watching the file descriptor
+ */
+int eventloop_watch(int fd, event_handler_t handler, void *data);
+
+/**
+ * Stops watching a file descriptor. Must be called before the file descriptor is closed,
+ * a forked copy of the shell may hold it open and keep it in the epoll instance otherwise.
+ * File descriptors that are not watched are ignored.
+ *
+ * @param fd: file descriptor to stop watching
+ */
+void eventloop_unwatch(int fd);
+
+/**
+ * Delivers a signal through a signalfd instead of a signal handler. The signal is blocked
+ * in the shell and unblocked again in every child it starts. The handler has to read the
+ * pending signals from the file descriptor.
+ *
+ * @param signal: signal to deliver
+ * @param handler: function to run when the signal is pending
+ * @param data: passed to the handler
+ * @return the signalfd, negative on error
+ */
+int eventloop_signal(int signal, event_handler_t handler, void *data);
+
+/**
+ * Starts a timer that expires after an interval and again every interval after. The loop
+ * reads the expirations before running the handler. Stop it with eventloop_unwatch and close.
+ *
+ * @param interval_ms: interval in milliseconds
+ * @param handler: function to run when the timer expired, NULL to only wake the loop
+ * @param data: passed to the handler
+ * @return the timerfd, negative on error
+ */
+int eventloop_timer(long interval_ms, event_handler_t handler, void *data);
+
+/**
+ * Waits until at least one watched file descriptor is readable and runs the handler of
+ * every one that is
+ *
+ * @param timeout_ms: longest time to wait in milliseconds, -1 to wait without a limit
+ * @return number of events handled, 0 on timeout or interruption, ERROR if there is no loop
+ */
+int eventloop_run_once(int timeout_ms);
+
+/**
+ * Returns the signal mask children of the shell start with, the mask the shell had before
+ * the loop blocked any signals
+ *
+ * @return signal mask for posix_spawn
+ */
+sigset_t *eventloop_child_mask();
+
+/**
+ * Leaves the loop in a forked child. The signals the loop blocked are unblocked and the
+ * child closes its copy of the epoll instance, which it shares with the shell, so nothing
+ * the child does changes what the shell watches.
+ */
+void eventloop_child();
+
+/**
+ * Counts the memory held by the table of watched file descriptors
+ *
+ * @param usage: counters to add to
+ */
+void eventloop_memory(struct mem_usage_t *usage);
+
+/**
+ * Closes the epoll instance and frees the table of watched file descriptors
+ */
+void eventloop_close();
+
+#endif
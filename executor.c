@@ -5,7 +5,8 @@
  * @brief: Executes an array of commands
  * 
  * Execution unit of the shell to execute all non-internal commands. Takes an array of commands
- * and handles pipelining of stdin and stdout channels if necessary. Additional error checking
+ * and handles pipelining of stdin and stdout channels if necessary. Builtin utilities run in
+ * the shell when alone and in a forked child when part of a pipeline. Additional error checking
  * is present to ensure that any channel is only redirected once (i.e. cannot redirect out to file
  * and also write to a pipe) - this is checked elsewhere in the shell but done again here prior
  * to execution of any command.
@@ -17,47 +18,59 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <dirent.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 
 #include "runner.h"
 #include "executor.h"
 #include "environ.h"
+#include "cmdhash.h"
+#include "builtins.h"
+#include "internal.h"
+#include "profile.h"
 #include "error.h"
+#include "joblimits.h"
+#include "eventloop.h"
+#include "background.h"
 
 
 // constants for pipe code readability
 #define READ_PIPE 0
 #define WRITE_PIPE 1
 
+// most commands a pipeline status is kept for
+#define MAX_PIPESTATUS 64
 
-/**
- * Resets stdin and stdout after command(s) execution to ensure
- * both are reset to default.
- * 
- * @param stdin_copy: default stdin 
- * @param stdout_copy: default stdout 
- * @return status of reset
- */ 
-int reset_stdin_stdout(int stdin_copy, int stdout_copy) {
-    int rc;
-    
-    // reset stdin
-    rc = dup2(stdin_copy, STDIN_FILENO);
-    if (rc < 0) return ERROR;
-    
-    // reset stdout
-    rc = dup2(stdout_copy, STDOUT_FILENO);
-    if (rc < 0) return ERROR;
-    
-    rc = close(stdin_copy);
-    if (rc < 0) return ERROR;
+// environment variable which selects how commands are launched
+#define SPAWN_BACKEND_VAR "SUSH_SPAWN"
 
-    rc = close(stdout_copy);
-    if (rc < 0) return ERROR;
+// environment variable holding the capacity of the pipes of a pipeline
+#define PIPE_SIZE_VAR "SUSH_PIPE_SIZE"
+
+// largest pipe capacity an unprivileged process may set
+#define PIPE_MAX_SIZE_FILE "/proc/sys/fs/pipe-max-size"
+
+// directory listing the open file descriptors of the shell
+#define FD_DIR "/proc/self/fd"
+
+// exit status reported for a command that could not be executed
+#define EXIT_NOT_EXECUTED 127
 
-    return true;
-}
+
+// exit status of each command in the most recent pipeline
+static int pipestatus[MAX_PIPESTATUS];
+static int num_pipestatus = 0;
+
+// pipe ends held for the stage of the pipeline the shell runs itself, -1 if none
+static int in_shell_fds[2] = { -1, -1 };
+
+// largest pipe capacity allowed, read on first use and -1 if unknown
+static long pipe_max_size = 0;
 
 
 /**
@@ -66,6 +79,8 @@ int reset_stdin_stdout(int stdin_copy, int stdout_copy) {
  * created if it does not exist or truncates the existing file. If appending, the file 
  * is created if it does not exist, or opens it for appending.
  * 
+ * The file is closed on exec, the command gets its own copy as stdout.
+ * 
  * @param fname: name of the file
  * @param redir_type: type of redirection out to be done 
  * @return fid will be positive if opened/created successully, otherwise negative
@@ -75,7 +90,7 @@ int create_out_file(char *fname, enum redirect_type_e redir_type) {
 
     // if create/overwrite
     if (redir_type == FILE_OUT_OVERWRITE) {
-        fid = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0777);
+        fid = open(fname, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0777);
         // error, unable to open file
         if (fid < 0) {
             LOG_ERROR(ERROR_EXEC_OUTFILE, strerror(errno));
@@ -83,7 +98,7 @@ int create_out_file(char *fname, enum redirect_type_e redir_type) {
     }
     // if append
     else if (redir_type == FILE_OUT_APPEND) {
-        fid = open(fname, O_RDWR | O_CREAT | O_APPEND, 0777);
+        fid = open(fname, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0777);
         // error, unable to open file
         if (fid < 0) {
             LOG_ERROR(ERROR_EXEC_APPEND, strerror(errno));
@@ -96,14 +111,15 @@ int create_out_file(char *fname, enum redirect_type_e redir_type) {
 
 /**
  * Opens file for redirection in. If the filename exists, the file is opened for
- * read and returns the file id. If the file does not 
+ * read and returns the file id. The file is closed on exec like
+ * files for redirection out.
  * 
  * @param fname: name of the file
  * @param redir_type: type of redirection out to be done 
  * @return fid will be positive if opened successully, otherwise negative
  */ 
 int open_in_file(char *fname) {
-    int fid = open(fname, O_RDONLY, 0777);
+    int fid = open(fname, O_RDONLY | O_CLOEXEC, 0777);
 
     // error, unable to open file
     if (fid < 0) {
@@ -146,6 +162,22 @@ int setup_command_redirection(struct command_t *command) {
 }
 
 
+/**
+ * Closes the redirection files of a command. Called once the command was started,
+ * or finished when it ran in the shell, so the shell holds no file of a command
+ * after launching it.
+ * 
+ * @param command: command whose redirection files are closed
+ */ 
+void close_command_redirection(struct command_t *command) {
+    if (command->fid_out > 0) close(command->fid_out);
+    if (command->fid_in > 0) close(command->fid_in);
+
+    command->fid_out = 0;
+    command->fid_in = 0;
+}
+
+
 /**
  * Sets stdin based on command information. Stdin will either be from a file
  * whose fid is stored in struct, a pipes read side, or the default
@@ -220,15 +252,31 @@ int set_stdin(struct command_t *command, int pipe_in) {
  * describes input and output destinations. After setup, the command is executed and
  * the function will only return if command execution fails.
  * 
+ * The child joins the process group of the pipeline before anything else so that the
+ * whole pipeline can be signalled and reaped as one unit.
+ * 
  * @param command: command struct holding information about commands execution config
  * @param pipe_in: read side of the pipe used if given command proceeds another
  * @param pipe_out: write side of the pipe used if given command preceeds another
+ * @param pipe_next: read side of this commands output pipe which only the next command uses
+ * @param pgid: process group of the pipeline, 0 if this command is the group leader
+ * @param path: resolved path of the executable
  * @param envp: environement for command execution
  * @return will only return if exec fails
  **/ 
-int do_child(struct command_t *command, int pipe_in, int pipe_out, char *const envp[]) {
+int do_child(struct command_t *command, int pipe_in, int pipe_out, int pipe_next, pid_t pgid, char *path, char *const envp[]) {
     int rc;
 
+    // the command starts with the signals the shell blocked for its event loop unblocked
+    eventloop_child();
+
+    // join the pipelines process group
+    setpgid(0, pgid);
+
+    // the read end of our own output pipe belongs to the next command. Holding it open
+    // would keep the pipe alive after the reader exits and we would never see SIGPIPE
+    if (pipe_next >= 0) close(pipe_next);
+
     // set stdout channel
     rc = set_stdout(command, pipe_out);
     if (rc < 0) return ERROR;
@@ -237,92 +285,585 @@ int do_child(struct command_t *command, int pipe_in, int pipe_out, char *const e
     rc = set_stdin(command, pipe_in);
     if (rc < 0) return ERROR;
 
+    // a queued job runs with the cpus, priority and memory it was given
+    if (command->limits != NULL && joblimits_apply(command->limits) < 0) exit(EXIT_NOT_EXECUTED);
+
     // execute command
-    execvpe(command->cmd_name, command->tokens, envp);
+    execve(path, command->tokens, envp);
 
     // if exec returns, something went wrong
     LOG_ERROR(ERROR_EXEC_FAILED, strerror(errno));
-    exit(ERROR);
+    exit(EXIT_NOT_EXECUTED);
 }
 
 
 /**
- * The parent process waits for the child to finish
+ * Forks the process and the child executes the command. The parent does not wait for
+ * the child, it records the pid in the command struct and returns immediately so the 
+ * next command of the pipeline can be started while this one runs.
  * 
- * @param pid: id of the child process
- **/ 
-void do_parent(int pid) {
-    int status;
-    waitpid(pid, &status, 0);
+ * @param command: command struct holding information about commands execution config
+ * @param pipe_in: read side of the pipe used if given command proceeds another
+ * @param pipe_out: write side of the pipe used if given command preceeds another
+ * @param pipe_next: read side of this commands output pipe which only the next command uses
+ * @param pgid: process group of the pipeline, 0 if this command is the group leader
+ * @param path: resolved path of the executable
+ * @param envp: environement for command execution
+ * @return status of fork
+ */ 
+int fork_and_exec(struct command_t *command, int pipe_in, int pipe_out, int pipe_next, pid_t pgid, char *path, char *const envp[]) {
+    pid_t pid = fork();
+    
+    // check fork() return to ensure it is a valid pid, otherwise an error occured
+    if (pid < 0) {
+        return ERROR;
+    } 
+    // child executes command
+    else if (pid == 0) {
+        do_child(command, pipe_in, pipe_out, pipe_next, pgid, path, envp);
+        exit(ERROR);
+    } 
+
+    // parent also sets the group so it is in place no matter which process runs first
+    setpgid(pid, (pgid == 0) ? pid : pgid);
+    command->pid = pid;
+
+    return SUCCESS;
 }
 
 
 /**
- * Forks the process and calls functions to handle child and parent processes respectively.
+ * Runs an internal command or builtin in the current process. Builtins write straight
+ * to stdout, internal commands print through stdio which is flushed before returning.
+ * 
+ * @param command: command to run
+ * @param builtin: builtin that runs the command, NULL for an internal command
+ * @return exit status of the command
+ */ 
+int run_shell_command(struct command_t *command, struct builtin_t *builtin) {
+    if (builtin != NULL) return builtin->handler(command, STDOUT_FILENO);
+
+    int rc = execute_internal_command(command);
+    fflush(stdout);
+    return (rc < 0) ? 1 : 0;
+}
+
+
+/**
+ * Forks the process and the child runs an internal command or builtin as a stage of a
+ * pipeline. The child sets up stdin and stdout like a child that execs, runs the command 
+ * and exits with its status. Like fork_and_exec the parent does not wait for the child.
  * 
  * @param command: command struct holding information about commands execution config
+ * @param builtin: builtin that runs the command, NULL for an internal command
  * @param pipe_in: read side of the pipe used if given command proceeds another
  * @param pipe_out: write side of the pipe used if given command preceeds another
- * @param envp: environement for command execution
- * @return status of command execution
+ * @param pipe_next: read side of this commands output pipe which only the next command uses
+ * @param pgid: process group of the pipeline, 0 if this command is the group leader
+ * @return status of fork
  */ 
-int fork_and_exec(struct command_t *command, int pipe_in, int pipe_out, char *const envp[]) {
+int fork_and_run_shell_command(struct command_t *command, struct builtin_t *builtin, int pipe_in, int pipe_out, int pipe_next, pid_t pgid) {
+    // anything the shell printed must come out before the commands output
+    fflush(stdout);
+
     pid_t pid = fork();
     
-    // check fork() return to ensure it is a valid pid, otherwise an error occured
     if (pid < 0) {
-        return false;
+        return ERROR;
     } 
-    // child executes command
+    // child runs the command, exiting without running the shells exit handlers
     else if (pid == 0) {
-        do_child(command, pipe_in, pipe_out, envp);
+        eventloop_child();
+        setpgid(0, pgid);
+        if (pipe_next >= 0) close(pipe_next);
+
+        // pipe ends the shell keeps for the stage it runs itself are not ours
+        for (int i = 0; i < 2; i++) {
+            if (in_shell_fds[i] >= 0) close(in_shell_fds[i]);
+        }
+
+        if (set_stdout(command, pipe_out) < 0 || set_stdin(command, pipe_in) < 0) 
+            _exit(EXIT_NOT_EXECUTED);
+        if (command->limits != NULL && joblimits_apply(command->limits) < 0)
+            _exit(EXIT_NOT_EXECUTED);
+
+        _exit(run_shell_command(command, builtin));
     } 
-    // parent waits for child to finish
-    else {
-        do_parent(pid);
+
+    setpgid(pid, (pgid == 0) ? pid : pgid);
+    command->pid = pid;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Adds the file actions that give the spawned command the same stdin and stdout that
+ * set_stdin and set_stdout setup in a forked child.
+ * 
+ * @param actions: file actions to add to
+ * @param command: command struct holding information about commands execution config
+ * @param pipe_in: read side of the pipe used if given command proceeds another
+ * @param pipe_out: write side of the pipe used if given command preceeds another
+ * @param pipe_next: read side of this commands output pipe which only the next command uses
+ * @return status of adding the file actions
+ */ 
+int add_spawn_file_actions(posix_spawn_file_actions_t *actions, struct command_t *command, int pipe_in, int pipe_out, int pipe_next) {
+    int rc = 0;
+
+    // read end of our output pipe belongs to the next command
+    if (pipe_next >= 0) 
+        rc |= posix_spawn_file_actions_addclose(actions, pipe_next);
+
+    // writing to file or pipe, else keep default
+    if (command->file_out) 
+        rc |= posix_spawn_file_actions_adddup2(actions, command->fid_out, STDOUT_FILENO);
+    else if (command->pipe_out) 
+        rc |= posix_spawn_file_actions_adddup2(actions, pipe_out, STDOUT_FILENO);
+
+    // reading from file or pipe, else keep default
+    if (command->file_in) 
+        rc |= posix_spawn_file_actions_adddup2(actions, command->fid_in, STDIN_FILENO);
+    else if (command->pipe_in) 
+        rc |= posix_spawn_file_actions_adddup2(actions, pipe_in, STDIN_FILENO);
+
+    return (rc == 0) ? SUCCESS : ERROR;
+}
+
+
+/**
+ * Launches the command with posix_spawn. The child shares the address space of the shell
+ * until it execs, so no page tables are copied no matter how large the shell has grown.
+ * Redirections and pipe ends are applied through spawn file actions and the process group
+ * through spawn attributes. Like fork_and_exec the parent does not wait for the child.
+ * 
+ * @param command: command struct holding information about commands execution config
+ * @param pipe_in: read side of the pipe used if given command proceeds another
+ * @param pipe_out: write side of the pipe used if given command preceeds another
+ * @param pipe_next: read side of this commands output pipe which only the next command uses
+ * @param pgid: process group of the pipeline, 0 if this command is the group leader
+ * @param path: resolved path of the executable
+ * @param envp: environement for command execution
+ * @return 0 if the command was started, otherwise the error number of the failure
+ */ 
+int spawn_and_exec(struct command_t *command, int pipe_in, int pipe_out, int pipe_next, pid_t pgid, char *path, char *const envp[]) {
+    int rc;
+    pid_t pid;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+
+    // describe the stdin/stdout setup of the child
+    posix_spawn_file_actions_init(&actions);
+    rc = add_spawn_file_actions(&actions, command, pipe_in, pipe_out, pipe_next);
+    if (rc < 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return EINVAL;
     }
 
+    // child joins the process group of the pipeline, without the signals the shell blocked
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setsigmask(&attr, eventloop_child_mask());
+
+    rc = posix_spawn(&pid, path, &actions, &attr, command->tokens, envp);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (rc == 0) command->pid = pid;
+
+    return rc;
+}
+
+
+/**
+ * Marks a command as finished without running. The exit status is set to 127 like other 
+ * shells and the rest of the pipeline still runs.
+ * 
+ * @param command: command that could not be executed
+ * @param error: error number describing why
+ */ 
+void set_not_executed(struct command_t *command, int error) {
+    LOG_ERROR(ERROR_EXEC_FAILED, strerror(error));
+    command->pid = 0;
+    command->exit_status = EXIT_NOT_EXECUTED;
+}
+
+
+/**
+ * Checks which backend launches commands. Commands are spawned unless the SUSH_SPAWN
+ * environment variable is set to `fork`.
+ * 
+ * @return true if commands should be launched with fork
+ */ 
+bool use_fork_backend() {
+    struct environ_var_t *backend = environ_get_var(SPAWN_BACKEND_VAR);
+    return backend != NULL && strcmp(backend->value, "fork") == 0;
+}
+
+
+/**
+ * Launches a command whose redirection files are open with the selected backend.
+ * 
+ * @param command: command struct holding information about commands execution config
+ * @param pipe_in: read side of the pipe used if given command proceeds another
+ * @param pipe_out: write side of the pipe used if given command preceeds another
+ * @param pipe_next: read side of this commands output pipe which only the next command uses
+ * @param pgid: process group of the pipeline, 0 if this command is the group leader
+ * @param envp: environement for command execution
+ * @param setup_start: time the setup of the command started
+ * @return status of command execution
+ */ 
+int launch_command(struct command_t *command, int pipe_in, int pipe_out, int pipe_next, pid_t pgid, char *const envp[], double setup_start) {
+    int rc;
+
+    // internal commands and builtins run in a copy of the shell instead of an executable
+    struct builtin_t *builtin = builtin_find(command);
+    if (builtin != NULL || is_internal_command(command)) {
+        command->start_time = profile_now();
+        command->setup_time = command->start_time - setup_start;
+        rc = fork_and_run_shell_command(command, builtin, pipe_in, pipe_out, pipe_next, pgid);
+        command->launch_time = profile_now() - command->start_time;
+        return rc;
+    }
+
+    // resolve the executable in the shell so the remembered path is exec'd directly
+    char *path = cmdhash_lookup(command->cmd_name);
+    if (path == NULL) {
+        set_not_executed(command, ENOENT);
+        return SUCCESS;
+    }
+
+    // time spent starting the process is measured apart from the setup
+    command->start_time = profile_now();
+    command->setup_time = command->start_time - setup_start;
+
+    // posix_spawn can not set affinity, priority or limits, a limited job sets them after fork
+    if (use_fork_backend() || command->limits != NULL) {
+        rc = fork_and_exec(command, pipe_in, pipe_out, pipe_next, pgid, path, envp);
+        command->launch_time = profile_now() - command->start_time;
+        return rc;
+    }
+
+    rc = spawn_and_exec(command, pipe_in, pipe_out, pipe_next, pgid, path, envp);
+
+    // remembered path no longer exists, search PATH again
+    if (rc == ENOENT && path != command->cmd_name) {
+        cmdhash_remove(command->cmd_name);
+        path = cmdhash_lookup(command->cmd_name);
+        if (path != NULL) rc = spawn_and_exec(command, pipe_in, pipe_out, pipe_next, pgid, path, envp);
+    }
+
+    if (rc != 0) set_not_executed(command, rc);
+    command->launch_time = profile_now() - command->start_time;
+
     return SUCCESS;
 }
 
 
 /**
- * Each command uses this function to first setup all redirection files, forks and
- * executes the command given.
+ * Each command uses this function to first setup all redirection files, then launches
+ * the command with the selected backend. The redirection files are closed again once
+ * the command started, the command has its own copies.
  * 
  * @param command: command struct holding information about commands execution config
  * @param pipe_in: read side of the pipe used if given command proceeds another
  * @param pipe_out: write side of the pipe used if given command preceeds another
+ * @param pipe_next: read side of this commands output pipe which only the next command uses
+ * @param pgid: process group of the pipeline, 0 if this command is the group leader
  * @param envp: environement for command execution
  * @return status of setup and command execution
  */ 
-int setup_and_execute_command(struct command_t *command, int pipe_in, int pipe_out, char *const envp[]) {
-    int rc;
+int setup_and_execute_command(struct command_t *command, int pipe_in, int pipe_out, int pipe_next, pid_t pgid, char *const envp[]) {
+    double setup_start = profile_now();
 
     // creates/opens any files to be used for command redirection
-    rc = setup_command_redirection(command);
-    if (rc < 0) return ERROR;
+    int rc = setup_command_redirection(command);
+    if (rc >= 0) rc = launch_command(command, pipe_in, pipe_out, pipe_next, pgid, envp, setup_start);
 
-    rc = fork_and_exec(command, pipe_in, pipe_out, envp);
-    if (rc < 0) return ERROR;
+    close_command_redirection(command);
+    return rc;
+}
 
-    return SUCCESS;
+
+/**
+ * Converts a status returned by waitpid to a shell exit status. Commands killed by
+ * a signal report 128 plus the signal number like other shells do.
+ * 
+ * @param status: status filled in by waitpid
+ * @return exit status of the command
+ */ 
+int wait_status_to_exit_status(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 0;
 }
 
 
 /**
- * Cleans up memory allocated to environment array used for execution.
- * Frees each element of the array and finishes by freeing the array memory
+ * Gives the terminal to the pipelines process group so the commands can read from it
+ * and receive keyboard signals. Only done when the shell itself owns the terminal.
  * 
- * @param envp: environement array to free
+ * @param pgid: process group of the pipeline
+ * @return true if the terminal was handed over and needs to be reclaimed
  */ 
-void executor_cleanup(char **envp) {
-    int i = 0;
-    while (envp[i] != NULL) {
-        free(envp[i]);
-        i++;
+bool give_terminal(pid_t pgid) {
+    if (!isatty(STDIN_FILENO) || tcgetpgrp(STDIN_FILENO) != getpgrp()) return false;
+
+    return tcsetpgrp(STDIN_FILENO, pgid) == 0;
+}
+
+
+/**
+ * Takes the terminal back after the pipeline finished. SIGTTOU is ignored while doing
+ * so because the shell is in a background process group at that moment.
+ */ 
+void reclaim_terminal() {
+    void (*prev_handler)(int) = signal(SIGTTOU, SIG_IGN);
+    tcsetpgrp(STDIN_FILENO, getpgrp());
+    signal(SIGTTOU, prev_handler);
+}
+
+
+/**
+ * Waits for every command of the pipeline to finish. All commands share one process group
+ * so the group is reaped as a whole, in whatever order the commands exit. The exit status,
+ * the time it was reaped and the resources used by each command are stored in its command
+ * struct and the status of the last command is remembered as the status of the pipeline.
+ * Background jobs that finish while the pipeline runs are reaped and the next queued jobs
+ * started without waiting for the pipeline.
+ * 
+ * @param commands_arr: array of command structs that were started
+ * @param num_started: number of commands that were started
+ * @param pgid: process group of the pipeline
+ */ 
+void wait_for_pipeline(struct command_t *commands_arr[], int num_started, pid_t pgid) {
+    int status;
+    int remaining = 0;
+    struct rusage usage;
+
+    // commands that could not be executed have no process to wait for
+    for (int i=0; i<num_started; i++) {
+        if (commands_arr[i]->pid > 0) remaining++;
+    }
+
+    // the shell waits in the event loop so background jobs are reaped and started meanwhile,
+    // without a loop delivering SIGCHLD it blocks in wait4
+    bool in_loop = true;
+
+    while (remaining > 0) {
+        pid_t pid = wait4(-pgid, &status, in_loop ? WNOHANG : 0, &usage);
+        if (pid == 0) {
+            if (background_wait_child() < 0) in_loop = false;
+            continue;
+        }
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // find the command that exited and store its status
+        for (int i=0; i<num_started; i++) {
+            if (commands_arr[i]->pid == pid) {
+                commands_arr[i]->exit_status = wait_status_to_exit_status(status);
+                commands_arr[i]->end_time = profile_now();
+                commands_arr[i]->usage = usage;
+                remaining--;
+                break;
+            }
+        }
+    }
+
+    // remember the status of each command, the last one is the status of the pipeline
+    num_pipestatus = (num_started < MAX_PIPESTATUS) ? num_started : MAX_PIPESTATUS;
+    for (int i=0; i<num_pipestatus; i++) {
+        pipestatus[i] = commands_arr[num_started - num_pipestatus + i]->exit_status;
+    }
+}
+
+
+/**
+ * Checks if a command can run in the shell without a new process
+ * 
+ * @param command: command to check
+ * @return true if the command is an internal command or an enabled builtin
+ */ 
+bool is_shell_command(struct command_t *command) {
+    return is_internal_command(command) || builtin_find(command) != NULL;
+}
+
+
+/**
+ * Points a standard stream at another file descriptor while a command runs in the shell.
+ * 
+ * @param fd: file descriptor to use, the stream is kept if it is the stream itself
+ * @param stream: STDIN_FILENO or STDOUT_FILENO
+ * @return copy of the stream to restore it with, -1 if the stream was kept
+ */ 
+int swap_stream(int fd, int stream) {
+    if (fd == stream) return -1;
+
+    int saved = fcntl(stream, F_DUPFD_CLOEXEC, 0);
+    dup2(fd, stream);
+    return saved;
+}
+
+
+/**
+ * Restores a standard stream swapped by swap_stream
+ * 
+ * @param saved: copy returned by swap_stream
+ * @param stream: STDIN_FILENO or STDOUT_FILENO
+ */ 
+void restore_stream(int saved, int stream) {
+    if (saved < 0) return;
+
+    dup2(saved, stream);
+    close(saved);
+}
+
+
+/**
+ * Runs an internal command or builtin in the shell itself. Input and output come from the
+ * redirection files if there are any, otherwise from the given pipe ends. Builtins are handed
+ * the output file descriptor, internal commands print through stdio so stdin and stdout are
+ * swapped while they run. Redirection files are closed once the command finished.
+ * 
+ * Writing to a pipe of the pipeline whose reader is gone fails instead of raising SIGPIPE,
+ * which would terminate the shell. The resources the shell used while the command ran
+ * become the usage of the command.
+ * 
+ * @param command: command struct holding information about commands execution config
+ * @param pipe_in: read side of the pipe to read from, -1 to keep stdin
+ * @param pipe_out: write side of the pipe to write to, -1 to keep stdout
+ * @return return code of the internal command, or status of the redirection setup
+ */ 
+int run_in_shell(struct command_t *command, int pipe_in, int pipe_out) {
+    int rc = SUCCESS;
+    struct rusage start_usage;
+    getrusage(RUSAGE_SELF, &start_usage);
+    command->start_time = profile_now();
+
+    // creates/opens any files to be used for command redirection
+    if (setup_command_redirection(command) < 0) {
+        close_command_redirection(command);
+        command->exit_status = 1;
+        return ERROR;
     }
-    free(envp);
+    command->setup_time = profile_now() - command->start_time;
+
+    int in_fd = command->file_in ? command->fid_in : (pipe_in >= 0) ? pipe_in : STDIN_FILENO;
+    int out_fd = command->file_out ? command->fid_out : (pipe_out >= 0) ? pipe_out : STDOUT_FILENO;
+    bool to_pipe = (out_fd == pipe_out);
+    void (*prev_handler)(int) = to_pipe ? signal(SIGPIPE, SIG_IGN) : SIG_DFL;
+
+    // anything the shell printed must come out before the commands output
+    fflush(stdout);
+
+    struct builtin_t *builtin = builtin_find(command);
+    if (builtin != NULL) {
+        command->exit_status = builtin->handler(command, out_fd);
+    } else {
+        int saved_in = swap_stream(in_fd, STDIN_FILENO);
+        int saved_out = swap_stream(out_fd, STDOUT_FILENO);
+
+        rc = execute_internal_command(command);
+        command->exit_status = (rc < 0) ? 1 : 0;
+
+        fflush(stdout);
+        clearerr(stdout);
+        restore_stream(saved_out, STDOUT_FILENO);
+        restore_stream(saved_in, STDIN_FILENO);
+    }
+
+    if (to_pipe) signal(SIGPIPE, prev_handler);
+    command->end_time = profile_now();
+
+    // no process was reaped for it, the command used what the shell used meanwhile
+    getrusage(RUSAGE_SELF, &command->usage);
+    timersub(&command->usage.ru_utime, &start_usage.ru_utime, &command->usage.ru_utime);
+    timersub(&command->usage.ru_stime, &start_usage.ru_stime, &command->usage.ru_stime);
+
+    close_command_redirection(command);
+
+    return rc;
+}
+
+
+/**
+ * Runs an internal command or builtin that is the whole command line in the shell, with
+ * any redirection applied. Its exit status becomes the status of the pipeline.
+ * 
+ * @param command: command to run
+ * @return return code of the internal command, or status of the redirection setup
+ */ 
+int execute_shell_command(struct command_t *command) {
+    int rc = run_in_shell(command, -1, -1);
+
+    pipestatus[0] = command->exit_status;
+    num_pipestatus = 1;
+
+    return rc;
+}
+
+
+/**
+ * Returns the capacity pipes of a pipeline get unless the pipeline gives a size, read
+ * from SUSH_PIPE_SIZE. Invalid values leave the kernel default.
+ * 
+ * @return capacity in bytes, 0 for the kernel default
+ */ 
+long get_default_pipe_size() {
+    struct environ_var_t *size_var = environ_get_var(PIPE_SIZE_VAR);
+    if (size_var == NULL) return 0;
+
+    long size = parse_size(size_var->value);
+    return (size > 0) ? size : 0;
+}
+
+
+/**
+ * Returns the largest capacity an unprivileged process may give a pipe. The limit
+ * is read once from /proc/sys/fs/pipe-max-size.
+ * 
+ * @return capacity in bytes, -1 if the limit is unknown
+ */ 
+long get_pipe_max_size() {
+    if (pipe_max_size != 0) return pipe_max_size;
+
+    pipe_max_size = -1;
+    int fd = open(PIPE_MAX_SIZE_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return pipe_max_size;
+
+    char buffer[32];
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length > 0) {
+        buffer[length] = '\0';
+        long size = strtol(buffer, NULL, 10);
+        if (size > 0) pipe_max_size = size;
+    }
+    return pipe_max_size;
+}
+
+
+/**
+ * Sets the capacity of a pipe. A size over the limit for unprivileged processes falls
+ * back to the largest allowed size, if the pipe can not be resized it keeps the default.
+ * 
+ * @param fd: either end of the pipe
+ * @param size: capacity in bytes, 0 to keep the default
+ */ 
+void set_pipe_size(int fd, long size) {
+    if (size <= 0) return;
+    if (size > INT_MAX) size = INT_MAX;
+
+    if (fcntl(fd, F_SETPIPE_SZ, (int) size) >= 0) return;
+
+    long max_size = get_pipe_max_size();
+    if (errno == EPERM && max_size > 0 && max_size < size) 
+        fcntl(fd, F_SETPIPE_SZ, (int) max_size);
 }
 
 
@@ -334,7 +875,15 @@ void executor_cleanup(char **envp) {
  * 
  * The function expects an array of command_t structs (defined in runner.h) and the number
  * of commands being executed. Consecutive commmands are pipelined together and each command
- * structure should hold values that reflect the pipelining behavior.
+ * structure should hold values that reflect the pipelining behavior. Every command of the 
+ * pipeline is started before any is waited on, so all commands run concurrently in one 
+ * process group.
+ * 
+ * Each pipe gets the size given after its | in the command line, or SUSH_PIPE_SIZE.
+ * 
+ * Internal commands and builtins take part in the pipeline. The last of them runs in the shell
+ * once every other stage was started, so whatever it writes to or reads from is already running.
+ * Any others run in a forked copy of the shell.
  * 
  * @param commands_arr: array of command structs to execute
  * @param num_commands: the number of commands to execute
@@ -342,45 +891,179 @@ void executor_cleanup(char **envp) {
  */ 
 int execute_external_command(struct command_t *commands_arr[], int num_commands) {
 
-    // store default stdin and stdout to reset after all execution
-    int stdin_copy = dup(STDIN_FILENO);
-    int stdout_copy = dup(STDOUT_FILENO);
+    // a builtin on its own needs no new process
+    if (num_commands == 1 && is_shell_command(commands_arr[0])) {
+        execute_shell_command(commands_arr[0]);
+        return SUCCESS;
+    }
+
+    // last stage the shell can run itself
+    int in_shell = -1;
+    for (int j = num_commands - 1; j >= 0 && in_shell < 0; j--) {
+        if (is_shell_command(commands_arr[j])) in_shell = j;
+    }
 
-    // build evnp for commands execution
+    // snapshot of the environment for commands execution
     char **envp = make_environ();
     
-    int i, rc;
-    pid_t pid;
+    int i, rc = SUCCESS;
+    pid_t pgid = 0;
 
-    // create pipes
+    // pipe ends, -1 when there is no pipe
     int pipes_fd[2];
-    int pipe_in = 0;
+    int pipe_in = -1;
+    long default_pipe_size = get_default_pipe_size();
 
-    // fork and execute each command
+    // fork every command first so all commands of the pipeline run at the same time
     for (i=0; i<num_commands; i++) {
-        // create pipe
-        rc = pipe(pipes_fd);
-        if (rc < 0) return ERROR;
+        // only a command followed by another one writes to a pipe
+        bool piped = (i < num_commands - 1);
+        pipes_fd[READ_PIPE] = pipes_fd[WRITE_PIPE] = -1;
+
+        // create pipe, only the commands an end is given to may keep it after exec
+        if (piped) {
+            rc = pipe2(pipes_fd, O_CLOEXEC);
+            if (rc < 0) break;
+
+            long pipe_size = commands_arr[i]->pipe_size;
+            set_pipe_size(pipes_fd[WRITE_PIPE], (pipe_size > 0) ? pipe_size : default_pipe_size);
+        }
+
+        // shell keeps the pipe ends of the stage it runs itself until every other stage started
+        if (i == in_shell) {
+            in_shell_fds[0] = pipe_in;
+            in_shell_fds[1] = pipes_fd[WRITE_PIPE];
+            pipe_in = pipes_fd[READ_PIPE];
+            continue;
+        }
 
         // use command struct to setup commands stdout/stdin and execute
-        rc = setup_and_execute_command(commands_arr[i], pipe_in, pipes_fd[WRITE_PIPE], envp);
-        if (rc < 0) return ERROR;
+        rc = setup_and_execute_command(commands_arr[i], pipe_in, pipes_fd[WRITE_PIPE], pipes_fd[READ_PIPE], pgid, envp);
+
+        // the first command started leads the process group of the pipeline
+        if (rc > 0 && pgid == 0) pgid = commands_arr[i]->pid;
 
         // close writing end of pipe, the child will write to it if pipeing out is specified
-        rc = close(pipes_fd[WRITE_PIPE]);
-        if (rc < 0) return ERROR;
+        if (piped) close(pipes_fd[WRITE_PIPE]);
+
+        // the previous commands read end now belongs to the child only
+        if (pipe_in >= 0) close(pipe_in);
 
         // store the read end of the previous commands pipe. If another command follows
         // this becomes stdin of the next command
         pipe_in = pipes_fd[READ_PIPE];
+
+        if (rc < 0) break;
     }
 
-    // reset stdin and stdout to default
-    rc = reset_stdin_stdout(stdin_copy, stdout_copy);
-    if (rc < 0) return ERROR;
+    // nothing reads the output pipe of the last command started if the pipeline was cut short
+    if (pipe_in >= 0) close(pipe_in);
+
+    // a pipeline cut short fails even if the commands started before succeed
+    if (rc < 0) {
+        commands_arr[i]->exit_status = 1;
+        i++;
+    }
+
+    // the terminal goes to the other stages first so none of them is stopped for using it
+    double wait_start = profile_now();
+    bool has_terminal = (pgid != 0) && give_terminal(pgid);
+
+    // run the stage of the shell now that every command it reads from or writes to is running
+    if (in_shell >= 0 && rc >= 0) run_in_shell(commands_arr[in_shell], in_shell_fds[0], in_shell_fds[1]);
+    for (int j = 0; j < 2; j++) {
+        if (in_shell_fds[j] >= 0) close(in_shell_fds[j]);
+        in_shell_fds[j] = -1;
+    }
+
+    wait_for_pipeline(commands_arr, (rc < 0) ? i : num_commands, pgid);
+    if (has_terminal) reclaim_terminal();
+    profile_add(PROFILE_WAIT, wait_start);
 
-    // cleanup executor
-    executor_cleanup(envp);
+    return (rc < 0) ? ERROR : SUCCESS;
+}
+
+
+/**
+ * Returns the exit status of the last command of the most recent pipeline
+ * 
+ * @return exit status of the pipeline
+ */ 
+int executor_last_status() {
+    if (num_pipestatus == 0) return 0;
+    return pipestatus[num_pipestatus - 1];
+}
+
+
+/**
+ * Copies the exit status of every command of the most recent pipeline, like bash's PIPESTATUS
+ * 
+ * @param statuses: array to hold the exit statuses
+ * @param max: size of the given array
+ * @return number of statuses copied
+ */ 
+int executor_pipestatus(int *statuses, int max) {
+    int count = (num_pipestatus < max) ? num_pipestatus : max;
+    for (int i=0; i<count; i++) {
+        statuses[i] = pipestatus[i];
+    }
+    return count;
+}
+
+
+/**
+ * Launches a single command in the background. The command runs in its own process
+ * group and the function returns as soon as it is started, the caller is responsible
+ * for reaping the child.
+ * 
+ * @param command: command struct holding information about commands execution config
+ * @return pid of the started command, otherwise a negative value
+ */ 
+pid_t execute_background_command(struct command_t *command) {
+    int rc;
+
+    // snapshot of the environment for commands execution
+    char **envp = make_environ();
+
+    rc = setup_and_execute_command(command, -1, -1, -1, 0, envp);
+
+    if (rc < 0 || command->pid == 0) return ERROR;
+    return command->pid;
+}
+
+
+/**
+ * Prints every file descriptor the shell has open with what it refers to, marking those
+ * that are closed on exec. Anything past stdin, stdout and stderr that is not closed on
+ * exec is handed to every command the shell runs.
+ * 
+ * @return status of listing the file descriptors
+ */ 
+int executor_print_fds() {
+    DIR *dir = opendir(FD_DIR);
+    if (dir == NULL) {
+        LOG_ERROR(ERROR_FDS_LIST, strerror(errno));
+        return ERROR;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        // the directory being listed is not one of ours
+        int fd = atoi(entry->d_name);
+        if (fd == dirfd(dir)) continue;
+
+        char path[PATH_MAX];
+        char target[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%d", FD_DIR, fd);
+        ssize_t length = readlink(path, target, sizeof(target) - 1);
+        target[(length < 0) ? 0 : length] = '\0';
+
+        int flags = fcntl(fd, F_GETFD);
+        LOG_MSG(MSG_FDS_ENTRY, fd, target, (flags >= 0 && (flags & FD_CLOEXEC)) ? " cloexec" : "");
+    }
 
+    closedir(dir);
     return SUCCESS;
 }
@@ -9,6 +9,7 @@
  * internal commands.
  */ 
 #include <stddef.h>
+#include <sys/types.h>
 
 #include "runner.h"
 
@@ -23,7 +24,9 @@
  * 
  * The function expects an array of command_t structs (defined in runner.h) and the number
  * of commands being executed. Consecutive commmands are pipelined together and each command
- * structure should hold values that reflect the pipelining behavior.
+ * structure should hold values that reflect the pipelining behavior. Every command of the 
+ * pipeline is started before any is waited on, so all commands run concurrently in one 
+ * process group.
  * 
  * @param commands_arr: array of command structs to execute
  * @param num_commands: the number of commands to execute
@@ -31,4 +34,60 @@
  */ 
 int execute_external_command(struct command_t *commands_arr[], int num_commands);
 
+/**
+ * Runs an internal command or builtin that is the whole command line in the shell, with
+ * any redirection applied. Its exit status becomes the status of the pipeline.
+ * 
+ * @param command: command to run
+ * @return return code of the internal command, or status of the redirection setup
+ */ 
+int execute_shell_command(struct command_t *command);
+
+/**
+ * Launches a single command in the background. The command runs in its own process
+ * group and the function returns as soon as it is started, the caller is responsible
+ * for reaping the child.
+ * 
+ * Commands are started with posix_spawn, setting SUSH_SPAWN=fork in the environment
+ * selects the fork/exec backend instead.
+ * 
+ * @param command: command struct holding information about commands execution config
+ * @return pid of the started command, otherwise a negative value
+ */ 
+pid_t execute_background_command(struct command_t *command);
+
+/**
+ * Converts a status returned by waitpid to a shell exit status. Commands killed by
+ * a signal report 128 plus the signal number like other shells do.
+ * 
+ * @param status: status filled in by waitpid
+ * @return exit status of the command
+ */ 
+int wait_status_to_exit_status(int status);
+
+/**
+ * Returns the exit status of the last command of the most recent pipeline
+ * 
+ * @return exit status of the pipeline
+ */ 
+int executor_last_status();
+
+/**
+ * Copies the exit status of every command of the most recent pipeline, like bash's PIPESTATUS.
+ * The status of each command is also stored in its command struct.
+ * 
+ * @param statuses: array to hold the exit statuses
+ * @param max: size of the given array
+ * @return number of statuses copied
+ */ 
+int executor_pipestatus(int *statuses, int max);
+
+/**
+ * Prints every file descriptor the shell has open with what it refers to, marking those
+ * that are closed on exec. Used to check the shell does not leak file descriptors.
+ * 
+ * @return status of listing the file descriptors
+ */ 
+int executor_print_fds();
+
 #endif
\ No newline at end of file
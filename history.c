@@ -0,0 +1,488 @@
+/**
+ * @file: history.c
+ * @author: Andrew Kress
+ *
+ * @brief: Command line history kept in a shared log with an index
+ *
+ * Every line is appended to the log as a record with a single write to a file opened with
+ * O_APPEND, so shells sharing the log never take a lock to add a line and their records
+ * are never mixed together. The index file holds the offset of every record so entry N is
+ * found without reading the log, both files are mapped in to memory.
+ *
+ * Nothing is read when the history is opened. The first lookup brings the index up to date
+ * by reading only the records appended since it was last written, under a lock so shells
+ * sharing the index do not write it at the same time. An index that does not match its log
+ * is built again from the whole log.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "runner.h"
+#include "error.h"
+#include "history.h"
+
+// ending of the index file name
+#define INDEX_SUFFIX ".idx"
+
+// offsets found before the index is grown
+#define INITIAL_NEW_OFFSETS 256
+
+_Static_assert(sizeof(struct history_record_t) == 24, "history record layout changed");
+_Static_assert(sizeof(struct history_index_header_t) == 16, "history index layout changed");
+
+// log opened for appending, -1 when no history is kept
+static int log_fd = -1;
+static char *index_path = NULL;
+static int index_fd = -1;
+
+// log mapped up to the size it had when the index was last brought up to date
+static char *log_map = NULL;
+static size_t log_map_size = 0;
+
+// index mapped with the offset of every entry
+static char *index_map = NULL;
+static size_t index_map_size = 0;
+static uint64_t *offsets = NULL;
+static long num_entries = 0;
+
+
+/**
+ * Returns the FNV-1a hash of a line, stored with each record to find torn records
+ *
+ * @param line: line to hash
+ * @param length: length of the line
+ * @return hash of the line
+ */
+uint32_t history_checksum(const char *line, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) line[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/**
+ * Opens the history log for appending. The log is only read, and its index brought up
+ * to date, the first time an entry is looked up so opening a long history is cheap.
+ *
+ * @param path: history log, its index is the same path ending in .idx
+ * @return status of opening the log
+ */
+int history_open(char *path) {
+    if (log_fd >= 0) return SUCCESS;
+
+    log_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (log_fd < 0) return ERROR;
+
+    index_path = malloc(strlen(path) + sizeof(INDEX_SUFFIX));
+    strcpy(index_path, path);
+    strcat(index_path, INDEX_SUFFIX);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Appends a line to the history with a single write, which the kernel keeps whole when
+ * other shells append at the same time. Does nothing if no history is open.
+ *
+ * @param line: command line to add
+ */
+void history_add(char *line) {
+    size_t length = strlen(line);
+    if (log_fd < 0 || length == 0 || length > HISTORY_MAX_LINE) return;
+
+    struct history_record_t record = {
+        .magic = HISTORY_MAGIC,
+        .length = length,
+        .time = time(NULL),
+        .pid = getpid(),
+        .checksum = history_checksum(line, length)
+    };
+
+    // record and line go out together, a short write leaves a torn record that is skipped
+    struct iovec iov[2] = {
+        { .iov_base = &record, .iov_len = sizeof(record) },
+        { .iov_base = line, .iov_len = length }
+    };
+    while (writev(log_fd, iov, 2) < 0 && errno == EINTR);
+}
+
+
+/**
+ * Checks if a whole record that matches its checksum starts at an offset of the log
+ *
+ * @param offset: offset in the mapped log
+ * @param record: set to the record
+ * @return true if the record is whole and valid
+ */
+bool record_at(size_t offset, struct history_record_t *record) {
+    if (offset + sizeof(*record) > log_map_size) return false;
+    memcpy(record, log_map + offset, sizeof(*record));
+
+    return record->magic == HISTORY_MAGIC && record->length <= HISTORY_MAX_LINE &&
+           offset + sizeof(*record) + record->length <= log_map_size &&
+           record->checksum == history_checksum(log_map + offset + sizeof(*record), record->length);
+}
+
+
+/**
+ * Maps the log as large as it is now
+ *
+ * @return status of mapping the log
+ */
+int map_log() {
+    struct stat sfile;
+    if (fstat(log_fd, &sfile) < 0) return ERROR;
+    if ((size_t) sfile.st_size == log_map_size) return SUCCESS;
+
+    if (log_map != NULL) munmap(log_map, log_map_size);
+    log_map = NULL;
+    log_map_size = 0;
+    if (sfile.st_size == 0) return SUCCESS;
+
+    void *map = mmap(NULL, sfile.st_size, PROT_READ, MAP_SHARED, log_fd, 0);
+    if (map == MAP_FAILED) return ERROR;
+
+    log_map = map;
+    log_map_size = sfile.st_size;
+    return SUCCESS;
+}
+
+
+/**
+ * Reads the offset of an entry from the index file
+ *
+ * @param entry: entry number starting at 0
+ * @return offset of the record in the log
+ */
+uint64_t read_index_offset(long entry) {
+    uint64_t offset = UINT64_MAX;
+    pread(index_fd, &offset, sizeof(offset), sizeof(struct history_index_header_t) + entry * sizeof(offset));
+    return offset;
+}
+
+
+/**
+ * Returns the number of entries in the index file, 0 after emptying an index that does
+ * not belong to the log. Called with the index locked.
+ *
+ * @return number of entries in the index
+ */
+long check_index() {
+    struct history_index_header_t header;
+    struct history_record_t record;
+    struct stat sfile;
+
+    if (fstat(index_fd, &sfile) < 0) return 0;
+
+    long count = 0;
+    if ((size_t) sfile.st_size >= sizeof(header) && pread(index_fd, &header, sizeof(header), 0) == sizeof(header) &&
+        memcmp(header.magic, HISTORY_INDEX_MAGIC, sizeof(HISTORY_INDEX_MAGIC)) == 0 &&
+        header.version == HISTORY_INDEX_VERSION) {
+        count = (sfile.st_size - sizeof(header)) / sizeof(uint64_t);
+    }
+
+    // the first and last entry must still be records of the log
+    if (count > 0 && record_at(read_index_offset(0), &record) && record_at(read_index_offset(count - 1), &record))
+        return count;
+
+    // log was replaced or truncated, or the index is new
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HISTORY_INDEX_MAGIC, sizeof(HISTORY_INDEX_MAGIC));
+    header.version = HISTORY_INDEX_VERSION;
+    if (ftruncate(index_fd, 0) < 0 || pwrite(index_fd, &header, sizeof(header), 0) != sizeof(header)) return ERROR;
+    return 0;
+}
+
+
+/**
+ * Adds the records appended to the log since the index was last written to the index.
+ * Bytes that do not start a valid record are skipped one at a time until a record starts,
+ * a record still being written at the end of the log is left for the next time.
+ *
+ * @param count: number of entries in the index
+ * @return number of entries in the index after adding the new records
+ */
+long index_new_records(long count) {
+    struct history_record_t record;
+    size_t position = 0;
+
+    if (count > 0) {
+        size_t last = read_index_offset(count - 1);
+        record_at(last, &record);
+        position = last + sizeof(record) + record.length;
+    }
+
+    uint64_t *found = NULL;
+    size_t num_found = 0, capacity = 0;
+
+    while (position + sizeof(record) <= log_map_size) {
+        if (record_at(position, &record)) {
+            if (num_found == capacity) {
+                capacity = (capacity == 0) ? INITIAL_NEW_OFFSETS : capacity * 2;
+                found = realloc(found, capacity * sizeof(uint64_t));
+            }
+            found[num_found++] = position;
+            position += sizeof(record) + record.length;
+        }
+        // another shell is still writing the last record
+        else if (record.magic == HISTORY_MAGIC && record.length <= HISTORY_MAX_LINE &&
+                 position + sizeof(record) + record.length > log_map_size) {
+            break;
+        } else {
+            position++;
+        }
+    }
+
+    if (num_found > 0) {
+        off_t end = sizeof(struct history_index_header_t) + count * sizeof(uint64_t);
+        if (pwrite(index_fd, found, num_found * sizeof(uint64_t), end) == (ssize_t) (num_found * sizeof(uint64_t)))
+            count += num_found;
+    }
+
+    free(found);
+    return count;
+}
+
+
+/**
+ * Maps the index with the given number of entries
+ *
+ * @param count: number of entries
+ * @return status of mapping the index
+ */
+int map_index(long count) {
+    size_t size = sizeof(struct history_index_header_t) + count * sizeof(uint64_t);
+
+    if (index_map != NULL) munmap(index_map, index_map_size);
+    index_map = NULL;
+    offsets = NULL;
+    num_entries = 0;
+
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, index_fd, 0);
+    if (map == MAP_FAILED) return ERROR;
+
+    index_map = map;
+    index_map_size = size;
+    offsets = (uint64_t *) (index_map + sizeof(struct history_index_header_t));
+    num_entries = count;
+    return SUCCESS;
+}
+
+
+/**
+ * Brings the index up to date with the log, only records added since the last lookup
+ * are read
+ *
+ * @return status of reading the history
+ */
+int history_sync() {
+    struct stat sfile;
+    if (log_fd < 0 || fstat(log_fd, &sfile) < 0) return ERROR;
+
+    // nothing was appended since the last lookup
+    if (index_map != NULL && (size_t) sfile.st_size == log_map_size) return SUCCESS;
+
+    if (index_fd < 0) {
+        index_fd = open(index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (index_fd < 0) return ERROR;
+    }
+
+    // shells sharing the index take turns writing it. The log is mapped once the index is
+    // locked so every record the index already holds is in the mapping
+    if (flock(index_fd, LOCK_EX) < 0) return ERROR;
+    long count = (map_log() < 0) ? ERROR : check_index();
+    if (count >= 0) count = index_new_records(count);
+    flock(index_fd, LOCK_UN);
+
+    if (count < 0) return ERROR;
+    return map_index(count);
+}
+
+
+/**
+ * Returns the line of an entry
+ *
+ * @param entry: entry number starting at 1
+ * @param length: set to the length of the line
+ * @return line in the mapped log, not terminated
+ */
+char *history_line(long entry, uint32_t *length) {
+    struct history_record_t record;
+
+    memcpy(&record, log_map + offsets[entry - 1], sizeof(record));
+    *length = record.length;
+    return log_map + offsets[entry - 1] + sizeof(record);
+}
+
+
+/**
+ * Prints the last entries of the history with their numbers
+ *
+ * @param count: number of entries to print
+ * @return status of reading the history
+ */
+int history_print(long count) {
+    // the shell keeps no history, there is nothing to read
+    if (log_fd < 0) {
+        LOG_ERROR(ERROR_HISTORY_NONE);
+        return ERROR;
+    }
+
+    if (history_sync() < 0) {
+        LOG_ERROR(ERROR_HISTORY_READ, strerror(errno));
+        return ERROR;
+    }
+
+    long first = (count >= num_entries) ? 1 : num_entries - count + 1;
+    for (long entry = first; entry <= num_entries; entry++) {
+        uint32_t length;
+        char *line = history_line(entry, &length);
+        LOG_MSG(MSG_HISTORY_ENTRY, entry, (int) length, line);
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Finds the newest entry starting with a prefix, entries are checked from the newest
+ * so a recent match is found without looking at older entries
+ *
+ * @param prefix: start of the line to find
+ * @return entry number, 0 if no entry matched
+ */
+long history_search(char *prefix) {
+    size_t prefix_length = strlen(prefix);
+
+    for (long entry = num_entries; entry >= 1; entry--) {
+        uint32_t length;
+        char *line = history_line(entry, &length);
+        if (length >= prefix_length && memcmp(line, prefix, prefix_length) == 0) return entry;
+    }
+    return 0;
+}
+
+
+/**
+ * Prints the newest entry starting with a prefix
+ *
+ * @param prefix: start of the line to find
+ * @return status of the search, ERROR if no entry matched
+ */
+int history_print_search(char *prefix) {
+    // the shell keeps no history, there is nothing to read
+    if (log_fd < 0) {
+        LOG_ERROR(ERROR_HISTORY_NONE);
+        return ERROR;
+    }
+
+    if (history_sync() < 0) {
+        LOG_ERROR(ERROR_HISTORY_READ, strerror(errno));
+        return ERROR;
+    }
+
+    long entry = history_search(prefix);
+    if (entry == 0) return ERROR;
+
+    uint32_t length;
+    char *line = history_line(entry, &length);
+    LOG_MSG(MSG_HISTORY_ENTRY, entry, (int) length, line);
+    return SUCCESS;
+}
+
+
+/**
+ * Finds the entry an event such as !!, !N, !-N or !prefix recalls
+ *
+ * @param event: event without the leading !
+ * @return entry number, 0 if there is no such entry
+ */
+long find_event(char *event) {
+    if (strcmp(event, "!") == 0) return num_entries;
+
+    char *end;
+    long number = strtol(event, &end, 10);
+    if (end != event && *end == '\0') {
+        if (number < 0) number = num_entries + number + 1;
+        return (number >= 1 && number <= num_entries) ? number : 0;
+    }
+
+    return history_search(event);
+}
+
+
+/**
+ * Replaces a line starting with `!` with the entry it recalls. `!!` recalls the last
+ * entry, `!N` entry N, `!-N` the Nth last entry and `!prefix` the newest entry starting
+ * with prefix. The rest of the line after the first word is kept.
+ *
+ * @param line: command line to expand
+ * @param expanded: set to the expanded line, free with free, NULL if line recalls nothing
+ * @return SUCCESS, ERROR if the line recalls an entry that does not exist
+ */
+int history_expand(char *line, char **expanded) {
+    *expanded = NULL;
+
+    // a lone ! or one followed by a blank is an ordinary word
+    if (log_fd < 0 || line[0] != '!' || line[1] == '\0' || line[1] == ' ' || line[1] == '\t') return SUCCESS;
+
+    size_t word_length = strcspn(line, " \t");
+    char event[word_length];
+    memcpy(event, line + 1, word_length - 1);
+    event[word_length - 1] = '\0';
+
+    long entry = 0;
+    if (history_sync() == SUCCESS) entry = find_event(event);
+    if (entry == 0) {
+        LOG_ERROR(ERROR_HISTORY_EVENT, event);
+        return ERROR;
+    }
+
+    // recalled line followed by the rest of the line
+    uint32_t length;
+    char *recalled = history_line(entry, &length);
+    char *rest = line + word_length;
+    *expanded = malloc(length + strlen(rest) + 1);
+    memcpy(*expanded, recalled, length);
+    strcpy(*expanded + length, rest);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Unmaps and closes the history
+ */
+void history_close() {
+    if (log_map != NULL) munmap(log_map, log_map_size);
+    if (index_map != NULL) munmap(index_map, index_map_size);
+    log_map = NULL;
+    log_map_size = 0;
+    index_map = NULL;
+    index_map_size = 0;
+    offsets = NULL;
+    num_entries = 0;
+
+    if (log_fd >= 0) close(log_fd);
+    if (index_fd >= 0) close(index_fd);
+    log_fd = -1;
+    index_fd = -1;
+
+    free(index_path);
+    index_path = NULL;
+}
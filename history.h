@@ -0,0 +1,93 @@
+/**
+ * @file: history.h
+ * @author: Andrew Kress
+ *
+ * @brief: Header file for the command line history
+ *
+ * Defines the records of the history log and its index, and the functions to add lines,
+ * print and search them and recall a line with `!`. The log is shared by every shell that
+ * uses the same file, each shell appends to it without taking a lock.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+// marks the start of every record in the log
+#define HISTORY_MAGIC 0x52485553
+
+// longer lines are not kept in the history
+#define HISTORY_MAX_LINE 65536
+
+// identifies an index file of this layout
+#define HISTORY_INDEX_MAGIC "SUSHHIX"
+#define HISTORY_INDEX_VERSION 1
+
+// record in front of each line of the log, the line follows without a terminator
+struct history_record_t {
+    uint32_t magic;
+    uint32_t length;        // bytes of the line
+    int64_t time;           // seconds since the epoch the line ran at
+    int32_t pid;            // shell that ran the line
+    uint32_t checksum;      // FNV-1a of the line, a torn record does not match
+};
+
+// start of the index file, the offset of every record in the log follows in order
+struct history_index_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+/**
+ * Opens the history log for appending. The log is only read, and its index brought up
+ * to date, the first time an entry is looked up so opening a long history is cheap.
+ *
+ * @param path: history log, its index is the same path ending in .idx
+ * @return status of opening the log
+ */
+int history_open(char *path);
+
+/**
+ * Appends a line to the history with a single write, which the kernel keeps whole when
+ * other shells append at the same time. Does nothing if no history is open.
+ *
+ * @param line: command line to add
+ */
+void history_add(char *line);
+
+/**
+ * Prints the last entries of the history with their numbers
+ *
+ * @param count: number of entries to print
+ * @return status of reading the history
+ */
+int history_print(long count);
+
+/**
+ * Prints the newest entry starting with a prefix
+ *
+ * @param prefix: start of the line to find
+ * @return status of the search, ERROR if no entry matched
+ */
+int history_print_search(char *prefix);
+
+/**
+ * Replaces a line starting with `!` with the entry it recalls. `!!` recalls the last
+ * entry, `!N` entry N, `!-N` the Nth last entry and `!prefix` the newest entry starting
+ * with prefix. The rest of the line after the first word is kept.
+ *
+ * @param line: command line to expand
+ * @param expanded: set to the expanded line, free with free, NULL if line recalls nothing
+ * @return SUCCESS, ERROR if the line recalls an entry that does not exist
+ */
+int history_expand(char *line, char **expanded);
+
+/**
+ * Unmaps and closes the history
+ */
+void history_close();
+
+#endif
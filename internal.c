@@ -4,9 +4,10 @@
  * 
  * @brief: Handles and runs the internal shell commands.
  * 
- * When execute_internal_command is called, it loops through
- * the available commands and runs the handlers for the
- * corresponding command.
+ * When is_internal_command is called, the name is looked up
+ * in a perfect hash table of the available commands and the
+ * handler is stored on the command. execute_internal_command
+ * then runs the stored handler.
  */ 
 
 #include <stdbool.h>
@@ -15,17 +16,27 @@
 #include <dirent.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
 
 #include "runner.h"
 #include "internal.h"
 #include "error.h"
 #include "environ.h"
 #include "background.h"
+#include "cmdhash.h"
+#include "parsecache.h"
+#include "builtins.h"
+#include "perfhash.h"
+#include "executor.h"
+#include "memstat.h"
+#include "history.h"
 
 
 // argc offset set to 2 because tokens array include executable name and null
 #define ARGC_OFFSET 2
 
+// entries history prints without a count
+#define HISTORY_DEFAULT_COUNT 16
 
 // internal command struct holds name of command and handler when that command is called
 struct internal_command_t {
@@ -138,9 +149,9 @@ int handle_cd(struct command_t *cmd) {
     // chdir to the new directory.
     } else if (cmd->num_tokens - ARGC_OFFSET == 1) {
         chdir(cmd->tokens[1]);
-        char *cwd = malloc(1024);
-        getcwd(cwd, 1024);
-        environ_set_var("PWD", cwd);
+        // PWD keeps its own copy of the directory
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd)) != NULL) environ_set_var("PWD", cwd);
     } else {
         // Print error if there are two or more args.
         LOG_ERROR(ERROR_CD_ARG);
@@ -163,8 +174,8 @@ int handle_pwd(struct command_t *cmd) {
     // get cwd and print it.
     if (cmd->num_tokens - ARGC_OFFSET == 0) {
         // Get cwd.
-        char *cwd = malloc(1024);
-        getcwd(cwd, 1024);
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd)) == NULL) cwd[0] = '\0';
         // Print the current working directory.
         printf("%s\n", cwd);
     } else {
@@ -195,9 +206,76 @@ int handle_exit(struct command_t *cmd) {
 }
 
 
+/**
+ * Parses a comma separated list of job ids such as 2,3
+ * 
+ * @param list - The list to parse
+ * @param job_ids - Array the ids are stored in, holds QUEUE_MAX_AFTER ids
+ * 
+ * @return number of ids or ERROR if the list is not valid
+ */
+int parse_job_ids(char *list, int *job_ids) {
+    int num_ids = 0;
+    char *end = list;
+
+    do {
+        char *start = end + (num_ids > 0);
+        long id = strtol(start, &end, 10);
+
+        if (end == start || id < 0 || id > INT_MAX || num_ids == QUEUE_MAX_AFTER) return ERROR;
+        job_ids[num_ids++] = (int) id;
+    } while (*end == ',');
+
+    return *end == '\0' ? num_ids : ERROR;
+}
+
+
+/**
+ * Parses one option of the queue command and its value in to the queue options
+ * 
+ * @param option - The option such as --after or --cpus
+ * @param value - The value of the option
+ * @param options - The options to set
+ * 
+ * @return SUCCESS or ERROR if the option is not valid.
+ */
+int parse_queue_option(char *option, char *value, struct queue_options_t *options) {
+    if (strcmp(option, "--after") == 0) {
+        options->num_after = parse_job_ids(value, options->after);
+        if (options->num_after < 0) {
+            LOG_ERROR(ERROR_QUEUE_AFTER);
+            return ERROR;
+        }
+        if (!queue_jobs_exist(options->after, options->num_after)) return ERROR;
+    } else if (strcmp(option, "--cpus") == 0) {
+        if (joblimits_set_cpus(&options->limits, value) < 0) {
+            LOG_ERROR(ERROR_QUEUE_CPUS);
+            return ERROR;
+        }
+    } else if (strcmp(option, "--nice") == 0) {
+        if (joblimits_set_nice(&options->limits, value) < 0) {
+            LOG_ERROR(ERROR_QUEUE_NICE);
+            return ERROR;
+        }
+    } else if (strcmp(option, "--mem") == 0) {
+        if (joblimits_set_mem(&options->limits, value) < 0) {
+            LOG_ERROR(ERROR_QUEUE_MEM);
+            return ERROR;
+        }
+    } else {
+        LOG_ERROR(ERROR_QUEUE_OPTION, option);
+        return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+
 /**
  * Handles the queue command to add the given command to
- * the background job queue.
+ * the background job queue. With --after the command waits
+ * for the listed jobs to finish successfully, --cpus, --nice
+ * and --mem limit the resources the command runs with.
  * 
  * @param cmd - The command for arguments
  * 
@@ -205,32 +283,42 @@ int handle_exit(struct command_t *cmd) {
  */
 int handle_queue(struct command_t *cmd) {
     int rc;
+    struct queue_options_t options;
+
+    memset(&options, 0, sizeof(options));
+
+    // options and their values follow `queue`, the command starts at the first token after them
+    int first = 1;
+    while (cmd->num_tokens - ARGC_OFFSET > first && strncmp(cmd->tokens[first], "--", 2) == 0) {
+        if (parse_queue_option(cmd->tokens[first], cmd->tokens[first + 1], &options) < 0) return ERROR;
+        first += 2;
+    }
 
-    if (cmd->num_tokens - ARGC_OFFSET > 1) {
+    if (cmd->num_tokens - ARGC_OFFSET > first) {
 
         // checks that stdin and stdout are not being changed
         if (is_valid_background_command(cmd)) {
-            // free token `queue` from token array and cmd_name field
-            free(cmd->tokens[0]);
+            // remove the internal command `queue` and its options
+            for (int i = 0; i < first; i++) command_shift(cmd);
 
-            // remove first token which is the internal command `queue`
-            for(int i=1; i<cmd->num_tokens; i++) {
-                cmd->tokens[i-1] = cmd->tokens[i];
-            }
-
-            cmd->num_tokens = cmd->num_tokens-1;
-            cmd->cmd_name = cmd->tokens[0];
+            // job outlives the command line, copy it out of the parser arena
+            struct command_t *job = command_clone(cmd);
 
             // set background commands stdin and stdout
-            rc = set_command_channels(cmd);
-            if (rc < 0) return ERROR;
+            rc = set_command_channels(job);
+            if (rc < 0) {
+                free(job);
+                return ERROR;
+            }
 
-            add_to_queue(cmd);
+            add_to_queue(job, &options);
         } 
     } else {
         LOG_ERROR(ERROR_QUEUE_ARG);
         return ERROR;
     }
+
+    return SUCCESS;
 }
 
 
@@ -258,7 +346,8 @@ int handle_status(struct command_t *cmd) {
 
 /**
  * Handles the output command to get the output of
- * the requested background job.
+ * the requested background job, or only its first
+ * or last lines with --head K or --tail K.
  * 
  * @param cmd - The command for arguments
  * 
@@ -269,7 +358,18 @@ int handle_output(struct command_t *cmd) {
     // print the output of the requested job.
     if (cmd->num_tokens - ARGC_OFFSET == 1) {
         int job_id = atoi(cmd->tokens[1]);
-        print_output_and_remove(job_id);
+        print_output_and_remove(job_id, OUTPUT_ALL, 0);
+    // If the args are N --head K or N --tail K,
+    // print the first or last K lines of the output.
+    } else if (cmd->num_tokens - ARGC_OFFSET == 3 && 
+               (strcmp(cmd->tokens[2], "--head") == 0 || strcmp(cmd->tokens[2], "--tail") == 0)) {
+        int job_id = atoi(cmd->tokens[1]);
+        enum output_range_e range = (strcmp(cmd->tokens[2], "--head") == 0) ? OUTPUT_HEAD : OUTPUT_TAIL;
+        print_output_and_remove(job_id, range, atol(cmd->tokens[3]));
+    // If the args are --follow N,
+    // print the output of the job as it is written.
+    } else if (cmd->num_tokens - ARGC_OFFSET == 2 && strcmp(cmd->tokens[1], "--follow") == 0) {
+        follow_output(atoi(cmd->tokens[2]));
     } else {
         // Print error if there is one or more args
         LOG_ERROR(ERROR_OUTPUT_ARG);
@@ -279,6 +379,32 @@ int handle_output(struct command_t *cmd) {
 }
 
 
+/**
+ * Handles the wait command to block until the given
+ * background jobs, or all jobs without arguments, finished.
+ * 
+ * @param cmd - The command for arguments
+ * 
+ * @return SUCCESS or ERROR if the command fails or any of the jobs failed.
+ */
+int handle_wait(struct command_t *cmd) {
+    int num_ids = cmd->num_tokens - ARGC_OFFSET;
+    int job_ids[num_ids + 1];
+
+    for (int i = 0; i < num_ids; i++) {
+        char *end;
+        long id = strtol(cmd->tokens[i + 1], &end, 10);
+        if (end == cmd->tokens[i + 1] || *end != '\0' || id < 0 || id > INT_MAX) {
+            LOG_ERROR(ERROR_WAIT_ARG);
+            return ERROR;
+        }
+        job_ids[i] = (int) id;
+    }
+
+    return wait_for_jobs(job_ids, num_ids);
+}
+
+
 /**
  * Handles the cancel command to cancel a
  * background job.
@@ -302,6 +428,182 @@ int handle_cancel(struct command_t *cmd) {
 }
 
 
+/**
+ * Handles the jobs command to show how many background
+ * jobs run at the same time or change it with -j N.
+ * 
+ * @param cmd - The command for arguments
+ * 
+ * @return SUCCESS or ERROR if the command succeeds or fails.
+ */
+int handle_jobs(struct command_t *cmd) {
+    // If there aren't any args,
+    // print the number of running jobs and the limit.
+    if (cmd->num_tokens - ARGC_OFFSET == 0) {
+        print_jobs_limit();
+    // If the args are -j N, change the limit.
+    } else if (cmd->num_tokens - ARGC_OFFSET == 2 && strcmp(cmd->tokens[1], "-j") == 0 && atoi(cmd->tokens[2]) > 0) {
+        set_max_jobs(atoi(cmd->tokens[2]));
+    } else {
+        // Print error for any other args
+        LOG_ERROR(ERROR_JOBS_ARG);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Handles the hash command to show the remembered paths of
+ * commands or forget them with -r.
+ * 
+ * @param cmd - The command for arguments
+ * 
+ * @return SUCCESS or ERROR if the command succeeds or fails.
+ */
+int handle_hash(struct command_t *cmd) {
+    // If there aren't any args,
+    // print the remembered commands.
+    if (cmd->num_tokens - ARGC_OFFSET == 0) {
+        cmdhash_print();
+    // If the arg is -r, forget all commands.
+    } else if (cmd->num_tokens - ARGC_OFFSET == 1 && strcmp(cmd->tokens[1], "-r") == 0) {
+        cmdhash_clear();
+    } else {
+        // Print error for any other args
+        LOG_ERROR(ERROR_HASH_ARG);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Handles the stats command to show counters of the
+ * shells caches.
+ * 
+ * @param cmd - The command for arguments
+ * 
+ * @return SUCCESS or ERROR if the command succeeds or fails.
+ */
+int handle_stats(struct command_t *cmd) {
+    // If there aren't any args,
+    // print the counters.
+    if (cmd->num_tokens - ARGC_OFFSET == 0) {
+        parsecache_print_stats();
+    } else {
+        // Print error for any other args
+        LOG_ERROR(ERROR_STATS_ARG);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Handles the history command to print the last entries
+ * of the history, or the newest entry starting with a
+ * prefix with -s.
+ * 
+ * @param cmd - The command for arguments
+ * 
+ * @return SUCCESS or ERROR if the command succeeds or fails.
+ */
+int handle_history(struct command_t *cmd) {
+    // If there aren't any args,
+    // print the last few entries.
+    if (cmd->num_tokens - ARGC_OFFSET == 0) {
+        return history_print(HISTORY_DEFAULT_COUNT);
+    // If there is one number,
+    // print that many entries.
+    } else if (cmd->num_tokens - ARGC_OFFSET == 1 && atol(cmd->tokens[1]) > 0) {
+        return history_print(atol(cmd->tokens[1]));
+    // If the args are -s prefix,
+    // print the newest entry starting with it.
+    } else if (cmd->num_tokens - ARGC_OFFSET == 2 && strcmp(cmd->tokens[1], "-s") == 0) {
+        return history_print_search(cmd->tokens[2]);
+    }
+
+    // Print error for any other args
+    LOG_ERROR(ERROR_HISTORY_ARG);
+    return ERROR;
+}
+
+
+/**
+ * Handles the mem command to print the memory held by
+ * each part of the shell and by the shell as a whole.
+ * 
+ * @param cmd - The command for arguments
+ * 
+ * @return SUCCESS or ERROR if the command succeeds or fails.
+ */
+int handle_mem(struct command_t *cmd) {
+    // If there aren't any args,
+    // print the memory counters.
+    if (cmd->num_tokens - ARGC_OFFSET == 0) {
+        return memstat_print();
+    }
+
+    // Print error for any other args
+    LOG_ERROR(ERROR_MEM_ARG);
+    return ERROR;
+}
+
+
+/**
+ * Handles the fds command to list the file descriptors
+ * the shell has open.
+ * 
+ * @param cmd - The command for arguments
+ * 
+ * @return SUCCESS or ERROR if the command succeeds or fails.
+ */
+int handle_fds(struct command_t *cmd) {
+    // If there aren't any args,
+    // print the open file descriptors.
+    if (cmd->num_tokens - ARGC_OFFSET == 0) {
+        return executor_print_fds();
+    }
+
+    // Print error for any other args
+    LOG_ERROR(ERROR_FDS_ARG);
+    return ERROR;
+}
+
+
+/**
+ * Handles the enable command to switch builtin utilities
+ * on or off. With -n the executable in PATH is run instead.
+ * 
+ * @param cmd - The command for arguments
+ * 
+ * @return SUCCESS or ERROR if the command succeeds or fails.
+ */
+int handle_enable(struct command_t *cmd) {
+    // If there aren't any args,
+    // print the state of every builtin.
+    if (cmd->num_tokens - ARGC_OFFSET == 0) {
+        builtin_print();
+        return SUCCESS;
+    }
+
+    // -n disables the builtins that follow
+    bool enabled = strcmp(cmd->tokens[1], "-n") != 0;
+    int first = enabled ? 1 : 2;
+    if (cmd->tokens[first] == NULL) {
+        LOG_ERROR(ERROR_ENABLE_ARG);
+        return ERROR;
+    }
+
+    int rc = SUCCESS;
+    for (int i = first; cmd->tokens[i] != NULL; i++) {
+        if (builtin_set_enabled(cmd->tokens[i], enabled) < 0) rc = ERROR;
+    }
+    return rc;
+}
+
+
 /**
  * The array of available internal commands.
  */
@@ -316,10 +618,47 @@ struct internal_command_t internal_cmds[] = {
     { .name = "status", .handler = handle_status },
     { .name = "output", .handler = handle_output },
     { .name = "cancel", .handler = handle_cancel },
-    NULL
+    { .name = "wait", .handler = handle_wait },
+    { .name = "jobs", .handler = handle_jobs },
+    { .name = "hash", .handler = handle_hash },
+    { .name = "stats", .handler = handle_stats },
+    { .name = "fds", .handler = handle_fds },
+    { .name = "mem", .handler = handle_mem },
+    { .name = "history", .handler = handle_history },
+    { .name = "enable", .handler = handle_enable },
+    { .name = NULL }
 };
 
 
+// perfect hash table of the internal commands, built on first lookup
+static struct perfhash_t internal_table;
+
+
+/**
+ * Finds an internal command by name.
+ * 
+ * @param name - Name of the command
+ * 
+ * @return The internal command, NULL if there is none with the name.
+ */
+struct internal_command_t *find_internal_command(char *name) {
+    // Build the table from the array of commands once.
+    if (!internal_table.built) {
+        char *names[PERFHASH_SLOTS];
+        void *values[PERFHASH_SLOTS];
+        int count;
+
+        for (count = 0; internal_cmds[count].name != NULL; count++) {
+            names[count] = internal_cmds[count].name;
+            values[count] = &internal_cmds[count];
+        }
+        perfhash_build(&internal_table, names, values, count);
+    }
+
+    return perfhash_lookup(&internal_table, name);
+}
+
+
 /**
  * Checks if the given command is an internal command.
  * 
@@ -328,14 +667,14 @@ struct internal_command_t internal_cmds[] = {
  * @return True if the command was found. False if it wasn't.
  */
 bool is_internal_command(struct command_t *cmd) {
-    // Loop through the internal commands,
-    // comparing their names to the name of cmd.
-    for (int i = 0; internal_cmds[i].name != NULL; i++) {
-        // If the names match, return true.
-        if (strcmp(internal_cmds[i].name, cmd->cmd_name) == 0)
-            return true;
+    // Look the name up once,
+    // the handler is kept on the command.
+    if (!cmd->handler_resolved) {
+        struct internal_command_t *internal = find_internal_command(cmd->cmd_name);
+        cmd->handler = (internal != NULL) ? internal->handler : NULL;
+        cmd->handler_resolved = true;
     }
-    return false;
+    return cmd->handler != NULL;
 }
 
 
@@ -345,13 +684,9 @@ bool is_internal_command(struct command_t *cmd) {
  * @param cmd - The command for arguments
  */
 int execute_internal_command(struct command_t *cmd) {
-    // Loop through the internal commands,
-    // comparing their name to the name of cmd.
-    for (int i = 0; internal_cmds[i].name != NULL; i++) {
-        // If the names match, return the result of the
-        // corresponding command handler.
-        if (strcmp(internal_cmds[i].name, cmd->cmd_name) == 0)
-            return internal_cmds[i].handler(cmd);
-    }
-    return ERROR;
+    // Run the handler of the command,
+    // looking it up if not done yet.
+    if (!is_internal_command(cmd))
+        return ERROR;
+    return cmd->handler(cmd);
 }
\ No newline at end of file
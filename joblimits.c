@@ -0,0 +1,306 @@
+/**
+ * @file: joblimits.c
+ * @author: Michael Permyashkin
+ *
+ * @brief: Resource limits of background jobs
+ *
+ * A job queued with --cpus, --nice or --mem carries its limits with its command. The shell
+ * only records the limits, they are applied by the child process of the job right before it
+ * executes the command so the shell itself keeps its own affinity, priority and limits.
+ *
+ * The cpus of --cpus auto are the cpus of a NUMA node, read once from sysfs. Each job queued
+ * with auto gets the next node in turn so heavy jobs running at the same time do not share
+ * the caches and memory of one node.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include "runner.h"
+#include "error.h"
+#include "joblimits.h"
+
+// cpus of each NUMA node are listed in node<N>/cpulist
+#define NUMA_NODE_DIR "/sys/devices/system/node"
+
+// most NUMA nodes jobs are spread over
+#define MAX_NUMA_NODES 64
+
+// number of bits in a word of a cpu mask
+#define CPU_WORD_BITS (8 * sizeof(unsigned long))
+
+// cpus of each NUMA node, read on the first job queued with auto
+static unsigned long numa_cpus[MAX_NUMA_NODES][JOB_CPU_WORDS];
+static int num_numa_nodes = -1;
+
+// node the next job queued with auto gets
+static int next_numa_node = 0;
+
+
+/**
+ * Checks if any limit is set
+ *
+ * @param limits: limits to check
+ * @return true if the job is limited
+ */
+bool joblimits_active(struct job_limits_t *limits) {
+    return limits->has_cpus || limits->auto_cpus || limits->has_nice || limits->mem > 0;
+}
+
+
+/**
+ * Parses a cpu list such as 0-7,16 in to a mask
+ *
+ * @param list: cpu list
+ * @param mask: mask to set the cpus in, cleared first
+ * @return status of parsing the list
+ */
+int parse_cpu_list(char *list, unsigned long *mask) {
+    memset(mask, 0, JOB_CPU_WORDS * sizeof(unsigned long));
+
+    char *end = list;
+    do {
+        // a range of cpus or a single cpu, separated by commas
+        char *start = (end == list) ? list : end + 1;
+        long first = strtol(start, &end, 10);
+        if (end == start || first < 0 || first >= JOB_MAX_CPUS) return ERROR;
+
+        long last = first;
+        if (*end == '-') {
+            start = end + 1;
+            last = strtol(start, &end, 10);
+            if (end == start || last < first || last >= JOB_MAX_CPUS) return ERROR;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            mask[cpu / CPU_WORD_BITS] |= 1UL << (cpu % CPU_WORD_BITS);
+        }
+    } while (*end == ',');
+
+    // a trailing newline is left by sysfs
+    return (*end == '\0' || *end == '\n') ? SUCCESS : ERROR;
+}
+
+
+/**
+ * Checks if a cpu is in a mask
+ *
+ * @param mask: cpu mask
+ * @param cpu: cpu to check
+ * @return true if the cpu is set
+ */
+bool cpu_is_set(unsigned long *mask, int cpu) {
+    return (mask[cpu / CPU_WORD_BITS] >> (cpu % CPU_WORD_BITS)) & 1;
+}
+
+
+/**
+ * Writes a cpu mask as a list of ranges such as 0-7,16
+ *
+ * @param mask: cpu mask
+ * @param buffer: buffer to hold the list
+ * @param size: size of the buffer
+ */
+void format_cpu_list(unsigned long *mask, char *buffer, size_t size) {
+    size_t length = 0;
+    buffer[0] = '\0';
+
+    for (int cpu = 0; cpu < JOB_MAX_CPUS && length < size; cpu++) {
+        if (!cpu_is_set(mask, cpu)) continue;
+
+        int last = cpu;
+        while (last + 1 < JOB_MAX_CPUS && cpu_is_set(mask, last + 1)) last++;
+
+        if (last == cpu)
+            length += snprintf(buffer + length, size - length, "%s%d", (length > 0) ? "," : "", cpu);
+        else
+            length += snprintf(buffer + length, size - length, "%s%d-%d", (length > 0) ? "," : "", cpu, last);
+        cpu = last;
+    }
+}
+
+
+/**
+ * Sets the cpus of a job from a list such as 0-7,16 or from `auto`, which gives each job
+ * the cpus of the next NUMA node in turn
+ *
+ * @param limits: limits to set
+ * @param list: cpu list
+ * @return status of parsing the list
+ */
+int joblimits_set_cpus(struct job_limits_t *limits, char *list) {
+    if (strlen(list) >= JOB_LIMIT_TEXT) return ERROR;
+
+    if (strcmp(list, "auto") == 0) {
+        limits->auto_cpus = true;
+        limits->has_cpus = false;
+    } else {
+        if (parse_cpu_list(list, limits->cpus) < 0) return ERROR;
+        limits->auto_cpus = false;
+        limits->has_cpus = true;
+    }
+
+    strcpy(limits->cpus_text, list);
+    return SUCCESS;
+}
+
+
+/**
+ * Sets the nice value of a job
+ *
+ * @param limits: limits to set
+ * @param nice: nice value from -20 to 19
+ * @return status of parsing the value
+ */
+int joblimits_set_nice(struct job_limits_t *limits, char *nice) {
+    char *end;
+    long value = strtol(nice, &end, 10);
+    if (end == nice || *end != '\0' || value < -20 || value > 19) return ERROR;
+
+    limits->has_nice = true;
+    limits->nice = value;
+    return SUCCESS;
+}
+
+
+/**
+ * Sets the most memory a job may use from a size such as 4G
+ *
+ * @param limits: limits to set
+ * @param mem: size of the limit
+ * @return status of parsing the size
+ */
+int joblimits_set_mem(struct job_limits_t *limits, char *mem) {
+    long size = parse_size(mem);
+    if (size <= 0 || strlen(mem) >= JOB_LIMIT_TEXT) return ERROR;
+
+    limits->mem = size;
+    strcpy(limits->mem_text, mem);
+    return SUCCESS;
+}
+
+
+/**
+ * Reads the cpus of every NUMA node from sysfs, nodes are numbered from 0 without gaps
+ */
+void read_numa_nodes() {
+    char path[128];
+    char list[4096];
+
+    for (num_numa_nodes = 0; num_numa_nodes < MAX_NUMA_NODES; num_numa_nodes++) {
+        snprintf(path, sizeof(path), "%s/node%d/cpulist", NUMA_NODE_DIR, num_numa_nodes);
+        FILE *file = fopen(path, "re");
+        if (file == NULL) break;
+
+        bool read = fgets(list, sizeof(list), file) != NULL;
+        fclose(file);
+        if (!read || parse_cpu_list(list, numa_cpus[num_numa_nodes]) < 0) break;
+    }
+}
+
+
+/**
+ * Picks the cpus of a job queued with --cpus auto. Jobs are spread over the NUMA nodes
+ * in turn, on a machine with one node the job is not limited.
+ *
+ * @param limits: limits to pick cpus for
+ */
+void joblimits_assign_cpus(struct job_limits_t *limits) {
+    if (!limits->auto_cpus) return;
+
+    if (num_numa_nodes < 0) read_numa_nodes();
+    if (num_numa_nodes < 2) return;
+
+    memcpy(limits->cpus, numa_cpus[next_numa_node], sizeof(limits->cpus));
+    limits->has_cpus = true;
+    next_numa_node = (next_numa_node + 1) % num_numa_nodes;
+}
+
+
+/**
+ * Writes the limits as the queue options that give them
+ *
+ * @param limits: limits to write
+ * @param buffer: buffer to hold the options
+ * @param size: size of the buffer
+ * @return length of the options, at least size if they did not fit
+ */
+int joblimits_options(struct job_limits_t *limits, char *buffer, size_t size) {
+    int length = 0;
+    buffer[0] = '\0';
+
+    if (limits->has_cpus || limits->auto_cpus)
+        length += snprintf(buffer + length, size - length, "--cpus %s ", limits->cpus_text);
+    if (limits->has_nice && (size_t) length < size)
+        length += snprintf(buffer + length, size - length, "--nice %d ", limits->nice);
+    if (limits->mem > 0 && (size_t) length < size)
+        length += snprintf(buffer + length, size - length, "--mem %s ", limits->mem_text);
+
+    return length;
+}
+
+
+/**
+ * Writes a description of the limits for the status command
+ *
+ * @param limits: limits to describe
+ * @param buffer: buffer to hold the description
+ * @param size: size of the buffer
+ */
+void joblimits_describe(struct job_limits_t *limits, char *buffer, size_t size) {
+    char cpus[256];
+    size_t length = 0;
+    buffer[0] = '\0';
+
+    if (limits->has_cpus) {
+        format_cpu_list(limits->cpus, cpus, sizeof(cpus));
+        length += snprintf(buffer + length, size - length, "cpus %s%s", cpus, limits->auto_cpus ? " (auto)" : "");
+    } else if (limits->auto_cpus) {
+        length += snprintf(buffer + length, size - length, "cpus all (auto, one NUMA node)");
+    }
+    if (limits->has_nice && length < size)
+        length += snprintf(buffer + length, size - length, "%snice %d", (length > 0) ? ", " : "", limits->nice);
+    if (limits->mem > 0 && length < size)
+        snprintf(buffer + length, size - length, "%smem %s", (length > 0) ? ", " : "", limits->mem_text);
+}
+
+
+/**
+ * Applies the limits to the calling process, called in the child before the job runs
+ *
+ * @param limits: limits to apply
+ * @return status of applying the limits
+ */
+int joblimits_apply(struct job_limits_t *limits) {
+    if (limits->has_cpus) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < JOB_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+            if (cpu_is_set(limits->cpus, cpu)) CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+            LOG_ERROR(ERROR_LIMIT_CPUS, strerror(errno));
+            return ERROR;
+        }
+    }
+
+    if (limits->has_nice && setpriority(PRIO_PROCESS, 0, limits->nice) < 0) {
+        LOG_ERROR(ERROR_LIMIT_NICE, strerror(errno));
+        return ERROR;
+    }
+
+    if (limits->mem > 0) {
+        struct rlimit rlim = { .rlim_cur = limits->mem, .rlim_max = limits->mem };
+        if (setrlimit(RLIMIT_AS, &rlim) < 0) {
+            LOG_ERROR(ERROR_LIMIT_MEM, strerror(errno));
+            return ERROR;
+        }
+    }
+
+    return SUCCESS;
+}
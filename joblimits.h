@@ -0,0 +1,112 @@
+/**
+ * @file: joblimits.h
+ * @author: Michael Permyashkin
+ *
+ * @brief: Header file for resource limits of background jobs
+ *
+ * Defines the cpus, priority and memory a queued job is limited to and the functions to
+ * parse them from queue options, describe them for status and apply them in the child
+ * process before the job is executed.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef JOBLIMITS_H
+#define JOBLIMITS_H
+
+// most cpus a job can be given
+#define JOB_MAX_CPUS 1024
+
+// number of words in a cpu mask
+#define JOB_CPU_WORDS (JOB_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+// longest option value that is kept to show and record the limits
+#define JOB_LIMIT_TEXT 64
+
+// resources a job is limited to
+struct job_limits_t {
+    bool has_cpus;
+    bool auto_cpus;                         // cpus of a NUMA node picked when the job is queued
+    unsigned long cpus[JOB_CPU_WORDS];      // mask of the cpus the job may run on
+    char cpus_text[JOB_LIMIT_TEXT];         // cpu list as given, or `auto`
+
+    bool has_nice;
+    int nice;
+
+    long mem;                               // most bytes of address space, 0 for no limit
+    char mem_text[JOB_LIMIT_TEXT];
+};
+
+/**
+ * Checks if any limit is set
+ *
+ * @param limits: limits to check
+ * @return true if the job is limited
+ */
+bool joblimits_active(struct job_limits_t *limits);
+
+/**
+ * Sets the cpus of a job from a list such as 0-7,16 or from `auto`, which gives each job
+ * the cpus of the next NUMA node in turn
+ *
+ * @param limits: limits to set
+ * @param list: cpu list
+ * @return status of parsing the list
+ */
+int joblimits_set_cpus(struct job_limits_t *limits, char *list);
+
+/**
+ * Sets the nice value of a job
+ *
+ * @param limits: limits to set
+ * @param nice: nice value from -20 to 19
+ * @return status of parsing the value
+ */
+int joblimits_set_nice(struct job_limits_t *limits, char *nice);
+
+/**
+ * Sets the most memory a job may use from a size such as 4G
+ *
+ * @param limits: limits to set
+ * @param mem: size of the limit
+ * @return status of parsing the size
+ */
+int joblimits_set_mem(struct job_limits_t *limits, char *mem);
+
+/**
+ * Picks the cpus of a job queued with --cpus auto. Jobs are spread over the NUMA nodes
+ * in turn, on a machine with one node the job is not limited.
+ *
+ * @param limits: limits to pick cpus for
+ */
+void joblimits_assign_cpus(struct job_limits_t *limits);
+
+/**
+ * Writes the limits as the queue options that give them
+ *
+ * @param limits: limits to write
+ * @param buffer: buffer to hold the options
+ * @param size: size of the buffer
+ * @return length of the options, at least size if they did not fit
+ */
+int joblimits_options(struct job_limits_t *limits, char *buffer, size_t size);
+
+/**
+ * Writes a description of the limits for the status command
+ *
+ * @param limits: limits to describe
+ * @param buffer: buffer to hold the description
+ * @param size: size of the buffer
+ */
+void joblimits_describe(struct job_limits_t *limits, char *buffer, size_t size);
+
+/**
+ * Applies the limits to the calling process, called in the child before the job runs
+ *
+ * @param limits: limits to apply
+ * @return status of applying the limits
+ */
+int joblimits_apply(struct job_limits_t *limits);
+
+#endif
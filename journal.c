@@ -0,0 +1,352 @@
+/**
+ * @file: journal.c
+ * @author: Michael Permyashkin
+ *
+ * @brief: Keeps the state of queued jobs in a file other programs can read
+ *
+ * The journal is mapped in to memory so a state change is a few stores in to the record of
+ * the job, no system call is made unless the file has to grow. The sequence number in the
+ * header is bumped before and after each write so a reader polling the file can tell when
+ * it saw a record half written.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "runner.h"
+#include "capture.h"
+#include "joblimits.h"
+#include "journal.h"
+
+// records a new journal has room for
+#define JOURNAL_INITIAL_CAPACITY 64
+
+_Static_assert(sizeof(struct journal_header_t) == 64, "journal header layout changed");
+_Static_assert(sizeof(struct journal_record_t) == 512, "journal record layout changed");
+
+// open journal, fd is -1 when no journal is used
+static int journal_fd = -1;
+static struct journal_header_t *header = NULL;
+static struct journal_record_t *records = NULL;
+static size_t map_size = 0;
+
+
+/**
+ * Returns the size of a journal file holding the given number of records
+ *
+ * @param capacity: number of records
+ * @return size in bytes
+ */
+size_t journal_size(uint32_t capacity) {
+    return sizeof(struct journal_header_t) + (size_t) capacity * sizeof(struct journal_record_t);
+}
+
+
+/**
+ * Returns the current time for record timestamps
+ *
+ * @return nanoseconds since the epoch
+ */
+int64_t journal_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Maps the journal file with room for the given number of records, the file
+ * is grown to fit
+ *
+ * @param capacity: number of records
+ * @return status of mapping the file
+ */
+int journal_map(uint32_t capacity) {
+    size_t size = journal_size(capacity);
+    if (ftruncate(journal_fd, size) < 0) return ERROR;
+
+    void *map;
+    if (header == NULL) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, journal_fd, 0);
+    } else {
+        map = mremap(header, map_size, size, MREMAP_MAYMOVE);
+    }
+    if (map == MAP_FAILED) return ERROR;
+
+    header = map;
+    records = (struct journal_record_t *) (header + 1);
+    map_size = size;
+    header->capacity = capacity;
+    return SUCCESS;
+}
+
+
+/**
+ * Copies the records of a previous shell out of the journal file if it holds a
+ * journal of this layout
+ *
+ * @param recovered: set to the copied records
+ * @return number of records copied
+ */
+int journal_read_previous(struct journal_record_t **recovered) {
+    struct journal_header_t previous;
+    struct stat sfile;
+
+    *recovered = NULL;
+    if (fstat(journal_fd, &sfile) < 0 || (size_t) sfile.st_size < sizeof(previous)) return 0;
+    if (pread(journal_fd, &previous, sizeof(previous), 0) != sizeof(previous)) return 0;
+
+    // anything else in the file is not recovered
+    if (memcmp(previous.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        previous.version != JOURNAL_VERSION || previous.record_size != sizeof(struct journal_record_t))
+        return 0;
+
+    // only records that are in the file, a shell may have died while growing it
+    uint32_t count = previous.num_records;
+    size_t in_file = (sfile.st_size - sizeof(previous)) / sizeof(struct journal_record_t);
+    if (count > in_file) count = in_file;
+    if (count == 0) return 0;
+
+    size_t length = (size_t) count * sizeof(struct journal_record_t);
+    *recovered = malloc(length);
+    if (pread(journal_fd, *recovered, length, sizeof(previous)) != (ssize_t) length) {
+        free(*recovered);
+        *recovered = NULL;
+        return 0;
+    }
+    return count;
+}
+
+
+/**
+ * Opens or creates the journal and maps it in to memory. Records left by a previous shell
+ * are copied out for recovery and the journal is started over. The journal is locked so
+ * only one shell uses it at a time.
+ *
+ * @param path: journal file
+ * @param recovered: set to the records of the previous shell, free with free
+ * @return number of recovered records, negative on error with errno set
+ */
+int journal_open(char *path, struct journal_record_t **recovered) {
+    *recovered = NULL;
+    if (journal_fd >= 0) return 0;
+
+    journal_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (journal_fd < 0) return ERROR;
+
+    // another shell is using this journal
+    if (flock(journal_fd, LOCK_EX | LOCK_NB) < 0) {
+        int saved_errno = errno;
+        journal_close();
+        errno = saved_errno;
+        return ERROR;
+    }
+
+    int count = journal_read_previous(recovered);
+
+    // start over with an empty journal
+    if (ftruncate(journal_fd, 0) < 0 || journal_map(JOURNAL_INITIAL_CAPACITY) < 0) {
+        int saved_errno = errno;
+        free(*recovered);
+        *recovered = NULL;
+        journal_close();
+        errno = saved_errno;
+        return ERROR;
+    }
+
+    memcpy(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header->version = JOURNAL_VERSION;
+    header->record_size = sizeof(struct journal_record_t);
+    header->num_records = 0;
+    header->sequence = 0;
+    header->shell_pid = getpid();
+
+    return count;
+}
+
+
+/**
+ * Checks if a journal is open
+ *
+ * @return true if job state is being recorded
+ */
+bool journal_is_open() {
+    return header != NULL;
+}
+
+
+/**
+ * Starts writing a record, readers see an odd sequence number until the write ends
+ */
+void journal_begin_write() {
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+/**
+ * Ends writing a record
+ */
+void journal_end_write() {
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Writes the command line of a job so it can be parsed again. Tokens with blanks
+ * are put in double quotes. The queue options of the limits of the job come first
+ * so a recovered job gets the same limits.
+ *
+ * @param queue_item: job to write
+ * @param buffer: buffer to hold the command line
+ * @return true if the command line fits and can be parsed back to the same tokens
+ */
+bool journal_write_command(struct queue_item_t *queue_item, char *buffer) {
+    struct command_t *command = queue_item->command;
+    size_t length = joblimits_options(&queue_item->limits, buffer, JOURNAL_COMMAND_SIZE);
+    if (length >= JOURNAL_COMMAND_SIZE) return false;
+
+    for (int i = 0; i < command->num_tokens && command->tokens[i] != NULL; i++) {
+        char *token = command->tokens[i];
+        bool quote = strpbrk(token, " \t") != NULL;
+
+        // a double quote in a token can not be written back
+        if (strchr(token, '"') != NULL) return false;
+
+        int written = snprintf(buffer + length, JOURNAL_COMMAND_SIZE - length,
+                               quote ? "%s\"%s\"" : "%s%s", (i > 0) ? " " : "", token);
+        if (written < 0 || length + written >= JOURNAL_COMMAND_SIZE) return false;
+        length += written;
+    }
+    return true;
+}
+
+
+/**
+ * Adds the record of a newly queued job
+ *
+ * @param queue_item: job that was queued
+ * @param after: ids of the jobs it depends on
+ * @param num_after: number of ids
+ */
+void journal_add(struct queue_item_t *queue_item, int *after, int num_after) {
+    if (header == NULL || queue_item->job_id < 0) return;
+
+    // grow the file when the job id is past the last record
+    uint32_t capacity = header->capacity;
+    while ((uint32_t) queue_item->job_id >= capacity) capacity *= 2;
+    if (capacity != header->capacity && journal_map(capacity) < 0) return;
+
+    struct journal_record_t *record = &records[queue_item->job_id];
+
+    journal_begin_write();
+    memset(record, 0, sizeof(*record));
+    record->job_id = queue_item->job_id;
+    record->queue_time = journal_now();
+
+    // a job that does not fit is still watched, it just can not be recovered
+    if (num_after > JOURNAL_MAX_AFTER || !journal_write_command(queue_item, record->command))
+        record->flags |= JOURNAL_NO_RECOVER;
+    record->num_after = (num_after > JOURNAL_MAX_AFTER) ? JOURNAL_MAX_AFTER : num_after;
+    for (int i = 0; i < record->num_after; i++) {
+        record->after[i] = after[i];
+    }
+
+    if ((uint32_t) queue_item->job_id >= header->num_records)
+        header->num_records = queue_item->job_id + 1;
+    journal_end_write();
+
+    journal_update(queue_item);
+}
+
+
+/**
+ * Returns the state a job is recorded in
+ *
+ * @param queue_item: job to check
+ * @return state of the job
+ */
+enum journal_state_e journal_job_state(struct queue_item_t *queue_item) {
+    if (queue_item->is_skipped) return JOURNAL_SKIPPED;
+    if (queue_item->is_canceled) return JOURNAL_CANCELED;
+    if (queue_item->is_complete) return JOURNAL_COMPLETE;
+    if (queue_item->waiting_on > 0) return JOURNAL_WAITING;
+    if (queue_item->pid == 0) return JOURNAL_QUEUED;
+    return JOURNAL_RUNNING;
+}
+
+
+/**
+ * Returns the number of bytes of output a job wrote so far
+ *
+ * @param queue_item: job to check
+ * @return size of the output
+ */
+uint64_t journal_output_size(struct queue_item_t *queue_item) {
+    if (queue_item->capture != NULL) return capture_size(queue_item->capture);
+
+    struct stat sfile;
+    if (queue_item->outfile == NULL || stat(queue_item->outfile, &sfile) < 0) return 0;
+    return sfile.st_size;
+}
+
+
+/**
+ * Writes the current state of a job to its record
+ *
+ * @param queue_item: job that changed state
+ */
+void journal_update(struct queue_item_t *queue_item) {
+    if (header == NULL || queue_item->job_id < 0 || (uint32_t) queue_item->job_id >= header->num_records)
+        return;
+
+    struct journal_record_t *record = &records[queue_item->job_id];
+    int64_t now = journal_now();
+
+    journal_begin_write();
+    record->pid = queue_item->pid;
+    record->state = journal_job_state(queue_item);
+    record->exit_status = queue_item->exit_status;
+    record->output_size = journal_output_size(queue_item);
+
+    if (queue_item->pid != 0 && record->start_time == 0) record->start_time = now;
+    if (queue_item->is_complete && record->end_time == 0) record->end_time = now;
+    journal_end_write();
+}
+
+
+/**
+ * Marks the record of a job that was removed from the queue
+ *
+ * @param job_id: id of the job
+ */
+void journal_remove(int job_id) {
+    if (header == NULL || job_id < 0 || (uint32_t) job_id >= header->num_records) return;
+
+    journal_begin_write();
+    records[job_id].flags |= JOURNAL_REMOVED;
+    journal_end_write();
+}
+
+
+/**
+ * Unmaps and closes the journal, the records stay in the file
+ */
+void journal_close() {
+    if (header != NULL) munmap(header, map_size);
+    header = NULL;
+    records = NULL;
+    map_size = 0;
+
+    if (journal_fd >= 0) close(journal_fd);
+    journal_fd = -1;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file: journal.h
+ * @author: Michael Permyashkin
+ *
+ * @brief: Header file for the job journal
+ *
+ * The journal is a file of fixed size records, one per queued job, that the shell maps in to
+ * memory and updates in place whenever a job changes state. Other programs can map or read the
+ * same file to watch the queue without talking to the shell.
+ *
+ * The file starts with a journal_header_t followed by capacity records, the record of a job is
+ * at index job id. All fields are in the byte order of the host. The sequence number in the header
+ * is odd while the shell is writing a record, a reader copies the records it wants and retries
+ * if the sequence number was odd or changed in the meantime. The file grows when more jobs are
+ * queued than it has records, readers should check capacity against the size of the file.
+ *
+ * Jobs that were still waiting to start when the shell exited are recorded with their command
+ * line so a new shell using the same journal can queue them again.
+ */
+
+#include <stdint.h>
+
+#include "background.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+// identifies a journal file and its layout
+#define JOURNAL_MAGIC "SUSHJNL"
+#define JOURNAL_VERSION 1
+
+// most dependencies of a job the journal records
+#define JOURNAL_MAX_AFTER 16
+
+// size of the command line held by a record
+#define JOURNAL_COMMAND_SIZE 392
+
+// state of a job in its record
+enum journal_state_e {
+    JOURNAL_QUEUED,     // ready to start, waiting for a free slot
+    JOURNAL_WAITING,    // waiting for the jobs it depends on
+    JOURNAL_RUNNING,
+    JOURNAL_COMPLETE,   // exited, or could not be started
+    JOURNAL_SKIPPED,    // a job it depends on failed
+    JOURNAL_CANCELED
+};
+
+// flags of a record
+#define JOURNAL_REMOVED 0x1     // job was removed from the queue
+#define JOURNAL_NO_RECOVER 0x2  // command line or dependencies did not fit the record
+
+// start of the journal file
+struct journal_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;          // number of records the file holds
+    uint32_t num_records;       // number of records in use, one past the highest job id
+    uint64_t sequence;          // odd while a record is being written
+    int32_t shell_pid;
+    uint8_t reserved[28];
+};
+
+// record of a single job, timestamps are nanoseconds since the epoch and 0 until reached
+struct journal_record_t {
+    int32_t job_id;
+    int32_t pid;
+    int32_t state;
+    int32_t exit_status;
+    int64_t queue_time;
+    int64_t start_time;
+    int64_t end_time;
+    uint64_t output_size;
+    int32_t flags;
+    int32_t num_after;
+    int32_t after[JOURNAL_MAX_AFTER];
+    char command[JOURNAL_COMMAND_SIZE];     // job command line as it would be typed
+};
+
+/**
+ * Opens or creates the journal and maps it in to memory. Records left by a previous shell
+ * are copied out for recovery and the journal is started over. The journal is locked so
+ * only one shell uses it at a time.
+ *
+ * @param path: journal file
+ * @param recovered: set to the records of the previous shell, free with free
+ * @return number of recovered records, negative on error with errno set
+ */
+int journal_open(char *path, struct journal_record_t **recovered);
+
+/**
+ * Checks if a journal is open
+ *
+ * @return true if job state is being recorded
+ */
+bool journal_is_open();
+
+/**
+ * Adds the record of a newly queued job
+ *
+ * @param queue_item: job that was queued
+ * @param after: ids of the jobs it depends on
+ * @param num_after: number of ids
+ */
+void journal_add(struct queue_item_t *queue_item, int *after, int num_after);
+
+/**
+ * Writes the current state of a job to its record
+ *
+ * @param queue_item: job that changed state
+ */
+void journal_update(struct queue_item_t *queue_item);
+
+/**
+ * Marks the record of a job that was removed from the queue
+ *
+ * @param job_id: id of the job
+ */
+void journal_remove(int job_id);
+
+/**
+ * Unmaps and closes the journal, the records stay in the file
+ */
+void journal_close();
+
+#endif
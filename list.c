@@ -14,6 +14,18 @@
 
 #include "list.h"
 
+/**
+ * Initializes a list head at runtime so it points to itself, used for heads and nodes
+ * that are not declared with LIST_HEAD
+ * 
+ * @param head: the head node to initialize
+ **/ 
+void list_init(struct list_head *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+
 /**
  * Adds the new item at to the list, at the front
  * 
@@ -54,6 +54,14 @@ struct list_head
     struct list_head *next, *prev;
 };
 
+/**
+ * Initializes a list head at runtime so it points to itself, used for heads and nodes
+ * that are not declared with LIST_HEAD
+ * 
+ * @param head: the head node to initialize
+ **/ 
+void list_init(struct list_head *head);
+
 /**
  * Adds the new item at to the list, at the front
  * 
@@ -0,0 +1,110 @@
+/**
+ * @file: memstat.c
+ * @author: Andrew Kress
+ *
+ * @brief: Memory accounting of the shell
+ *
+ * Nothing is counted while the shell runs. When the mem command asks, every part of the
+ * shell walks the memory it holds and adds the usable size malloc reports for each block,
+ * so the counters cost nothing between calls and can never drift from what is really held.
+ * The heap in use and the resident size of the whole shell are printed with them, which is
+ * how a long session is checked to stay flat.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#include "runner.h"
+#include "error.h"
+#include "environ.h"
+#include "background.h"
+#include "parsecache.h"
+#include "cmdhash.h"
+#include "eventloop.h"
+#include "memstat.h"
+
+// sizes of the shell in pages, the second field is the resident size
+#define STATM_FILE "/proc/self/statm"
+
+
+/**
+ * Counts an allocation, NULL is not counted
+ *
+ * @param usage: counters to add to
+ * @param ptr: memory returned by malloc
+ */
+void mem_count(struct mem_usage_t *usage, void *ptr) {
+    if (ptr == NULL) return;
+
+    usage->bytes += malloc_usable_size(ptr);
+    usage->allocations++;
+}
+
+
+/**
+ * Returns the number of bytes of heap the shell has allocated
+ *
+ * @return bytes in use
+ */
+size_t memstat_heap_in_use() {
+    struct mallinfo2 heap = mallinfo2();
+    return heap.uordblks + heap.hblkhd;
+}
+
+
+/**
+ * Returns the resident size of the shell
+ *
+ * @return resident size in bytes, negative on error
+ */
+long memstat_resident() {
+    FILE *file = fopen(STATM_FILE, "re");
+    if (file == NULL) return ERROR;
+
+    long size, resident;
+    int fields = fscanf(file, "%ld %ld", &size, &resident);
+    fclose(file);
+
+    return (fields == 2) ? resident * sysconf(_SC_PAGESIZE) : ERROR;
+}
+
+
+/**
+ * Prints the memory held by the parser, the environment, the job queue and event loop and
+ * the command hash, followed by the heap in use and the resident size of the shell
+ *
+ * @return status of reading the sizes of the shell
+ */
+int memstat_print() {
+    struct mem_usage_t parser = { 0 }, env = { 0 }, queue = { 0 }, hash = { 0 };
+
+    // the parser holds the arena of the line, its token buffer and every remembered line,
+    // the queue its jobs and the file descriptors the event loop watches for them
+    runner_memory(&parser);
+    parser_memory(&parser);
+    parsecache_memory(&parser);
+    environ_memory(&env);
+    background_memory(&queue);
+    eventloop_memory(&queue);
+    cmdhash_memory(&hash);
+
+    LOG_MSG(MSG_MEM_USAGE, "parser", parser.bytes, parser.allocations);
+    LOG_MSG(MSG_MEM_USAGE, "environ", env.bytes, env.allocations);
+    LOG_MSG(MSG_MEM_USAGE, "queue", queue.bytes, queue.allocations);
+    LOG_MSG(MSG_MEM_USAGE, "hash", hash.bytes, hash.allocations);
+
+    struct mallinfo2 heap = mallinfo2();
+    LOG_MSG(MSG_MEM_HEAP, memstat_heap_in_use(), heap.arena + heap.hblkhd);
+
+    long resident = memstat_resident();
+    if (resident < 0) {
+        LOG_ERROR(ERROR_MEM_RSS, strerror(errno));
+        return ERROR;
+    }
+    LOG_MSG(MSG_MEM_RSS, resident);
+
+    return SUCCESS;
+}
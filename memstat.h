@@ -0,0 +1,53 @@
+/**
+ * @file: memstat.h
+ * @author: Andrew Kress
+ *
+ * @brief: Header file for memory accounting of the shell
+ *
+ * Defines the counters each part of the shell fills in with the memory it holds, and the
+ * function the mem command uses to print them along with the heap and resident size of
+ * the shell.
+ */
+
+#include <stddef.h>
+
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+// memory held by one part of the shell
+struct mem_usage_t {
+    size_t bytes;                   // usable size of every allocation, as malloc reports it
+    unsigned long allocations;
+};
+
+/**
+ * Counts an allocation, NULL is not counted
+ *
+ * @param usage: counters to add to
+ * @param ptr: memory returned by malloc
+ */
+void mem_count(struct mem_usage_t *usage, void *ptr);
+
+/**
+ * Returns the number of bytes of heap the shell has allocated
+ *
+ * @return bytes in use
+ */
+size_t memstat_heap_in_use();
+
+/**
+ * Returns the resident size of the shell
+ *
+ * @return resident size in bytes, negative on error
+ */
+long memstat_resident();
+
+/**
+ * Prints the memory held by the parser, the environment, the job queue and event loop and
+ * the command hash, followed by the heap in use and the resident size of the shell
+ *
+ * @return status of reading the sizes of the shell
+ */
+int memstat_print();
+
+#endif
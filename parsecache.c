@@ -0,0 +1,264 @@
+/**
+ * @file: parsecache.c
+ * @author: Andrew Kress
+ * 
+ * @brief: Cache of parsed command lines
+ * 
+ * Loops and startup files run the same command lines over and over. The commands each line
+ * parsed to are kept as templates in a hash table of buckets, each bucket a linked list of
+ * entries, keyed by the text of the line. A line found in the table is copied from its template
+ * in to the arena instead of being parsed again. The number of lines is bounded, entries are
+ * kept in order of use and the least recently used line is forgotten when the cache is full.
+ * 
+ * Templates own their token strings. Copies made for a run share the strings but get their own
+ * command structs and token arrays, so a command can change its fields and tokens while it runs
+ * without changing the template. A template is only freed when a new line is inserted, after
+ * the commands of the line before are done.
+ * 
+ * A line with a $ may expand variables, its commands depend on the environment as well as the
+ * text. Its entry records the generation of the environment it was parsed with and is only
+ * used while the environment is unchanged, otherwise the line is parsed again.
+ */ 
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "list.h"
+#include "parsecache.h"
+#include "environ.h"
+#include "error.h"
+
+
+// number of buckets in the hash table
+#define PARSECACHE_BUCKETS 256
+
+// most command lines remembered at once
+#define PARSECACHE_CAPACITY 128
+
+// longer command lines are not remembered
+#define PARSECACHE_MAX_LINE 4096
+
+
+// struct to store a command line and the commands it parsed to
+struct parsecache_entry_t {
+    char *cmdline;
+    unsigned long hash;
+
+    bool expands;               // line may expand variables
+    unsigned long generation;   // generation of the environment the line was parsed with
+
+    struct command_t **commands;
+    int num_commands;
+
+    struct list_head list;      // bucket list
+    struct list_head lru_list;  // most recently used first
+};
+
+
+// buckets of the hash table, initialized on first use
+static struct list_head buckets[PARSECACHE_BUCKETS];
+static bool buckets_initialized = false;
+
+// every entry in order of use and counters shown by the stats command
+static LIST_HEAD(lru_list);
+static int num_entries = 0;
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+
+
+/**
+ * Hashes a command line with FNV-1a
+ * 
+ * @param cmdline - Command line to hash
+ * @return hash of the line
+ **/
+unsigned long parsecache_hash(char *cmdline) {
+    unsigned long hash = 14695981039346656037UL;
+    for (char *c = cmdline; *c != '\0'; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+
+/**
+ * Returns the bucket a hash belongs in
+ * 
+ * @param hash - Hash of the command line
+ * @return head of the bucket list
+ **/
+struct list_head *parsecache_bucket(unsigned long hash) {
+    // initialize every bucket as an empty list
+    if (!buckets_initialized) {
+        for (int i = 0; i < PARSECACHE_BUCKETS; i++) {
+            list_init(&buckets[i]);
+        }
+        buckets_initialized = true;
+    }
+
+    return &buckets[hash % PARSECACHE_BUCKETS];
+}
+
+
+/**
+ * Returns the entry of a command line if it is in the table
+ * 
+ * @param cmdline - Command line to find
+ * @param hash - Hash of the command line
+ * @return the entry, NULL if the line is not in the table
+ **/
+struct parsecache_entry_t *parsecache_find(char *cmdline, unsigned long hash) {
+    struct list_head *head = parsecache_bucket(hash);
+    struct list_head *curr;
+    struct parsecache_entry_t *entry;
+
+    for (curr = head->next; curr != head; curr = curr->next) {
+        entry = list_entry(curr, struct parsecache_entry_t, list);
+        if (entry->hash == hash && strcmp(entry->cmdline, cmdline) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+
+/**
+ * Removes an entry from the table and frees it along with its templates
+ * 
+ * @param entry - Entry to remove
+ **/
+void parsecache_delete_entry(struct parsecache_entry_t *entry) {
+    list_del(&entry->list);
+    list_del(&entry->lru_list);
+    num_entries--;
+
+    for (int i = 0; i < entry->num_commands; i++) {
+        free(entry->commands[i]);
+    }
+    free(entry->commands);
+    free(entry->cmdline);
+    free(entry);
+}
+
+
+/**
+ * Looks up a command line and if it was parsed before copies its commands in to the arena.
+ * The copies start without any open files or processes like freshly parsed commands.
+ * 
+ * @param arena: arena to copy the commands to
+ * @param commands_arr: set to the array of command structs
+ * @param cmdline: command line to look up
+ * @return number of commands, ERROR if the line is not in the cache
+ **/
+int parsecache_lookup(struct arena_t *arena, struct command_t ***commands_arr, char *cmdline) {
+    struct parsecache_entry_t *entry = parsecache_find(cmdline, parsecache_hash(cmdline));
+
+    // variables the line expanded changed since, the line is parsed and inserted again
+    if (entry != NULL && entry->expands && entry->generation != environ_generation()) {
+        parsecache_delete_entry(entry);
+        entry = NULL;
+    }
+
+    if (entry == NULL) {
+        misses++;
+        return ERROR;
+    }
+    hits++;
+
+    // entry is now the most recently used
+    list_del(&entry->lru_list);
+    list_add(&entry->lru_list, &lru_list);
+
+    // copy each command and its token array, the strings are shared with the template
+    struct command_t **commands = arena_alloc(arena, entry->num_commands * sizeof(struct command_t *));
+    for (int i = 0; i < entry->num_commands; i++) {
+        struct command_t *template = entry->commands[i];
+
+        commands[i] = arena_alloc(arena, sizeof(struct command_t));
+        *commands[i] = *template;
+        commands[i]->tokens = arena_alloc(arena, template->num_tokens * sizeof(char *));
+        memcpy(commands[i]->tokens, template->tokens, template->num_tokens * sizeof(char *));
+    }
+
+    *commands_arr = commands;
+    return entry->num_commands;
+}
+
+
+/**
+ * Remembers the commands a command line parsed to. The least recently used line is
+ * forgotten when the cache is full.
+ * 
+ * @param cmdline: command line that was parsed
+ * @param commands_arr: commands the line parsed to
+ * @param num_commands: number of commands
+ **/
+void parsecache_insert(char *cmdline, struct command_t **commands_arr, int num_commands) {
+    if (strlen(cmdline) > PARSECACHE_MAX_LINE) return;
+
+    unsigned long hash = parsecache_hash(cmdline);
+    if (parsecache_find(cmdline, hash) != NULL) return;
+
+    // make room by forgetting the least recently used line
+    if (num_entries >= PARSECACHE_CAPACITY) {
+        parsecache_delete_entry(list_entry(lru_list.prev, struct parsecache_entry_t, lru_list));
+    }
+
+    struct parsecache_entry_t *entry = malloc(sizeof(struct parsecache_entry_t));
+    entry->cmdline = strdup(cmdline);
+    entry->hash = hash;
+    entry->expands = strchr(cmdline, '$') != NULL;
+    entry->generation = environ_generation();
+    entry->num_commands = num_commands;
+
+    // templates are copied out of the arena
+    entry->commands = malloc(num_commands * sizeof(struct command_t *));
+    for (int i = 0; i < num_commands; i++) {
+        entry->commands[i] = command_clone(commands_arr[i]);
+    }
+
+    list_add_tail(&entry->list, parsecache_bucket(hash));
+    list_add(&entry->lru_list, &lru_list);
+    num_entries++;
+}
+
+
+/**
+ * Forgets all remembered command lines
+ **/
+void parsecache_clear() {
+    while (!list_empty(&lru_list)) {
+        parsecache_delete_entry(list_entry(lru_list.next, struct parsecache_entry_t, lru_list));
+    }
+}
+
+
+/**
+ * Prints the number of hits and misses and how full the cache is
+ **/
+void parsecache_print_stats() {
+    LOG_MSG(MSG_STATS_PARSECACHE, hits, misses, num_entries, PARSECACHE_CAPACITY);
+}
+
+
+/**
+ * Counts the memory held by every remembered command line and its commands
+ * 
+ * @param usage: counters to add to
+ **/
+void parsecache_memory(struct mem_usage_t *usage) {
+    struct list_head *curr;
+
+    for (curr = lru_list.next; curr != &lru_list; curr = curr->next) {
+        struct parsecache_entry_t *entry = list_entry(curr, struct parsecache_entry_t, lru_list);
+
+        mem_count(usage, entry);
+        mem_count(usage, entry->cmdline);
+        mem_count(usage, entry->commands);
+        for (int i = 0; i < entry->num_commands; i++) {
+            mem_count(usage, entry->commands[i]);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+/**
+ * @file: parsecache.h
+ * @author: Andrew Kress
+ * 
+ * @brief: Header file for the parse cache
+ * 
+ * Defines functions to remember the commands a command line parsed to, so a line that is
+ * run again is not parsed again. Each run gets its own copy of the commands.
+ */ 
+
+#include <stddef.h>
+
+#include "runner.h"
+#include "arena.h"
+
+#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+/**
+ * Looks up a command line and if it was parsed before copies its commands in to the arena.
+ * The copies start without any open files or processes like freshly parsed commands.
+ * 
+ * @param arena: arena to copy the commands to
+ * @param commands_arr: set to the array of command structs
+ * @param cmdline: command line to look up
+ * @return number of commands, ERROR if the line is not in the cache
+ **/
+int parsecache_lookup(struct arena_t *arena, struct command_t ***commands_arr, char *cmdline);
+
+/**
+ * Remembers the commands a command line parsed to. The least recently used line is
+ * forgotten when the cache is full.
+ * 
+ * @param cmdline: command line that was parsed
+ * @param commands_arr: commands the line parsed to
+ * @param num_commands: number of commands
+ **/
+void parsecache_insert(char *cmdline, struct command_t **commands_arr, int num_commands);
+
+/**
+ * Forgets all remembered command lines
+ **/
+void parsecache_clear();
+
+/**
+ * Prints the number of hits and misses and how full the cache is
+ **/
+void parsecache_print_stats();
+
+/**
+ * Counts the memory held by every remembered command line and its commands
+ * 
+ * @param usage: counters to add to
+ **/
+void parsecache_memory(struct mem_usage_t *usage);
+
+#endif
@@ -8,40 +8,60 @@
  * Parses command line input into an array of command structs which hold all information
  * needed by the execution units. The parser uses a state machine
  * by looking at each character in turn, determining what that character is
- * and how to proceed. A list of tokens if built for each command present in command line
- * input and then converted to a command data struct which holds all the information needed
- * to execute the commmand.
+ * and how to proceed. The whole command line is tokenized in a single pass, pipes and
+ * redirections included, and the tokens are then grouped into one command data struct per
+ * subcommand which holds all the information needed to execute the commmand.
  * 
- * Parser finishes by populating an array of commands and returning a success value. If any
+ * A line is a list of pipelines joined by `;`, `&&` and `||`, and each pipeline a list of commands
+ * joined by `|`. The commands of every pipeline of the line are built in one pass in to one array, in
+ * the order they appear, and each command records the operator joining it to the next so the runner
+ * can walk the pipelines of the line without parsing it again. A `;` may also end the line.
+ * 
+ * The command line is copied once in to an arena and tokens are slices of the copy which are
+ * terminated in place. The command structs and their token arrays are allocated from the same
+ * arena, so everything built for a command line is released by a single arena reset.
+ * 
+ * Tokens that name variables as $NAME or ${NAME}, quoted or not, are expanded against the
+ * environment before the commands are built. A token without a variable is used as it is,
+ * an expanded token is written in to a single allocation from the arena. Expansion never
+ * splits a token, a token that is not quoted and expands to nothing is dropped.
+ * 
+ * Parser finishes by populating an array of commands and returning the number of commands. If any
  * errors occur or command(s) are invalid, parser returns an error code.
  */ 
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <stdbool.h>
+#include <ctype.h>
 
-#include "list.h"
+#include "arena.h"
 #include "runner.h"
+#include "environ.h"
 #include "error.h"
 
 
 // Definition of all types that any given token can be in a command line input
 enum token_types_e {
     TOKEN_NORMAL,
-    TOKEN_REDIR,
-    TOKEN_FNAME_IN,
-    TOKEN_FNAME_OUT_OVERWRITE,
-    TOKEN_FNAME_OUT_APPEND,
+    TOKEN_PIPE,
+    TOKEN_REDIR_IN,
+    TOKEN_REDIR_OUT_OVERWRITE,
+    TOKEN_REDIR_OUT_APPEND,
+    TOKEN_SEQ,
+    TOKEN_AND,
+    TOKEN_OR,
 };
 
 
-// Parser builds list of token found in command line
+// Tokenizer builds array of tokens found in command line, text points in to the command line
 struct token_t {
     char *token_text;
     enum token_types_e token_type;
-    struct list_head list;
+
+    bool quoted;    // token was in double quotes
+    bool expand;    // token holds a $ which may start a variable
 };
 
 
@@ -56,14 +76,18 @@ enum state_e {
 // Structure to hold all information the statemachine needs as it parses tokens from command
 struct state_machine_t {
     enum state_e state;
-    int position;
-    int cmd_len;
+    char *position;
 
-    int sub_start;
-    int sub_len;
+    struct token_t *tokens;
+    int num_tokens;
 };
 
 
+// array of tokens reused by every command line, grows to the longest line seen
+static struct token_t *token_buffer = NULL;
+static int token_buffer_capacity = 0;
+
+
 /**
  * Returns a string that starts at the given index at the length given
  * 
@@ -74,7 +98,7 @@ struct state_machine_t {
  */
 char * sub_string(char* str, int start, int length) {
     char* output = calloc(length + 1, sizeof(char));
-    for (int i = start; i < (start + length) && i < strlen(str); i++) {
+    for (int i = start; i < (start + length) && str[i] != '\0'; i++) {
         output[i - start] = str[i];
     }
     return output;
@@ -82,176 +106,415 @@ char * sub_string(char* str, int start, int length) {
 
 
 /**
- * Splits the command line input into subcommands each divided by a pipe.
+ * Initializes statemachine to starting state. The state machine is
+ * initialized to begin at the start of the command input
+ * with a state of WHITESPACE since no characters have been encountered.
+ * 
+ * The token array is grown so it can hold every token of the command line, a line
+ * never has more tokens than characters.
  * 
- * @param cmdline: the command that was entered by user
- * @param subcommands_arr: array to hold subcommand strings
- * @param cmd_len: length of command
+ * @param sm: state_machine struct that will be used by parser
+ * @param cmdline: command input from the user
+ * @param cmd_len: length of the command input
  */ 
-void split_cmdline(char *subcommands_arr[], char *cmdline) {
-    int idx = 0;   // index of subcommand array 
-    int start = 0, len = 0; // subcommand start index and length
+void initialize_statemachine(struct state_machine_t *sm, char *cmdline, int cmd_len) {
+    // no characters encountered yet
+    sm->state = WHITESPACE;        
+    sm->position = cmdline;
 
-    int cmd_len = strlen(cmdline);
-    for (int i=0; i<cmd_len; i++) {
-        // reached pipe or the end of the cmdline input
-        if (cmdline[i] == '|' || cmdline[i] == '\n' || cmdline[i] == '\0') {
-            // copy subcommand to array
-            char *subcommand = sub_string(cmdline, start, len);
-            subcommands_arr[idx++] = strdup(subcommand);
-            free(subcommand); 
-
-            // next subcommand begins at next position (after the pipe) 
-            start = i+1;
-            len = 0;
-        } else {
-            len++; // still in subcommand, increment subcommand length
-        }
+    // make room for the most tokens the line can have
+    if (cmd_len + 1 > token_buffer_capacity) {
+        token_buffer_capacity = cmd_len + 1;
+        token_buffer = realloc(token_buffer, token_buffer_capacity * sizeof(struct token_t));
     }
+
+    // no tokens encountered
+    sm->tokens = token_buffer;
+    sm->num_tokens = 0;
 }
 
 
 /**
- * Initializes statemachine to starting state. The state machine is
- * initialized to begin at the 0th position of the command input
- * with a state of WHITESPACE since no characters have been encountered.
+ * Adds a token to the end of the token array
  * 
- * Initialize substring positions and command input length
+ * @param sm: state_machine struct
+ * @param text: start of the token text in the command line, NULL for redirections and pipes without a size
+ * @param token_type: type of the token
+ */ 
+void add_token(struct state_machine_t *sm, char *text, enum token_types_e token_type) {
+    sm->tokens[sm->num_tokens].token_text = text;
+    sm->tokens[sm->num_tokens].token_type = token_type;
+    sm->tokens[sm->num_tokens].quoted = false;
+    sm->tokens[sm->num_tokens].expand = false;
+    sm->num_tokens++;
+}
+
+
+/**
+ * Marks the token being read for expansion if the character may start a variable
  * 
- * @param sm: state_machine struct that will be used by parser
- * @param cmdline: command input from the user
+ * @param sm: state_machine struct
+ * @param c: character of the token
  */ 
-void initialize_statemachine(struct state_machine_t *sm, char *cmdline) {
-    // no characters encountered yet
-    sm->state = WHITESPACE;        
-    sm->position = 0;
+void mark_expansion(struct state_machine_t *sm, char c) {
+    if (c == '$') sm->tokens[sm->num_tokens - 1].expand = true;
+}
 
-    // store the length of the string which will be traversed
-    sm->cmd_len = strlen(cmdline);
 
-    // no substrings encountered
-    sm->sub_start = 0;
-    sm->sub_len = 0;
+/**
+ * Checks if token type is associated with redirection. The filename that follows a
+ * redirection token in the command is the file to redirect to or from.
+ * 
+ * @param token_type: type of token
+ * @return true or false
+ */ 
+int is_redirection_token(enum token_types_e token_type) {
+    return (token_type == TOKEN_REDIR_OUT_OVERWRITE || token_type == TOKEN_REDIR_OUT_APPEND || token_type == TOKEN_REDIR_IN);
+}
+
+
+/**
+ * Checks if token type ends a subcommand, a pipe or a list operator
+ * 
+ * @param token_type: type of token
+ * @return true or false
+ */ 
+bool is_separator_token(enum token_types_e token_type) {
+    return (token_type == TOKEN_PIPE || token_type == TOKEN_SEQ || token_type == TOKEN_AND || token_type == TOKEN_OR);
 }
 
 
 /**
- * Frees allocated memory after parser is complete
+ * Checks if the character at a position of the line ends a token outside of quotes. Pipes,
+ * redirections and list operators end the token before them even without a space in between.
+ * A single & is part of the token, only && is an operator.
  * 
- * @param sm: statemachine used by tokenizer function 
- * @param subcommands_arr: array of subcommand strings to free
- * @param num_commands: number of subcommand strings present
+ * @param position: position of the character to check
+ * @return true or false
  */ 
-void parser_clean_up(struct state_machine_t *sm, char **subcommands_arr, int num_commands) {
-    // free each subcommand in array
-    for (int i=0; i<num_commands; i++) {
-        free(subcommands_arr[i]);
+bool is_operator_char(char *position) {
+    char c = *position;
+    return (c == '|' || c == '<' || c == '>' || c == ';' || (c == '&' && position[1] == '&'));
+}
+
+
+/**
+ * Handler when operator character is encountered by statemachine. This function
+ * handles all cases in which a pipe or redirection can appear
+ *   - no space before or after the operator
+ *   - 1 space before or 1 space after the operator
+ *   - spaces on both sides of the operator
+ * 
+ * Adds the operator token and moves the statemachine past a second character of >>, && or ||.
+ * A pipe may be followed by a size in braces such as |{1M}, the size becomes the text
+ * of the pipe token and the statemachine moves past the closing brace. The text of a list
+ * operator is its position in the line, which is where the next pipeline starts.
+ * 
+ * @param sm: state_machine struct
+ * @param c: operator character
+ */ 
+void parse_operator_token(struct state_machine_t *sm, char c) {
+    // run the next pipeline after this one
+    if (c == ';') {
+        add_token(sm, sm->position, TOKEN_SEQ);
+    }
+    // run the next pipeline if this one succeeded or failed
+    else if (c == '&' || (c == '|' && sm->position[1] == '|')) {
+        add_token(sm, sm->position, (c == '&') ? TOKEN_AND : TOKEN_OR);
+        sm->position++; // skip a char since we already added it
     }
-    // free subcommand array
-    free(subcommands_arr);
+    // pipe to next subcommand, with its size if one is given
+    else if (c == '|') {
+        if (sm->position[1] != '{') {
+            add_token(sm, NULL, TOKEN_PIPE);
+            return;
+        }
 
-    // free statemachine memory
-    free(sm);
+        // a size that is not closed is not a valid size and makes the line malformed
+        char *size = sm->position + 2;
+        char *close = size;
+        while (*close != '}' && *close != '\0' && *close != '\n') close++;
+        if (*close != '}') {
+            add_token(sm, sm->position + 1, TOKEN_PIPE);
+            return;
+        }
+
+        *close = '\0';
+        add_token(sm, size, TOKEN_PIPE);
+        sm->position = close;
+    }
+    // redirection out, >> if next char is also a redirection out
+    else if (c == '>') {
+        if (sm->position[1] == '>') {
+            add_token(sm, NULL, TOKEN_REDIR_OUT_APPEND);
+            sm->position++; // skip a char since we already added it
+        } else {
+            add_token(sm, NULL, TOKEN_REDIR_OUT_OVERWRITE);
+        }
+    }
+    // redirection in
+    else {
+        add_token(sm, NULL, TOKEN_REDIR_IN);
+    }
 }
 
 
 /**
- * Converts linked list of tokens to an array of tokens
+ * Handler when statemachine is in WHITESPACE state. Checks if the current character
+ * is an operator, quote or character - sets state accordingly. A quote or character
+ * starts a new token. If it is none of these, we encountered another whitespace and
+ * the handler does nothing.
  * 
- * @param head: the head node of a given linked list
- * @param arr: array to hold token text
+ * @param sm: state_machine struct
+ * @param c: character the statemachine is reading
  */ 
-void token_list_to_arr(struct list_head *head, char **arr) {
-    if (list_empty(head)) return;
+void do_ws(struct state_machine_t *sm, char c) {
+    // pipe, redirection or list operator
+    if (is_operator_char(sm->position)) {
+        parse_operator_token(sm, c);
+    }
+    // if character is a quote
+    else if (c == '"') {
+        // token begins at next position (we do not want to include the quotes)
+        add_token(sm, sm->position + 1, TOKEN_NORMAL);
+        sm->tokens[sm->num_tokens - 1].quoted = true;
+
+        // update state
+        sm->state = QUOTE;
+    } 
+    // character is not space(s) 
+    else if (c != ' ' && c != '\t') {
+        // token begins at current position
+        add_token(sm, sm->position, TOKEN_NORMAL);
+        mark_expansion(sm, c);
+        
+        // update state
+        sm->state = CHAR;
+    }
+    // otherwise more whitespace was encountered, do nothing
+}
 
-    int i = 0;
-    struct token_t *token; 
-    struct list_head *curr;
 
-    // copy each tokens text into array
-    for (curr = head->next; curr != head; curr = curr->next) {
-        token = list_entry(curr, struct token_t, list);
-        arr[i++] = strdup(token->token_text);
+/**
+ * Handler when statemachine is in CHAR state. Checks if the current character
+ * is blank space(s) or an operator, which ends the token. The token is terminated in 
+ * place and an operator is then handled like it was found after whitespace. Otherwise
+ * we are still inside the token and continue.
+ * 
+ * @param sm: state_machine struct
+ * @param c: character the statemachine is reading
+ */ 
+void do_char(struct state_machine_t *sm, char c) {
+    // is space(s) or operator, we found the end of the token
+    if (c == ' ' || c == '\t' || is_operator_char(sm->position)) {
+        bool is_operator = is_operator_char(sm->position);
+        *sm->position = '\0';
+        sm->state = WHITESPACE;
+
+        // handle the operator that ended the token
+        if (is_operator) parse_operator_token(sm, c);
+    }
+    // otherwise still inside the token
+    else {
+        mark_expansion(sm, c);
     }
-    // terminate array with null
-    arr[i] = NULL; 
 }
 
 
 /**
- * Creates a new token node and adds the node to the tail of the given list
+ * Handler when statemachine is in QUOTE state. A quote ends the quoted token which
+ * is terminated in place, any other character is part of the token.
  * 
  * @param sm: state_machine struct
- * @param head: head of the linked list of tokens to add the node to
- * @param text: holds a substring that is part of a command
+ * @param c: character the statemachine is reading
  */ 
-void add_token_node(struct state_machine_t *sm, struct list_head *head, char *text) {
-    struct token_t *token = malloc(sizeof(struct token_t));
-    token->token_text = strdup(text);
-    token->token_type = TOKEN_NORMAL;
-
-    list_add_tail(&token->list, head);
-    free(text);
-
-    // reset statemachine before it moves to next iteration
-    sm->sub_start = sm->position;
-    sm->sub_len = 0;
-    sm->state = WHITESPACE;
+void do_quote(struct state_machine_t *sm, char c) {
+    // we reached the end of quoted token
+    if (c == '"') {
+        *sm->position = '\0';
+
+        // update state
+        sm->state = WHITESPACE;
+    }
+    // otherwise still inside the quotes
+    else {
+        mark_expansion(sm, c);
+    }
+}
+
+
+/**
+ * Uses the statemachine pattern to move through the command line that was given by
+ * the user in a single pass. Based on the character value, the state of the machine is 
+ * changed to determine what should be done next. Tokens are slices of the command line
+ * which are terminated in place once their end is found. The command line ends at a
+ * newline or the end of the string, a quote that is not closed runs to the end.
+ * 
+ * @param sm: state_machine struct which collects the tokens
+ * @param cmdline: copy of the command line that may be modified
+ * @param cmd_len: length of the command line
+ */
+void tokenizer(struct state_machine_t *sm, char *cmdline, int cmd_len) {
+    // initialize statemachine
+    initialize_statemachine(sm, cmdline, cmd_len);
+
+    for (; *sm->position != '\0' && *sm->position != '\n'; sm->position++) {
+        // get character the statemachine is looking at
+        char c = *sm->position;
+
+        switch(sm->state) {
+            // character state
+            case CHAR:
+                do_char(sm, c);
+                break;
+
+            // quote state
+            case QUOTE:
+                do_quote(sm, c);
+                break;
+
+            // whitespace state
+            default:
+                do_ws(sm, c);
+        }
+    }
+
+    // terminate the last token at the end of the line
+    *sm->position = '\0';
 }
 
 
 /**
- * Removes token node from linked list and frees token memory
+ * Returns the length of the variable name at the start of a string. Names are
+ * letters, digits and underscores and do not start with a digit.
  * 
- * @param node: node to remove from list
- * @param token: token of the node to free
+ * @param str: string to check
+ * @return length of the name, 0 if the string does not start with one
  */ 
-void remove_token_node(struct list_head *node, struct token_t *token) {
-    // remove node from list
-    list_del(node);
-    // free token text memory
-    free(token->token_text);
-    // free token struct
-    free(token);
+int variable_name_length(char *str) {
+    if (!isalpha((unsigned char) str[0]) && str[0] != '_') return 0;
+
+    int length = 1;
+    while (isalnum((unsigned char) str[length]) || str[length] == '_') length++;
+    return length;
 }
 
 
 /**
- * Free all allocated memory to hold list of tokens
+ * Finds the variable a $ starts, $NAME or ${NAME}
  * 
- * @param head: head node of list to free
+ * @param str: string starting at the $
+ * @param name: set to the start of the name
+ * @param name_length: set to the length of the name
+ * @return length of the whole variable reference, 0 if the $ does not start one and is kept
  */ 
-void clear_list(struct list_head *head) {
-    struct token_t *token; 
+int variable_reference(char *str, char **name, int *name_length) {
+    if (str[0] != '$') return 0;
+
+    // ${NAME}
+    if (str[1] == '{') {
+        int length = variable_name_length(str + 2);
+        if (length == 0 || str[2 + length] != '}') return 0;
 
-    // traverse until no nodes remain in list
-    while (!list_empty(head)) {
-        token = list_entry(head->next, struct token_t, list);
-        remove_token_node(&token->list, token);
+        *name = str + 2;
+        *name_length = length;
+        return length + 3;
     }
+
+    // $NAME
+    int length = variable_name_length(str + 1);
+    if (length == 0) return 0;
+
+    *name = str + 1;
+    *name_length = length;
+    return length + 1;
 }
 
 
 /**
- * Checks if token type is associated with redirection. Filenames that proceed a redirection symbol in the 
- * command have these types which describe how to interact with the file.
+ * Returns the value of a variable whose name is part of a token. The name is
+ * terminated in place for the lookup and restored after.
  * 
- * @param token_type: type of token
- * @return true or false
+ * @param name: start of the name
+ * @param name_length: length of the name
+ * @return value of the variable, empty if it is not set
  */ 
-int is_redirection_token(enum token_types_e token_type) {
-    return (token_type == TOKEN_FNAME_OUT_OVERWRITE || token_type == TOKEN_FNAME_OUT_APPEND || token_type == TOKEN_FNAME_IN);
+char *variable_value(char *name, int name_length) {
+    char saved = name[name_length];
+    name[name_length] = '\0';
+    struct environ_var_t *var = environ_get_var(name);
+    name[name_length] = saved;
+
+    return (var != NULL) ? var->value : "";
 }
 
 
 /**
- * Checks if token text is a redirection. Redirection tokens are >, >>, <
+ * Expands the variables of a token. The length of the result is measured first so the
+ * expanded token is written in to a single allocation from the arena.
  * 
- * @param token_text: text of token
- * @return true or false
+ * @param arena: arena to allocate the expanded token from
+ * @param token: token to expand
  */ 
-int is_redirection_text(char *token_type) {
-    return (strcmp(token_type, ">") == 0 || strcmp(token_type, ">>") == 0 || strcmp(token_type, "<") == 0);
+void expand_token(struct arena_t *arena, struct token_t *token) {
+    char *name;
+    int name_length;
+    size_t length = 0;
+
+    // measure the expanded token
+    for (char *c = token->token_text; *c != '\0'; ) {
+        int reference = variable_reference(c, &name, &name_length);
+        if (reference > 0) {
+            length += strlen(variable_value(name, name_length));
+            c += reference;
+        } else {
+            length++;
+            c++;
+        }
+    }
+
+    // copy the text around the variables and their values
+    char *expanded = arena_alloc(arena, length + 1);
+    char *out = expanded;
+    for (char *c = token->token_text; *c != '\0'; ) {
+        int reference = variable_reference(c, &name, &name_length);
+        if (reference > 0) {
+            char *value = variable_value(name, name_length);
+            size_t value_length = strlen(value);
+            memcpy(out, value, value_length);
+            out += value_length;
+            c += reference;
+        } else {
+            *out++ = *c++;
+        }
+    }
+    *out = '\0';
+
+    token->token_text = expanded;
+}
+
+
+/**
+ * Expansion stage between the tokenizer and building the commands. Only tokens that
+ * hold a $ are looked at, every other token is left as a slice of the command line.
+ * Tokens that are not quoted and expand to nothing are removed.
+ * 
+ * @param arena: arena to allocate expanded tokens from
+ * @param sm: state_machine struct holding the tokens
+ */ 
+void expand_tokens(struct arena_t *arena, struct state_machine_t *sm) {
+    int kept = 0;
+
+    for (int i = 0; i < sm->num_tokens; i++) {
+        struct token_t *token = &sm->tokens[i];
+
+        if (token->expand) {
+            expand_token(arena, token);
+            if (token->token_text[0] == '\0' && !token->quoted) continue;
+        }
+        sm->tokens[kept++] = *token;
+    }
+    sm->num_tokens = kept;
 }
 
 
@@ -317,8 +580,6 @@ bool is_valid_stdout(int pipe_out, enum redirect_type_e redir_type, char *out_fn
  * @return true or false if commands stdin and stdout are valid
  */ 
 bool is_valid_command(struct command_t *command) {
-    int rc;
-
     // check stdin configuration
     if (!is_valid_stdin(command->pipe_in, command->file_in, command->infile)) return false;
 
@@ -330,450 +591,303 @@ bool is_valid_command(struct command_t *command) {
 
 
 /**
- * Sets commands redirection out fields. First checks if this redirection was already specified and if so we
+ * Sets commands redirection fields. First checks if this redirection was already specified and if so we
  * have a malformed command, return error. Otherwise the command struct is updated with the appropriate identifiers
  * 
  * @param command: structure to hold command representation
- * @param token: token which holds the file associated with the redirection
- * @param token_type: type of redirection 
- * @return true if set, false if redirection out already set and command is malformed
+ * @param fname: file associated with the redirection
+ * @param token_type: type of redirection token
+ * @return true if set, false if redirection already set and command is malformed
  */ 
-int set_redirection_out(struct command_t *command, struct token_t *token, enum redirect_type_e token_type) {
-    // if redir out already set, error
-    if (command->file_out != REDIRECT_NONE) {
-        return ERROR;
+int set_redirection(struct command_t *command, char *fname, enum token_types_e token_type) {
+    // <
+    if (token_type == TOKEN_REDIR_IN) {
+        // if redir in already set, error
+        if (command->file_in != REDIRECT_NONE) return ERROR;
+
+        command->infile = fname;
+        command->file_in = FILE_IN;
     }
+    // > or >>
+    else {
+        // if redir out already set, error
+        if (command->file_out != REDIRECT_NONE) return ERROR;
 
-    command->outfile = strdup(token->token_text);
-    command->file_out = token_type;
-
-    return SUCCESS;
-}
-
-
-/**
- * Sets commands redirection in fields. First checks if this redirection was already specified and if so we
- * have a malformed command, return error. Otherwise the command struct is updated with the appropriate identifiers
- * 
- * @param command: structure to hold command representation
- * @param token: token which holds the file associated with the redirection
- * @param token_type: type of redirection 
- * @return true if set, false if redirection in already set and command is malformed
- */ 
-int set_redirection_in(struct command_t *command, struct token_t *token, enum redirect_type_e token_type) {
-    // if redir in already set, error
-    if (command->file_in != REDIRECT_NONE) {
-        return ERROR;
+        command->outfile = fname;
+        command->file_out = (token_type == TOKEN_REDIR_OUT_APPEND) ? FILE_OUT_APPEND : FILE_OUT_OVERWRITE;
     }
 
-    command->infile = strdup(token->token_text);
-    command->file_in = token_type;
-
     return SUCCESS;
 }
 
 
 /**
- * Iterates over all tokens to determine if redirection is present. If redirection is
- * found, updates the command structure accordingly to describe what kind of redirection
- * to handle and the corresponding filename that was specified for the redirection.
- * 
- * @param command: structure to hold command representation
- * @param head: head of the linked list of tokens
- * @return true if redirection set properly, false if redirection channel was already set and command is malformed
- */ 
-int set_command_redirections(struct command_t *command, struct list_head *head) {
-    int rc = 0;
-
-    struct list_head *curr;
-    struct token_t *token;
-    for (curr = head->next; curr != head; curr = curr->next) {
-        token = list_entry(curr, struct token_t, list);
-        enum token_types_e token_type = token->token_type;
-
-        if (is_redirection_token(token_type)) {
-            // >
-            if (token_type == TOKEN_FNAME_OUT_OVERWRITE) {
-                rc = set_redirection_out(command, token, FILE_OUT_OVERWRITE);
-            }
-            // >>
-            else if (token_type == TOKEN_FNAME_OUT_APPEND) {
-                rc = set_redirection_out(command, token, FILE_OUT_APPEND);
-            }
-            // <
-            else if (token_type == TOKEN_FNAME_IN) {
-                rc = set_redirection_in(command, token, FILE_IN);
-            }
-
-            // if any errors, return error
-            if (rc < 0) return ERROR;
-
-            // update current node after deleting the filename node
-            struct list_head *next = curr->next;
-            remove_token_node(curr, token);
-            curr = next->prev; 
-        }
-    }
-
-    return SUCCESS; 
-}
-
-
-/**
- * Converts list of tokens to a null terminated array of tokens and store in command
- * struct. Sets the command struct values of executable name and number of tokens
- * 
- * @param command: structure to hold command representation
- * @param head: linked list hold tokens of the command
- */ 
-void set_command_tokens(struct command_t *command, struct list_head *head) {
-    // convert list of tokens to array of tokens
-    int size = list_size(head) + 1;
-    char *tokens_arr[size];
-    token_list_to_arr(head, tokens_arr);
-
-    // creates space in struct to hold array of tokens and copies the array to struct
-    command->tokens = malloc(size * sizeof(char *));
-    for (int i = 0; i < size; ++i) {
-        char *token = tokens_arr[i];
-        command->tokens[i] = token;
-    }
-
-    // command name is first token in array
-    command->num_tokens = size;
-    command->cmd_name = command->tokens[0];
-}
-
-
-/**
- * Takes a list of tokens which describe a single command and creates a data structure
- * to represent all the information needed about the command.
+ * Initializes a command struct to a command without arguments, redirection or pipes
  * 
- * @param command: structure to hold command representation
- * @param head: linked list hold tokens of the command
- * @param command_position: position of the command in the command line input
- * @param num_commands: number of commands present in the command line input
- * @return whether the conversion to command structure of successful or not
+ * @param command: structure to initialize
  */ 
-int tokens_to_command(struct command_t *command, struct list_head *head, int command_position, int num_commands) {
-    int rc; 
+void initialize_command(struct command_t *command) {
+    command->cmd_name = NULL;
+    command->tokens = NULL;
+    command->num_tokens = 0;
 
     // Initialize no file input/output
     command->file_in = REDIRECT_NONE;
     command->infile = NULL;
     command->file_out = REDIRECT_NONE;
     command->outfile = NULL;
+    command->fid_in = 0;
+    command->fid_out = 0;
+    command->pipe_size = 0;
+
+    // last command of the line until it is joined to another
+    command->next_op = LIST_END;
+    command->next_offset = 0;
+
+    // not looked up as an internal command or builtin yet
+    command->handler = NULL;
+    command->handler_resolved = false;
+    command->builtin = NULL;
+    command->builtin_resolved = false;
+    command->limits = NULL;
+
+    // no process has executed the command yet
+    command->pid = 0;
+    command->exit_status = 0;
+    command->setup_time = 0;
+    command->launch_time = 0;
+    command->start_time = 0;
+    command->end_time = 0;
+    memset(&command->usage, 0, sizeof(command->usage));
+}
+
+
+/**
+ * Takes the tokens which describe a single command and creates a data structure
+ * to represent all the information needed about the command. Each redirection token
+ * takes the token after it as its filename, the remaining tokens are the arguments.
+ * 
+ * @param arena: arena to allocate the command from
+ * @param tokens: tokens of the subcommand
+ * @param num_tokens: number of tokens of the subcommand
+ * @param pipe_in: true if the command reads from the pipe of the command before it
+ * @param pipe_out: true if the command writes to a pipe to the command after it
+ * @return the command, NULL if the command is malformed
+ */ 
+struct command_t *tokens_to_command(struct arena_t *arena, struct token_t *tokens, int num_tokens, bool pipe_in, bool pipe_out) {
+    struct command_t *command = arena_alloc(arena, sizeof(struct command_t));
+    initialize_command(command);
 
     // set command pipe values
-    int pipe_in = (command_position != 0) ? true : false;                  // if command is not first, pipe in
-    int pipe_out = (command_position != num_commands - 1) ? true : false;  // if command is not last, pipe out
     command->pipe_in = pipe_in;
     command->pipe_out = pipe_out;
 
-    // set command file params and check return code if command was malformed
-    rc = set_command_redirections(command, head);
-    if (rc < 0) return ERROR;
+    // every token that is not a redirection or its filename is an argument
+    int num_args = num_tokens;
+    for (int i = 0; i < num_tokens; i++) {
+        if (is_redirection_token(tokens[i].token_type)) num_args -= 2;
+    }
+    if (num_args <= 0) return NULL;
+
+    // token array is null terminated
+    command->tokens = arena_alloc(arena, (num_args + 1) * sizeof(char *));
+
+    int arg = 0;
+    for (int i = 0; i < num_tokens; i++) {
+        if (is_redirection_token(tokens[i].token_type)) {
+            // redirection must be followed by a filename
+            if (i + 1 == num_tokens || tokens[i + 1].token_type != TOKEN_NORMAL) return NULL;
+            if (set_redirection(command, tokens[i + 1].token_text, tokens[i].token_type) < 0) return NULL;
+            i++;
+        } else {
+            command->tokens[arg++] = tokens[i].token_text;
+        }
+    }
+    command->tokens[arg] = NULL;
+
+    // command name is first token in array
+    command->num_tokens = num_args + 1;
+    command->cmd_name = command->tokens[0];
 
-    // set command tokens array
-    set_command_tokens(command, head);
+    // verifies stdout and stdin channels are valid
+    if (!is_valid_command(command)) return NULL;
 
-    return SUCCESS;
+    return command;
 }
 
 
 /**
- * Once the list of tokens is created, this function checks if any redirection is present. If found,
- * the function determines if a filename was provided and what kind of operation should be done on
- * the file (overwrite, append, read). The operation type is stored in the corresponding file token
- * and the redirection token is deleted from the list since it is no longer needed.
+ * Records how a command is joined to the next command of the line by the separator
+ * token that follows it. After a list operator the offset of the next pipeline in
+ * the line is kept so the rest of the line can be parsed again on its own.
  * 
- * @param head: linked list hold tokens of the command
- * @return status which descibes if all redirection was valid
+ * @param command: command the separator follows
+ * @param separator: pipe or list operator token
+ * @param line: copy of the command line the token text points in to
  */ 
-int is_tokens_redirection_valid(struct list_head *head) {
-    struct list_head *curr;
-    struct token_t *token;
-
-    // Loop through all of the tokens to remove redirection tokens
-    for (curr = head->next; curr != head; curr = curr->next) {
-        token = list_entry(curr, struct token_t, list);
-        char *tokstr = token->token_text;
-
-        // if token text is redirection symbol
-        if (is_redirection_text(tokstr)) {
-            // redirection should not be last node is list
-            if (curr->next == head) {
-                return ERROR;
-            } else {
-                // get token after redirection
-                struct token_t *fname_tok = list_entry(curr->next, struct token_t, list);
-
-                // overwrite to file
-                if (strcmp(tokstr, ">") == 0)
-                    fname_tok->token_type = TOKEN_FNAME_OUT_OVERWRITE;
-
-                // append to file
-                else if (strcmp(tokstr, ">>") == 0)
-                    fname_tok->token_type = TOKEN_FNAME_OUT_APPEND;
-
-                // read from file
-                else if (strcmp(tokstr, "<") == 0)
-                    fname_tok->token_type = TOKEN_FNAME_IN;
-
-                // move loop to next node and delete the redirection node
-                struct list_head *next = curr->next;
-                remove_token_node(curr, token);
-                curr = next->prev;
-            }
-        }
+void join_command(struct command_t *command, struct token_t *separator, char *line) {
+    int length;
+
+    switch (separator->token_type) {
+        case TOKEN_PIPE:
+            command->next_op = LIST_PIPE;
+            return;
+        case TOKEN_SEQ:
+            command->next_op = LIST_SEQ;
+            length = 1;
+            break;
+        case TOKEN_AND:
+            command->next_op = LIST_AND;
+            length = 2;
+            break;
+        default:
+            command->next_op = LIST_OR;
+            length = 2;
     }
 
-    return SUCCESS;
+    command->next_offset = (separator->token_text - line) + length;
 }
 
 
 /**
- * Handler when redirection character is encountered by statemachine. This function
- * handles all cases in which a redirection can appear
- *   - no space before or after redirection
- *   - 1 space before or 1 space after redirection
- *   - spaces on both sides of redirection
+ * Driver function for the command parser functionality. Takes a single commmand line
+ * input, copies it in to the arena, tokenizes it and expands its variables. The tokens between each pipe or
+ * list operator are converted to a command structure and added to the array of commands. 
  * 
- * Function extracts redirection token, adds it to token linked list and updates
- * the statemachines next position so that it never sees a redirection character.
+ * When parser finishes, a complete array of commands is populated and ready to be executed by the shell.
+ * The commands live until the arena is reset.
  * 
- * @param sm: state_machine struct
- * @param c: redirection character
- * @param list_tokens: linked list to hold the subcommand being parsed
- * @param cmdline: command input from user
+ * @param arena: arena to allocate the commands from
+ * @param commands_arr: set to the array of command structs
+ * @param cmdline: the command line given by the user that will be parsed
+ * 
+ * @return number of commands, 0 if the line is blank, ERROR if the command line is malformed
  */ 
-void parse_redirection_token(struct state_machine_t *sm, char c, struct list_head *list_tokens, char *cmdline) {
-    // if redirection is found and substring is in statemachine, add substring to list (no space before redirection)
-    if (sm->sub_len != 0) {
-        // add token that precedes redirection to list (ex. cmd [word]> file ) 
-        char *text = sub_string(cmdline, sm->sub_start, sm->sub_len);
-        add_token_node(sm, list_tokens, text);
-    }
-    // redirection out 
-    if (c == '>') {
-        char next_char = cmdline[sm->position + 1];
-
-        // check if redirection is >> by checking next char in string
-        if (next_char == '>') {
-            char *redir_tok = sub_string(cmdline, sm->position, 2);
-            add_token_node(sm, list_tokens, redir_tok);
-            sm->position++; // skip a char since we already added it to list
-        } 
-        // just a single redirection > so add it to list
-        else {
-            char *redir_tok = sub_string(cmdline, sm->position, 1);
-            add_token_node(sm, list_tokens, redir_tok);
-        }
+int parse_command(struct arena_t *arena, struct command_t ***commands_arr, char *cmdline) {
+    struct state_machine_t sm;
 
-    }
-    // redirection in 
-    else {
-        // just a single redirection < so add it to list
-        char *redir_tok = sub_string(cmdline, sm->position, 1);
-        add_token_node(sm, list_tokens, redir_tok);
-    }
-}
+    // tokens are slices of a copy of the line
+    int cmd_len = strlen(cmdline);
+    char *line = arena_strndup(arena, cmdline, cmd_len);
+    tokenizer(&sm, line, cmd_len);
+    expand_tokens(arena, &sm);
 
+    // a ; at the end only ends the last pipeline
+    if (sm.num_tokens > 0 && sm.tokens[sm.num_tokens - 1].token_type == TOKEN_SEQ) sm.num_tokens--;
 
-/**
- * Handler when statemachine is in WHITESPACE state. Checks if the current character
- * is a quote or character - sets state accordingly. If it is neither a character or
- * quote, we encountered another whitespace and the handler does nothing.
- * 
- * @param sm: state_machine struct
- * @param c: character the statemachine is reading
- */ 
-void do_ws(struct state_machine_t *sm, char c) {
-    // if quote character is a quote
-    if (c == '"') {
-        // sub string will begin at next position (we do not want to include the quotes)
-        sm->sub_start = sm->position + 1;
-        // in WHITESPACE state, so this is the first char in substring
-        sm->sub_len = 1;
+    // blank line has no commands
+    *commands_arr = NULL;
+    if (sm.num_tokens == 0) return 0;
 
-        // update state
-        sm->state = QUOTE;
-    } 
-    // character is not space(s) 
-    else if (c != ' ' && c != '\t') {
-        // sub string will begin at current position
-        sm->sub_start = sm->position;
-        // in WHITESPACE state, so this is the first char in substring
-        sm->sub_len = 1;
-        
-        // update state
-        sm->state = CHAR;
+    // count number of commands, one more than the number of pipes and list operators
+    int num_commands = 1;
+    for (int i = 0; i < sm.num_tokens; i++) {
+        if (is_separator_token(sm.tokens[i].token_type)) num_commands++;
     }
-    // otherwise more whitespace was encountered, do nothing
-}
+    struct command_t **commands = arena_alloc(arena, num_commands * sizeof(struct command_t *));
 
+    // convert the tokens between each separator to a command
+    int start = 0;
+    bool pipe_in = false;
+    for (int i = 0; i < num_commands; i++) {
+        int end = start;
+        while (end < sm.num_tokens && !is_separator_token(sm.tokens[end].token_type)) end++;
 
-/**
- * Handler when statemachine is in CHAR state. Checks if the current character
- * is blank space(s) - sets state accordingly. If char is neither a space(s) or
- * newline, we encountered another character. If character is a redirection, the function
- * handles distinguishing the redirection from another token. If not redirection, increment 
- * the substring length and continue.
- * 
- * @param sm: state_machine struct
- * @param c: character the statemachine is reading
- * @param list_tokens: linked list to hold the subcommand being parsed
- * @param cmdline: command input from user
- */ 
-void do_char(struct state_machine_t *sm, char c, struct list_head *list_tokens, char *cmdline) {
-    // is space(s) or newline, we found the end of substring
-    if (c == ' ' || c == '\t' || c == '\0') {
-        // get substring and add argument to list
-        char *text = sub_string(cmdline, sm->sub_start, sm->sub_len);
-        add_token_node(sm, list_tokens, text);
-
-        // update state
-        sm->state = WHITESPACE;
-    }
-    // still inside a substring, increment substring length
-    else{
-        sm->sub_len++;
-    }
-}
+        // only the command before a pipe writes to one
+        struct token_t *separator = (end < sm.num_tokens) ? &sm.tokens[end] : NULL;
+        bool pipe_out = (separator != NULL && separator->token_type == TOKEN_PIPE);
 
+        commands[i] = tokens_to_command(arena, sm.tokens + start, end - start, pipe_in, pipe_out);
+        if (commands[i] == NULL) return ERROR;
+        if (separator != NULL) join_command(commands[i], separator, line);
 
-/**
- * Handler when statemachine is in QUOTE state. Checks if statemachine reached end
- * of substring or command input. If char is neither a quote or newline, we found 
- * the end of a quoted substring.
- * 
- * @param sm: state_machine struct
- * @param c: character the statemachine is reading
- * @param list_tokens: linked list to hold the subcommand being parsed
- * @param cmdline: command input from user
- */ 
-void do_quote(struct state_machine_t *sm, char c, struct list_head *list_tokens, char *cmdline) {
-    // if not quote or end of input, increment substring length
-    if (c != '"' && c != '\0') {
-        sm->sub_len++;
-    } 
-    // we reached the end of quoted substring
-    else if (c == '"') {
-        // get substring and add argument to list
-        char *text = sub_string(cmdline, sm->sub_start, --sm->sub_len);
-        add_token_node(sm, list_tokens, text);
+        // size given to the pipe this command writes to
+        if (pipe_out && separator->token_text != NULL) {
+            commands[i]->pipe_size = parse_size(separator->token_text);
+            if (commands[i]->pipe_size <= 0) return ERROR;
+        }
 
-        // update state
-        sm->state = WHITESPACE;
+        // next subcommand begins after the separator
+        pipe_in = pipe_out;
+        start = end + 1;
     }
+
+    *commands_arr = commands;
+    return num_commands;
 }
 
 
 /**
- * Uses the statemachine pattern to iteratively move through the command line that
- * that given by the user. Based on the character value, the state of the machine is 
- * changed to determine what should be done next. The state machine keeps track of 
- * the length of the cmdline input, its position in the cmdline, the machines state,
- * and positions of each substring that is encountered.
- * 
- * @param list_tokens: linked list to hold the subcommand being parsed
- * @param cmdline: the command that was entered by user
-*/
-void tokenizer(struct state_machine_t *sm, struct list_head *list_tokens, char *cmdline) {
-    // initialize statemachine
-    initialize_statemachine(sm, cmdline);
-
-    // initialize statemachine
-    for (sm->position = 0; sm->position < sm->cmd_len; sm->position++) {
-        // get character the statemachine is looking at
-        char c = cmdline[sm->position];
-
-        // if redirection and not between quotes, parse out
-        if (sm->state != QUOTE && (c == '<' || c == '>')) {
-            parse_redirection_token(sm, c, list_tokens, cmdline);
-        }
-        // not redirection or within quotes
-        else {
-            switch(sm->state) {
-                // character state
-                case CHAR:
-                    do_char(sm, c, list_tokens, cmdline);
-                    break;
-
-                // quote state
-                case QUOTE:
-                    do_quote(sm, c, list_tokens, cmdline);
-                    break;
-
-                // whitespace state
-                default:
-                    do_ws(sm, c);
-            } 
-        }
+ * Removes the first token of a command so the next token becomes the command name, used
+ * for prefixes such as `queue` and `time`. The command name is looked up again.
+ * 
+ * @param command: command to remove the first token of
+ **/ 
+void command_shift(struct command_t *command) {
+    // the null terminator moves with the tokens
+    for (int i = 1; i < command->num_tokens; i++) {
+        command->tokens[i - 1] = command->tokens[i];
     }
+    command->num_tokens--;
+    command->cmd_name = command->tokens[0];
 
-    // Once state machine reaches end, if not in WHITESPACE state then a last substring remains
-    if (sm->state != WHITESPACE) {
-        char *value = sub_string(cmdline, sm->sub_start, sm->position);
-        add_token_node(sm, list_tokens, value);
-    }
+    command->handler = NULL;
+    command->handler_resolved = false;
+    command->builtin = NULL;
+    command->builtin_resolved = false;
 }
 
 
 /**
- * Driver function for the command parser functionality. Takes a single commmand line
- * input, breaks it into an array of subcommands and parses each. Each subcommand is tokenized
- * and converted a command structure and added to the array of commands. 
- * 
- * When parser finishes, a complete array of commands is populated and ready to be executed by the shell.
+ * Copies a command out of the arena so it outlives the command line it was parsed from.
+ * The struct, token array and strings are copied in to a single allocation which is 
+ * released with one call to free.
  * 
- * @param commands_arr: array to hold command stucts
- * @param num_commands: number of subcommands to parse
- * @param cmdline: the command line given by the user that will be parsed
- * 
- * @return status of command parsing
+ * @param command: command to copy
+ * @return the copy
  */ 
-int parse_command(struct command_t *commands_arr[], int num_commands, char *cmdline) {
-    int rc;
-
-    // split command line by pipes and store sub commands in array
-    char **subcommands_arr = malloc(sizeof(char *) * num_commands); 
-    split_cmdline(subcommands_arr, cmdline);
-
-    // create statemachine for parser
-    struct state_machine_t *sm = malloc(sizeof(struct state_machine_t));
-
-
-    // parse each subcommands
-    for (int i = 0; i < num_commands; i++) {
-        // Initialize token list for sub command
-        LIST_HEAD(list_tokens);
-
-
-        // build list of tokens and verify redirection is valid
-        tokenizer(sm, &list_tokens, subcommands_arr[i]);
-        rc = is_tokens_redirection_valid(&list_tokens);
-        if (rc < 0) return ERROR;
-
-
-        // translate token list to subcommand structure
-        struct command_t *command = malloc(sizeof(struct command_t));
-        rc = tokens_to_command(command, &list_tokens, i, num_commands);
-        if (rc < 0) return ERROR;
-        
-
-        // verifies stdout and stdin channels are valid
-        if (!is_valid_command(command)) return ERROR;
-
-
-        // command is built and valid, add to array of commands
-        commands_arr[i] = command;
-
-        // free token list for parsed subcommand before next iteration
-        clear_list(&list_tokens);
+struct command_t *command_clone(struct command_t *command) {
+    // size of the struct, the token array and every string
+    size_t size = sizeof(struct command_t) + command->num_tokens * sizeof(char *);
+    for (int i = 0; command->tokens[i] != NULL; i++) {
+        size += strlen(command->tokens[i]) + 1;
+    }
+    if (command->infile != NULL) size += strlen(command->infile) + 1;
+    if (command->outfile != NULL) size += strlen(command->outfile) + 1;
+
+    struct command_t *clone = malloc(size);
+    *clone = *command;
+    clone->tokens = (char **)(clone + 1);
+
+    // strings are packed after the token array
+    char *next = (char *)(clone->tokens + command->num_tokens);
+    for (int i = 0; i < command->num_tokens; i++) {
+        if (command->tokens[i] == NULL) {
+            clone->tokens[i] = NULL;
+            continue;
+        }
+        clone->tokens[i] = strcpy(next, command->tokens[i]);
+        next += strlen(next) + 1;
+    }
+    if (command->infile != NULL) {
+        clone->infile = strcpy(next, command->infile);
+        next += strlen(next) + 1;
+    }
+    if (command->outfile != NULL) {
+        clone->outfile = strcpy(next, command->outfile);
     }
 
-    parser_clean_up(sm, subcommands_arr, num_commands);
+    clone->cmd_name = clone->tokens[0];
+    return clone;
+}
 
-    return SUCCESS;
-}
\ No newline at end of file
+
+/**
+ * Counts the memory held by the parser between command lines, the token buffer
+ * is kept for the next line
+ * 
+ * @param usage: counters to add to
+ **/ 
+void parser_memory(struct mem_usage_t *usage) {
+    mem_count(usage, token_buffer);
+}
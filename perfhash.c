@@ -0,0 +1,86 @@
+/**
+ * @file: perfhash.c
+ * @author: Andrew Kress
+ *
+ * @brief: Perfect hash tables of command names.
+ *
+ * The internal commands and builtins are checked for every command line. They are a
+ * fixed set of names, so instead of comparing the name with each of them a table is
+ * built once where the hash of each name lands in a slot of its own. Finding a name
+ * is then one hash of the name and at most one string compare.
+ */
+
+#include <string.h>
+
+#include "runner.h"
+#include "perfhash.h"
+
+
+// most seeds tried before giving up on building a table
+#define PERFHASH_MAX_SEEDS 100000
+
+
+/**
+ * Hashes a name with FNV-1a starting from the seed of the table
+ *
+ * @param seed - Seed of the table
+ * @param name - Name to hash
+ * @return slot of the name
+ **/
+unsigned int perfhash_slot(unsigned int seed, char *name) {
+    unsigned int hash = seed;
+    for (char *c = name; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return (hash ^ (hash >> 16)) & (PERFHASH_SLOTS - 1);
+}
+
+
+/**
+ * Builds a table from an array of names and values. Seeds of the hash function are tried
+ * until one gives every name a slot of its own.
+ *
+ * @param table - Table to build
+ * @param names - Names to add
+ * @param values - Value of each name
+ * @param count - Number of names
+ * @return SUCCESS or ERROR if no seed gives each name its own slot
+ **/
+int perfhash_build(struct perfhash_t *table, char **names, void **values, int count) {
+    for (unsigned int seed = 2166136261u; seed < 2166136261u + PERFHASH_MAX_SEEDS; seed++) {
+        memset(table->slots, 0, sizeof(table->slots));
+        table->seed = seed;
+
+        // place names until two share a slot
+        int i;
+        for (i = 0; i < count; i++) {
+            struct perfhash_slot_t *slot = &table->slots[perfhash_slot(seed, names[i])];
+            if (slot->name != NULL) break;
+
+            slot->name = names[i];
+            slot->value = values[i];
+        }
+
+        if (i == count) {
+            table->built = true;
+            return SUCCESS;
+        }
+    }
+
+    return ERROR;
+}
+
+
+/**
+ * Returns the value of a name
+ *
+ * @param table - Table to look in
+ * @param name - Name to look up
+ * @return value of the name, NULL if the name is not in the table
+ **/
+void *perfhash_lookup(struct perfhash_t *table, char *name) {
+    struct perfhash_slot_t *slot = &table->slots[perfhash_slot(table->seed, name)];
+
+    if (slot->name != NULL && strcmp(slot->name, name) == 0) return slot->value;
+    return NULL;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file: perfhash.h
+ * @author: Andrew Kress
+ *
+ * @brief: Header file for perfect hash tables of command names
+ *
+ * Defines a table built once from a fixed set of names in which every name has a slot
+ * of its own, so a lookup hashes the name and compares it with a single entry.
+ */
+
+#include <stdbool.h>
+
+#ifndef PERFHASH_H
+#define PERFHASH_H
+
+// number of slots in a table, a power of two at least twice the number of names
+#define PERFHASH_SLOTS 64
+
+// slot holding a name and the value it maps to
+struct perfhash_slot_t {
+    char *name;
+    void *value;
+};
+
+// table of names where no two names share a slot
+struct perfhash_t {
+    unsigned int seed;
+    bool built;
+    struct perfhash_slot_t slots[PERFHASH_SLOTS];
+};
+
+/**
+ * Builds a table from an array of names and values. Seeds of the hash function are tried
+ * until one gives every name a slot of its own.
+ *
+ * @param table - Table to build
+ * @param names - Names to add
+ * @param values - Value of each name
+ * @param count - Number of names
+ * @return SUCCESS or ERROR if no seed gives each name its own slot
+ **/
+int perfhash_build(struct perfhash_t *table, char **names, void **values, int count);
+
+/**
+ * Returns the value of a name
+ *
+ * @param table - Table to look in
+ * @param name - Name to look up
+ * @return value of the name, NULL if the name is not in the table
+ **/
+void *perfhash_lookup(struct perfhash_t *table, char *name);
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ * @file: profile.c
+ * @author: Michael Permyashkin
+ * 
+ * @brief: Measures the time and resources command lines use
+ * 
+ * A command line is profiled when it is prefixed with `time` or when SUSH_PROFILE is set to 1.
+ * While it runs the shell adds the time spent parsing and waiting to the phases of the profile
+ * and the executor records in each command when it was started, how long opening redirections
+ * and starting the process took, when it was reaped and the resources wait4 reported for it.
+ * 
+ * Once the line finished, a timed line prints a report on stderr and a profiled line writes one
+ * JSON object on a single line to the file descriptor in SUSH_PROFILE_FD, stderr by default, so
+ * results can be collected from many shells.
+ */ 
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "runner.h"
+#include "profile.h"
+#include "environ.h"
+#include "error.h"
+
+
+// environment variables that turn profiling on and select where reports go
+#define PROFILE_VAR "SUSH_PROFILE"
+#define PROFILE_FD_VAR "SUSH_PROFILE_FD"
+
+
+// profile of the command line being run
+static bool active = false;
+static bool timed = false;
+static double start_time;
+static double phases[PROFILE_NUM_PHASES];
+static struct rusage start_usage;
+
+
+/**
+ * Returns the current time of a monotonic clock in seconds
+ * 
+ * @return seconds since an arbitrary point
+ **/
+double profile_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Converts a time of a rusage struct to seconds
+ * 
+ * @param tv - Time to convert
+ * @return seconds
+ **/
+double timeval_to_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/**
+ * Checks if every command line is profiled
+ * 
+ * @return true if SUSH_PROFILE is set to 1
+ **/
+bool profile_enabled() {
+    struct environ_var_t *var = environ_get_var(PROFILE_VAR);
+    return var != NULL && strcmp(var->value, "1") == 0;
+}
+
+
+/**
+ * Starts profiling a command line if SUSH_PROFILE is set to 1
+ * 
+ * @param line_start: time the shell started on the line, from profile_now
+ * @return true if the command line is profiled
+ **/
+bool profile_begin(double line_start) {
+    active = profile_enabled();
+    timed = false;
+    if (!active) return false;
+
+    start_time = line_start;
+    memset(phases, 0, sizeof(phases));
+    getrusage(RUSAGE_SELF, &start_usage);
+    return true;
+}
+
+
+/**
+ * Marks the command line as timed by the `time` prefix, which prints a report on stderr
+ * once it finished. The prefix is only seen after parsing so the line is timed from
+ * when the shell started on it.
+ * 
+ * @param line_start: time the shell started on the line, from profile_now
+ **/
+void profile_set_timed(double line_start) {
+    if (!active) {
+        active = true;
+        start_time = line_start;
+        memset(phases, 0, sizeof(phases));
+        getrusage(RUSAGE_SELF, &start_usage);
+    }
+    timed = true;
+}
+
+
+/**
+ * Checks if the command line being run is profiled
+ * 
+ * @return true if profiling
+ **/
+bool profile_active() {
+    return active;
+}
+
+
+/**
+ * Adds the time since start to a phase of the command line being profiled
+ * 
+ * @param phase: phase the time was spent in
+ * @param start: time the phase started at, from profile_now
+ **/
+void profile_add(enum profile_phase_e phase, double start) {
+    if (active) phases[phase] += profile_now() - start;
+}
+
+
+/**
+ * Writes a string as a JSON string with quotes and escapes
+ * 
+ * @param out: stream to write to
+ * @param str: string to write
+ **/
+void write_json_string(FILE *out, char *str) {
+    fputc('"', out);
+    for (char *c = str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') fprintf(out, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20) fprintf(out, "\\u%04x", *c);
+        else fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+
+/**
+ * Gets the time and resources a command used. An internal command that is the whole
+ * line reports what the shell used while the line ran, a builtin or a stage run in the
+ * shell has what the shell used while it ran recorded by the executor.
+ * 
+ * @param command: command to get resources of
+ * @param internal: true if the command ran in the shell
+ * @param end_time: time the line finished
+ * @param times: set to the wall, user and system time of the command in seconds
+ * @return max resident set size in kilobytes
+ **/
+long command_usage(struct command_t *command, bool internal, double end_time, double times[3]) {
+    if (internal) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        times[0] = end_time - start_time;
+        times[1] = timeval_to_seconds(usage.ru_utime) - timeval_to_seconds(start_usage.ru_utime);
+        times[2] = timeval_to_seconds(usage.ru_stime) - timeval_to_seconds(start_usage.ru_stime);
+        return usage.ru_maxrss;
+    }
+
+    times[0] = (command->end_time > 0) ? command->end_time - command->start_time : 0;
+    times[1] = timeval_to_seconds(command->usage.ru_utime);
+    times[2] = timeval_to_seconds(command->usage.ru_stime);
+    return command->usage.ru_maxrss;
+}
+
+
+/**
+ * Writes the profile of a command line as a single JSON line to the profile descriptor
+ * 
+ * @param cmdline: the command line that ran
+ * @param commands_arr: commands of the line
+ * @param num_commands: number of commands
+ * @param internal: true if the line ran an internal command in the shell
+ * @param status: exit status of the line
+ * @param end_time: time the line finished
+ **/
+void write_profile_json(char *cmdline, struct command_t **commands_arr, int num_commands, bool internal, int status, double end_time) {
+    struct environ_var_t *fd_var = environ_get_var(PROFILE_FD_VAR);
+    int fd = (fd_var != NULL) ? atoi(fd_var->value) : STDERR_FILENO;
+
+    double setup = 0, launch = 0;
+    for (int i = 0; i < num_commands; i++) {
+        setup += commands_arr[i]->setup_time;
+        launch += commands_arr[i]->launch_time;
+    }
+
+    // build the line in memory so it is written with a single write
+    char *json;
+    size_t length;
+    FILE *out = open_memstream(&json, &length);
+
+    fprintf(out, "{\"cmdline\":");
+    write_json_string(out, cmdline);
+    fprintf(out, ",\"status\":%d,\"real_us\":%.0f,\"parse_us\":%.0f,\"setup_us\":%.0f,\"launch_us\":%.0f,\"wait_us\":%.0f,\"stages\":[",
+        status, (end_time - start_time) * 1e6, phases[PROFILE_PARSE] * 1e6, setup * 1e6, launch * 1e6, phases[PROFILE_WAIT] * 1e6);
+
+    for (int i = 0; i < num_commands; i++) {
+        double times[3];
+        long maxrss = command_usage(commands_arr[i], internal, end_time, times);
+
+        if (i > 0) fputc(',', out);
+        fprintf(out, "{\"cmd\":");
+        write_json_string(out, commands_arr[i]->cmd_name);
+        fprintf(out, ",\"pid\":%d,\"status\":%d,\"real_us\":%.0f,\"user_us\":%.0f,\"sys_us\":%.0f,\"maxrss_kb\":%ld}",
+            (int)commands_arr[i]->pid, commands_arr[i]->exit_status, times[0] * 1e6, times[1] * 1e6, times[2] * 1e6, maxrss);
+
+        // an internal command only runs the first command
+        if (internal) break;
+    }
+    fprintf(out, "]}\n");
+    fclose(out);
+
+    write(fd, json, length);
+    free(json);
+}
+
+
+/**
+ * Prints the profile of a timed command line on stderr, one line per command and a
+ * line with the total and the time the shell spent in each phase
+ * 
+ * @param commands_arr: commands of the line
+ * @param num_commands: number of commands
+ * @param internal: true if the line ran an internal command in the shell
+ * @param end_time: time the line finished
+ **/
+void print_profile(struct command_t **commands_arr, int num_commands, bool internal, double end_time) {
+    double setup = 0, launch = 0;
+
+    for (int i = 0; i < num_commands; i++) {
+        double times[3];
+        long maxrss = command_usage(commands_arr[i], internal, end_time, times);
+
+        LOG_ERROR(MSG_TIME_STAGE, i, commands_arr[i]->cmd_name, times[0], times[1], times[2], maxrss, commands_arr[i]->exit_status);
+
+        setup += commands_arr[i]->setup_time;
+        launch += commands_arr[i]->launch_time;
+
+        // an internal command only runs the first command
+        if (internal) break;
+    }
+
+    LOG_ERROR(MSG_TIME_TOTAL, end_time - start_time, phases[PROFILE_PARSE], setup, launch, phases[PROFILE_WAIT]);
+}
+
+
+/**
+ * Ends profiling of the command line and reports it. A timed line prints a report on
+ * stderr, with SUSH_PROFILE=1 a JSON line is written to the descriptor in SUSH_PROFILE_FD.
+ * 
+ * @param cmdline: the command line that ran
+ * @param commands_arr: commands of the line
+ * @param num_commands: number of commands
+ * @param internal: true if the line ran an internal command in the shell
+ * @param status: exit status of the line
+ **/
+void profile_end(char *cmdline, struct command_t **commands_arr, int num_commands, bool internal, int status) {
+    if (!active) return;
+    active = false;
+
+    double end_time = profile_now();
+
+    if (timed) print_profile(commands_arr, num_commands, internal, end_time);
+    if (profile_enabled()) write_profile_json(cmdline, commands_arr, num_commands, internal, status, end_time);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file: profile.h
+ * @author: Michael Permyashkin
+ * 
+ * @brief: Header file for timing and resource use of command lines
+ * 
+ * Defines functions to profile a command line when it is prefixed with `time` or when
+ * SUSH_PROFILE is set to 1. The time the shell spends in each phase is collected while the
+ * line runs and reported with the wall time and resources of every command once it finished.
+ */ 
+
+#include <stdbool.h>
+
+#include "runner.h"
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// phases of running a command line the shell spends time in
+enum profile_phase_e {
+    PROFILE_PARSE,
+    PROFILE_WAIT,
+    PROFILE_NUM_PHASES
+};
+
+/**
+ * Returns the current time of a monotonic clock in seconds
+ * 
+ * @return seconds since an arbitrary point
+ **/
+double profile_now();
+
+/**
+ * Starts profiling a command line if SUSH_PROFILE is set to 1
+ * 
+ * @param line_start: time the shell started on the line, from profile_now
+ * @return true if the command line is profiled
+ **/
+bool profile_begin(double line_start);
+
+/**
+ * Marks the command line as timed by the `time` prefix, which prints a report on stderr
+ * once it finished
+ * 
+ * @param line_start: time the shell started on the line, from profile_now
+ **/
+void profile_set_timed(double line_start);
+
+/**
+ * Checks if the command line being run is profiled
+ * 
+ * @return true if profiling
+ **/
+bool profile_active();
+
+/**
+ * Adds the time since start to a phase of the command line being profiled
+ * 
+ * @param phase: phase the time was spent in
+ * @param start: time the phase started at, from profile_now
+ **/
+void profile_add(enum profile_phase_e phase, double start);
+
+/**
+ * Ends profiling of the command line and reports it. A timed line prints a report on
+ * stderr, with SUSH_PROFILE=1 a JSON line is written to the descriptor in SUSH_PROFILE_FD.
+ * 
+ * @param cmdline: the command line that ran
+ * @param commands_arr: commands of the line
+ * @param num_commands: number of commands
+ * @param internal: true if the line ran an internal command in the shell
+ * @param status: exit status of the line
+ **/
+void profile_end(char *cmdline, struct command_t **commands_arr, int num_commands, bool internal, int status);
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * @file: reader.c
+ * @author: Andrew Kress
+ * 
+ * @brief: Reads lines of input of any length
+ * 
+ * Input is read from the file descriptor in large blocks in to a buffer that is reused for
+ * every line. A line is handed out as a slice of the buffer which is terminated in place, so
+ * once the buffer is as large as the longest line no line needs an allocation or a copy. Input
+ * that has not been returned yet is moved to the front of the buffer before more is read and
+ * the buffer only grows when a single line does not fit.
+ * 
+ * A backslash right before a newline continues the line, the backslash and newline are
+ * removed by moving the start of the line forward over them.
+ */ 
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "reader.h"
+
+
+// size of the buffer when the first input is read, each read asks for what fits
+#define READER_BLOCK 65536
+
+
+/**
+ * Initializes a reader of the given file descriptor. The buffer is allocated on the
+ * first read.
+ * 
+ * @param reader: reader to initialize
+ * @param fd: file descriptor to read lines from
+ **/
+void reader_init(struct line_reader_t *reader, int fd) {
+    reader->fd = fd;
+    reader->buffer = NULL;
+    reader->capacity = 0;
+    reader->start = 0;
+    reader->end = 0;
+    reader->eof = false;
+}
+
+
+/**
+ * Makes room at the end of the buffer by moving the input not yet returned to the front,
+ * or doubling the buffer when it is full of a single line
+ * 
+ * @param reader: reader to make room in
+ * @return number of bytes the input not yet returned moved towards the front
+ **/
+size_t reader_make_room(struct line_reader_t *reader) {
+    size_t moved = reader->start;
+
+    // move input not yet returned to the front
+    if (moved > 0) {
+        memmove(reader->buffer, reader->buffer + moved, reader->end - moved);
+        reader->end -= moved;
+        reader->start = 0;
+    }
+
+    // buffer is full of one line, grow it
+    if (reader->end == reader->capacity) {
+        reader->capacity = (reader->capacity == 0) ? READER_BLOCK : reader->capacity * 2;
+        reader->buffer = realloc(reader->buffer, reader->capacity);
+    }
+
+    return moved;
+}
+
+
+/**
+ * Reads as much input as fits in the buffer with one read
+ * 
+ * @param reader: reader to read in to
+ **/
+void reader_fill(struct line_reader_t *reader) {
+    while (true) {
+        ssize_t bytes = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        if (bytes < 0 && errno == EINTR) continue;
+
+        // end of input or an error, no more input will be read
+        if (bytes <= 0) {
+            reader->eof = true;
+            return;
+        }
+
+        reader->end += bytes;
+        return;
+    }
+}
+
+
+/**
+ * Returns the next line without its newline. Lines ending in a backslash are joined
+ * with the line after them. The line is held in the readers buffer and is only valid 
+ * until the next call.
+ * 
+ * @param reader: reader to read from
+ * @return the line, NULL once all input was read
+ **/
+char *reader_next_line(struct line_reader_t *reader) {
+    // input before scan is known to hold no newline
+    size_t scan = reader->start;
+
+    while (true) {
+        char *newline = (scan < reader->end) ? memchr(reader->buffer + scan, '\n', reader->end - scan) : NULL;
+
+        if (newline != NULL) {
+            size_t pos = newline - reader->buffer;
+
+            // backslash newline continues the line, move the line over the two characters
+            if (pos > reader->start && reader->buffer[pos - 1] == '\\') {
+                memmove(reader->buffer + reader->start + 2, reader->buffer + reader->start, pos - 1 - reader->start);
+                reader->start += 2;
+                scan = pos + 1;
+                continue;
+            }
+
+            // terminate line in place and return it
+            *newline = '\0';
+            char *line = reader->buffer + reader->start;
+            reader->start = pos + 1;
+            return line;
+        }
+        scan = reader->end;
+
+        // last line of input may not end in a newline
+        if (reader->eof) {
+            if (reader->start == reader->end) return NULL;
+            if (reader->end == reader->capacity) scan -= reader_make_room(reader);
+
+            reader->buffer[reader->end] = '\0';
+            char *line = reader->buffer + reader->start;
+            reader->start = reader->end;
+            return line;
+        }
+
+        // read more input after the input already buffered
+        scan -= reader_make_room(reader);
+        reader_fill(reader);
+    }
+}
+
+
+/**
+ * Checks if input was read that has not been returned as a line yet, the next line
+ * may then be available without reading the file descriptor
+ * 
+ * @param reader: reader to check
+ * @return true if input is buffered
+ **/
+bool reader_has_buffered(struct line_reader_t *reader) {
+    return reader->start < reader->end;
+}
+
+
+/**
+ * Frees the buffer of the reader. The file descriptor is not closed.
+ * 
+ * @param reader: reader to free
+ **/
+void reader_free(struct line_reader_t *reader) {
+    free(reader->buffer);
+    reader->buffer = NULL;
+    reader->capacity = 0;
+    reader->start = 0;
+    reader->end = 0;
+}
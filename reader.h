@@ -0,0 +1,65 @@
+/**
+ * @file: reader.h
+ * @author: Andrew Kress
+ * 
+ * @brief: Header file for the line reader
+ * 
+ * Defines the line reader which reads input from a file descriptor in large blocks in to a
+ * buffer it owns and hands out one line at a time. Lines may be any length and a backslash at
+ * the end of a line joins it with the next line.
+ */ 
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef READER_H
+#define READER_H
+
+// reader of lines from a file descriptor
+struct line_reader_t {
+    int fd;
+
+    char *buffer;       // input read from the file descriptor
+    size_t capacity;
+    size_t start;       // start of input not yet returned as a line
+    size_t end;         // end of input read so far
+
+    bool eof;           // file descriptor has no more input
+};
+
+/**
+ * Initializes a reader of the given file descriptor. The buffer is allocated on the
+ * first read.
+ * 
+ * @param reader: reader to initialize
+ * @param fd: file descriptor to read lines from
+ **/
+void reader_init(struct line_reader_t *reader, int fd);
+
+/**
+ * Returns the next line without its newline. Lines ending in a backslash are joined
+ * with the line after them. The line is held in the readers buffer and is only valid 
+ * until the next call.
+ * 
+ * @param reader: reader to read from
+ * @return the line, NULL once all input was read
+ **/
+char *reader_next_line(struct line_reader_t *reader);
+
+/**
+ * Checks if input was read that has not been returned as a line yet, the next line
+ * may then be available without reading the file descriptor
+ * 
+ * @param reader: reader to check
+ * @return true if input is buffered
+ **/
+bool reader_has_buffered(struct line_reader_t *reader);
+
+/**
+ * Frees the buffer of the reader. The file descriptor is not closed.
+ * 
+ * @param reader: reader to free
+ **/
+void reader_free(struct line_reader_t *reader);
+
+#endif
@@ -9,6 +9,10 @@
  * interface for processing. Function `do_command` drives processing by
  * calling the parser to build command data structures and then determining
  * which execution unit should handle the command(s).
+ * 
+ * The pipelines of a line joined by `;`, `&&` and `||` are run in turn from the single
+ * parse of the line. `&&` and `||` decide on the exit status of the pipeline that ran
+ * last, a pipeline that is skipped keeps that status for the next operator.
  */ 
 
 #include <stdio.h>
@@ -21,58 +25,149 @@
 #include "executor.h"
 #include "environ.h"
 #include "background.h"
+#include "parsecache.h"
+#include "profile.h"
+
+
+// size of each block of the arena that holds the commands of a command line
+#define CMDLINE_ARENA_BLOCK 16384
+
+// arena holding the commands of the command line being executed, reset after each line
+static struct arena_t cmdline_arena = { .block_size = CMDLINE_ARENA_BLOCK };
+
+
+/**
+ * Parses a size such as `512`, `64K`, `1M` or `4G` into a number of bytes
+ * 
+ * @param str - The size to parse
+ * @return number of bytes, negative if the size is invalid
+ */
+long parse_size(char *str) {
+    char *end;
+    long size = strtol(str, &end, 10);
+    if (end == str || size < 0) return ERROR;
+
+    // optional binary unit suffix
+    switch (*end) {
+        case 'k': case 'K': size <<= 10; end++; break;
+        case 'm': case 'M': size <<= 20; end++; break;
+        case 'g': case 'G': size <<= 30; end++; break;
+    }
+
+    if (*end != '\0') return ERROR;
+    return size;
+}
 
 
 /**
- * frees all allocated memory to hold command structures. Checks if command
- * is in queue before freeing the command structure to prevent a double free
- * when item is removed from queue.
+ * Removes the `time` prefix from the first command of a line so the command it
+ * prefixes runs in its place
  * 
- * @param commands_arr: array of command structures to free
- * @param num_commands: number of command structures present
+ * @param command: first command of the line
+ * 
+ * @return: SUCCESS, ERROR if time was not followed by a command
  */ 
-void runner_clean_up(struct command_t *commands_arr[], int num_commands) {
-    for (int i=0; i<num_commands; i++) {
-
-        // only free commands not in queue
-        if (!is_command_in_queue(commands_arr[i])) {
-            // free each token in array
-            int num_toks = commands_arr[i]->num_tokens;
-            for (int j=0;j<num_toks; j++ ) {
-                free(commands_arr[i]->tokens[j]);
-            }
-            // free token array
-            free(commands_arr[i]->tokens);
-
-            // free filename fields
-            free(commands_arr[i]->outfile);
-            free(commands_arr[i]->infile);
-            
-            // free command struct
-            free(commands_arr[i]);
-        }
+int remove_time_prefix(struct command_t *command) {
+    if (command->num_tokens <= 2) {
+        LOG_ERROR(ERROR_TIME_ARG);
+        return ERROR;
     }
+
+    command_shift(command);
+    return SUCCESS;
 }
 
 
 /**
- * Counts the number of subcommands present in a given command line. Each time
- * a pipe is encountered we incremenet the counter and return the final value.
+ * Parses the command line input without executing it, used to check scripts
  * 
- * @param cmdline: the command that was entered by user
+ * @param cmdline: the command line to check
  * 
- * @return: interger value of the number of subcommands found
+ * @return: SUCCESS if the command line is valid, ERROR if it is malformed
  */ 
-int get_num_subcommands(char *cmdline) {
-    int count = 1;
-    int cmd_len = strlen(cmdline);
+int check_command(char *cmdline) {
+    struct command_t **commands_arr;
+
+    int num_commands = parse_command(&cmdline_arena, &commands_arr, cmdline);
+    arena_reset(&cmdline_arena);
+
+    if (num_commands < 0) {
+        LOG_ERROR(ERROR_INVALID_CMDLINE);
+        return ERROR;
+    }
+    return SUCCESS;
+}
 
-    for (int i=0; i<cmd_len; i++) {
-        if (cmdline[i] == '|') {
-            count++;
+
+/**
+ * Runs a single pipeline with the execution unit appropriate for it. An internal command
+ * that is the whole pipeline runs in the shell.
+ * 
+ * @param commands_arr: commands of the pipeline
+ * @param num_commands: number of commands of the pipeline
+ * 
+ * @return: status of the pipeline execution
+ */ 
+int run_pipeline(struct command_t **commands_arr, int num_commands) {
+    // internal commands in a pipeline are run by the executor
+    if (num_commands == 1 && is_internal_command(commands_arr[0])) {
+        return execute_shell_command(commands_arr[0]);
+    }
+    return execute_external_command(commands_arr, num_commands);
+}
+
+
+/**
+ * Runs the pipelines of a command line in turn. A pipeline after `;` always runs, after `&&`
+ * only if the exit status is 0 and after `||` only if it is not.
+ * 
+ * Variables were expanded when the line was parsed. If a pipeline that ran changed the
+ * environment, the rest of the line is parsed again when it holds a $ so it sees the change.
+ * 
+ * @param cmdline: the command line the commands were parsed from
+ * @param commands_arr: commands of every pipeline of the line
+ * @param num_commands: number of commands
+ * 
+ * @return: status of the last pipeline that ran, EXIT_SHELL as soon as exit runs
+ */ 
+int run_list(char *cmdline, struct command_t **commands_arr, int num_commands) {
+    unsigned long generation = environ_generation();
+    bool run = true;
+    int rc = SUCCESS;
+
+    for (int start = 0; start < num_commands; ) {
+        // the pipeline ends at the first command not piped to the next
+        int end = start;
+        while (end < num_commands - 1 && commands_arr[end]->next_op == LIST_PIPE) end++;
+
+        if (run) {
+            rc = run_pipeline(commands_arr + start, end - start + 1);
+            if (rc == EXIT_SHELL) return rc;
+        }
+
+        struct command_t *last = commands_arr[end];
+        if (last->next_op == LIST_END) break;
+
+        // skipped pipelines leave the status of the one that ran before them
+        int status = executor_last_status();
+        run = (last->next_op == LIST_SEQ) || ((last->next_op == LIST_AND) == (status == 0));
+        start = end + 1;
+
+        // rest of the line expands the variables as they are now, offsets are from its start
+        char *rest = cmdline + last->next_offset;
+        if (environ_generation() != generation && strchr(rest, '$') != NULL) {
+            cmdline = rest;
+            num_commands = parse_command(&cmdline_arena, &commands_arr, cmdline);
+            if (num_commands < 0) {
+                LOG_ERROR(ERROR_INVALID_CMDLINE);
+                return ERROR;
+            }
+            generation = environ_generation();
+            start = 0;
         }
     }
-    return count;
+
+    return rc;
 }
 
 
@@ -86,26 +181,63 @@ int get_num_subcommands(char *cmdline) {
 int do_command(char *cmdline) {
     int rc;
 
-    // count number of commands and allocate memory to hold n command stucts
-    int num_commands = get_num_subcommands(cmdline);
-    struct command_t *commands_arr[num_commands];
+    struct command_t **commands_arr;
 
-    // parse commands to populate array of command structs
-    rc = parse_command(commands_arr, num_commands, cmdline);
-    if (rc < 0) {
-        LOG_ERROR(ERROR_INVALID_CMDLINE);
-        return rc;
+    // profiling starts before the parse, a time prefix is only found after it
+    double parse_start = profile_now();
+    profile_begin(parse_start);
+
+    // copy commands of a line parsed before, otherwise parse and remember them
+    int num_commands = parsecache_lookup(&cmdline_arena, &commands_arr, cmdline);
+    if (num_commands < 0) {
+        num_commands = parse_command(&cmdline_arena, &commands_arr, cmdline);
+        if (num_commands < 0) {
+            LOG_ERROR(ERROR_INVALID_CMDLINE);
+            arena_reset(&cmdline_arena);
+            return num_commands;
+        }
+        if (num_commands > 0) {
+            // remembered commands keep their handler so a hit needs no lookup
+            is_internal_command(commands_arr[0]);
+            parsecache_insert(cmdline, commands_arr, num_commands);
+        }
     }
 
-    // call respective execution unit
-    if (is_internal_command(commands_arr[0])) {
-        rc = execute_internal_command(commands_arr[0]);
-    } else {
-        rc = execute_external_command(commands_arr, num_commands);
+    // blank line, nothing to execute
+    if (num_commands == 0) {
+        arena_reset(&cmdline_arena);
+        return SUCCESS;
     }
 
+    // time prefix profiles the rest of the line
+    if (strcmp(commands_arr[0]->cmd_name, "time") == 0) {
+        if (remove_time_prefix(commands_arr[0]) < 0) {
+            arena_reset(&cmdline_arena);
+            return ERROR;
+        }
+        profile_set_timed(parse_start);
+    }
+    profile_add(PROFILE_PARSE, parse_start);
+
+    // run each pipeline of the line with the respective execution unit
+    bool internal = (num_commands == 1) && is_internal_command(commands_arr[0]);
+    rc = run_list(cmdline, commands_arr, num_commands);
+
+    // report the line if profiled
+    profile_end(cmdline, commands_arr, num_commands, internal, executor_last_status());
+
     // release all memory allocated to hold commands
-    runner_clean_up(commands_arr, num_commands);
+    arena_reset(&cmdline_arena);
 
     return rc;
-}
\ No newline at end of file
+}
+
+
+/**
+ * Counts the memory held by the arena of the command line being executed
+ * 
+ * @param usage: counters to add to
+ **/ 
+void runner_memory(struct mem_usage_t *usage) {
+    arena_memory(&cmdline_arena, usage);
+}
@@ -12,8 +12,12 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <sys/types.h>
+#include <sys/resource.h>
 
 #include "list.h"
+#include "arena.h"
+#include "memstat.h"
 
 #ifndef RUNNER_H
 #define RUNNER_H
@@ -33,6 +37,19 @@ enum redirect_type_e {
     FILE_OUT_APPEND
 };
 
+// How a command is joined to the command after it. Commands joined by pipes form a
+// pipeline, the pipelines of a line are joined by list operators.
+enum list_op_e {
+    LIST_END,       // last command of the line
+    LIST_PIPE,      // | the next command reads the output of this one
+    LIST_SEQ,       // ; the next pipeline runs after this one
+    LIST_AND,       // && the next pipeline runs if this one succeeded
+    LIST_OR         // || the next pipeline runs if this one failed
+};
+
+struct job_limits_t;
+struct builtin_t;
+
 // The command data structure which holds all information needed by the shell to execute the command
 struct command_t {
     char *cmd_name;
@@ -41,6 +58,10 @@ struct command_t {
 
     int pipe_in;
     int pipe_out;
+    long pipe_size;     // capacity of the pipe the command writes to, 0 for the default
+
+    enum list_op_e next_op;
+    int next_offset;    // offset in the command line of the pipeline after a list operator
 
     enum redirect_type_e file_in;
     char *infile;
@@ -49,6 +70,27 @@ struct command_t {
     enum redirect_type_e file_out;
     char *outfile;
     int fid_out;
+
+    pid_t pid;
+    int exit_status;
+
+    // handler of an internal command, looked up once by is_internal_command
+    int (*handler)(struct command_t *cmd);
+    bool handler_resolved;
+
+    // builtin of the same name, enabled or not, looked up once by builtin_find
+    struct builtin_t *builtin;
+    bool builtin_resolved;
+
+    // resources a queued job is limited to, NULL if it is not limited
+    struct job_limits_t *limits;
+
+    // filled in by the executor for profiling, times are in seconds
+    double setup_time;      // opening redirections and finding the executable
+    double launch_time;     // starting the process
+    double start_time;      // when the process was started
+    double end_time;        // when the process was reaped
+    struct rusage usage;    // resources used by the process
 };
 
 /**
@@ -61,6 +103,14 @@ struct command_t {
  */
 char * sub_string(char* str, int start, int length);
 
+/**
+ * Parses a size such as `512`, `64K`, `1M` or `4G` into a number of bytes
+ * 
+ * @param str - The size to parse
+ * @return number of bytes, negative if the size is invalid
+ */
+long parse_size(char *str);
+
 /**
  * Called by the main shell loop each time input is recieved. This function handles parsing the 
  * command line into an array of commands ready for execution. The commands are then directed 
@@ -75,21 +125,62 @@ char * sub_string(char* str, int start, int length);
 int do_command(char *cmdline);
 
 /**
- * Takes the command line input which may contain many commands seperated by a pipe. The command line
- * input is seperated into an array of subcommands and each is seperated into a list of tokens. The list
- * of tokens are then converted into a data structure which represents a command that will be executed by
- * the shell and holds all information needed by the execution unit. The parser populates the given empty 
- * array with the complete and valid command structures.
+ * Parses the command line input without executing it. Prints an error if the command
+ * line is malformed. Used by the shells parse only mode to check scripts.
+ * 
+ * @param cmdline: the command line to check
+ * @return: SUCCESS if the command line is valid, ERROR if it is malformed
+ */ 
+int check_command(char *cmdline);
+
+/**
+ * Takes the command line input which may contain many commands seperated by a pipe, and many pipelines
+ * seperated by `;`, `&&` or `||`. The command line input is tokenized in a single pass and the tokens of
+ * each subcommand are then converted into a data structure which represents a command that will be
+ * executed by the shell and holds all information needed by the execution unit. The commands of every
+ * pipeline are returned in order in one array, each command records how it is joined to the next. The commands, their tokens and the array holding them are allocated from
+ * the arena and live until the arena is reset.
  * 
  * If any command line input is invalid, an error message is printed to the console and the shell returns
  * to the prompt.
  * 
- * @param commands_arr: array to hold command stucts
- * @param num_commands: number of subcommands to parse
+ * @param arena: arena to allocate the commands from
+ * @param commands_arr: set to the array of command structs
  * @param cmdline: the command line given by the user that will be parsed
- * @return status of command line parsing
+ * @return number of commands, 0 if the line is blank, ERROR if the command line is malformed
+ **/ 
+int parse_command(struct arena_t *arena, struct command_t ***commands_arr, char *cmdline);
+
+/**
+ * Removes the first token of a command so the next token becomes the command name, used
+ * for prefixes such as `queue` and `time`. The command name is looked up again.
+ * 
+ * @param command: command to remove the first token of
  **/ 
-int parse_command(struct command_t *commands_arr[], int num_commands, char *cmdline);
+void command_shift(struct command_t *command);
 
+/**
+ * Copies a command out of the arena so it outlives the command line it was parsed from.
+ * The copy is a single allocation which is released with one call to free.
+ * 
+ * @param command: command to copy
+ * @return the copy
+ **/ 
+struct command_t *command_clone(struct command_t *command);
+
+
+/**
+ * Counts the memory held by the arena of the command line being executed
+ * 
+ * @param usage: counters to add to
+ **/
+void runner_memory(struct mem_usage_t *usage);
+
+/**
+ * Counts the memory held by the parser between command lines
+ * 
+ * @param usage: counters to add to
+ **/
+void parser_memory(struct mem_usage_t *usage);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,387 @@
+/**
+ * @file: startup.c
+ * @author: Andrew Kress
+ *
+ * @brief: Loads and runs the .sushrc startup file
+ *
+ * Every line of the startup file is parsed once and sorted by what it does. Lines that set a
+ * variable to a fixed value are kept as the name and value and are applied straight to the
+ * environment without parsing or dispatching them again. Other lines keep their text and are
+ * run as command lines. Lines that are a single pipeline of programs are skipped by shells
+ * nobody types in to, their output would not be seen.
+ *
+ * The sorted lines are written to a cache file beside the startup file, keyed by the inode,
+ * size and modification time of the startup file. A shell starting with an unchanged startup
+ * file reads the cache with a single read instead of parsing the file.
+ *
+ * Cache file layout, in the byte order of the host:
+ *   startup_cache_header_t
+ *   num_lines startup_line_t
+ *   data_size bytes of null terminated strings the lines point in to
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "runner.h"
+#include "arena.h"
+#include "reader.h"
+#include "internal.h"
+#include "builtins.h"
+#include "environ.h"
+#include "background.h"
+#include "startup.h"
+
+// suffix of the cache file, appended to the path of the startup file
+#define CACHE_SUFFIX ".cache"
+
+// identifies a cache file and its layout
+#define CACHE_MAGIC "SUSHRC"
+#define CACHE_VERSION 3
+
+// start of the cache file, the status of the startup file it was made from
+struct startup_cache_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_lines;
+    uint32_t data_size;
+    uint32_t reserved;
+    uint64_t inode;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+
+/**
+ * Returns the path of the cache file of a startup file
+ *
+ * @param path: path of the startup file
+ * @return path of the cache file, free with free
+ */
+char *startup_cache_path(char *path) {
+    char *cache_path = malloc(strlen(path) + sizeof(CACHE_SUFFIX));
+    strcpy(cache_path, path);
+    strcat(cache_path, CACHE_SUFFIX);
+    return cache_path;
+}
+
+
+/**
+ * Fills in a cache header for the startup file in its current state
+ *
+ * @param header: header to fill in
+ * @param sfile: status of the startup file
+ * @param startup: lines of the startup file
+ */
+void startup_cache_header(struct startup_cache_header_t *header, struct stat *sfile, struct startup_file_t *startup) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header->version = CACHE_VERSION;
+    header->num_lines = startup->num_lines;
+    header->data_size = startup->data_size;
+    header->inode = sfile->st_ino;
+    header->size = sfile->st_size;
+    header->mtime_sec = sfile->st_mtim.tv_sec;
+    header->mtime_nsec = sfile->st_mtim.tv_nsec;
+}
+
+
+/**
+ * Points the lines and data of a startup file in to its buffer, the lines come first
+ *
+ * @param startup: startup file whose buffer holds the lines and data
+ */
+void startup_set_buffer(struct startup_file_t *startup) {
+    startup->lines = startup->buffer;
+    startup->data = (char *) (startup->lines + startup->num_lines);
+}
+
+
+/**
+ * Reads the lines of a startup file from its cache file if the cache was made from
+ * the startup file as it is now
+ *
+ * @param cache_path: path of the cache file
+ * @param sfile: status of the startup file
+ * @param startup: set to the lines of the file
+ * @return SUCCESS if the cache was used, ERROR if the file has to be parsed
+ */
+int startup_read_cache(char *cache_path, struct stat *sfile, struct startup_file_t *startup) {
+    struct startup_cache_header_t header;
+    struct stat scache;
+
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return ERROR;
+
+    if (fstat(fd, &scache) < 0 || (size_t) scache.st_size < sizeof(header) ||
+        read(fd, &header, sizeof(header)) != sizeof(header)) {
+        close(fd);
+        return ERROR;
+    }
+
+    // the cache must have been made from this startup file and be complete
+    startup->num_lines = header.num_lines;
+    startup->data_size = header.data_size;
+    struct startup_cache_header_t expected;
+    startup_cache_header(&expected, sfile, startup);
+
+    size_t length = (size_t) header.num_lines * sizeof(struct startup_line_t) + header.data_size;
+    if (memcmp(&header, &expected, sizeof(header)) != 0 || scache.st_size != (off_t) (sizeof(header) + length)) {
+        close(fd);
+        return ERROR;
+    }
+
+    startup->buffer = malloc(length + 1);
+    ssize_t rc = read(fd, startup->buffer, length);
+    close(fd);
+    if (rc != (ssize_t) length) {
+        free(startup->buffer);
+        return ERROR;
+    }
+    startup_set_buffer(startup);
+
+    // every string must be inside the data
+    startup->data[header.data_size] = '\0';
+    for (uint32_t i = 0; i < startup->num_lines; i++) {
+        if (startup->lines[i].text >= startup->data_size || startup->lines[i].value >= startup->data_size) {
+            free(startup->buffer);
+            return ERROR;
+        }
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Writes the lines of a startup file to its cache file. The cache is written to a
+ * temporary file which replaces the cache once complete, a failure leaves no cache.
+ *
+ * @param cache_path: path of the cache file
+ * @param sfile: status of the startup file
+ * @param startup: lines of the file
+ */
+void startup_write_cache(char *cache_path, struct stat *sfile, struct startup_file_t *startup) {
+    struct startup_cache_header_t header;
+    startup_cache_header(&header, sfile, startup);
+
+    char *temp_path = malloc(strlen(cache_path) + 8);
+    sprintf(temp_path, "%s.XXXXXX", cache_path);
+    int fd = mkostemp(temp_path, O_CLOEXEC);
+    if (fd < 0) {
+        free(temp_path);
+        return;
+    }
+
+    size_t length = (size_t) startup->num_lines * sizeof(struct startup_line_t) + startup->data_size;
+    bool written = write(fd, &header, sizeof(header)) == sizeof(header) &&
+                   write(fd, startup->buffer, length) == (ssize_t) length;
+    close(fd);
+
+    if (!written || rename(temp_path, cache_path) < 0) unlink(temp_path);
+    free(temp_path);
+}
+
+
+/**
+ * Adds a string to the data of a startup file being parsed
+ *
+ * @param data: data grown to fit the string
+ * @param data_size: size of the data so far
+ * @param capacity: size of the allocation holding the data
+ * @param str: string to add
+ * @return offset of the string in the data
+ */
+uint32_t startup_add_string(char **data, uint32_t *data_size, size_t *capacity, char *str) {
+    size_t length = strlen(str) + 1;
+    while (*data_size + length > *capacity) {
+        *capacity = (*capacity == 0) ? 1024 : *capacity * 2;
+        *data = realloc(*data, *capacity);
+    }
+
+    uint32_t offset = *data_size;
+    memcpy(*data + offset, str, length);
+    *data_size += length;
+    return offset;
+}
+
+
+/**
+ * Finds out what a line of the startup file does by parsing it. A line which does
+ * not parse is run as it is so the error is shown.
+ *
+ * @param arena: arena to parse the line in to
+ * @param cmdline: line to check
+ * @param setenv_cmd: set to the setenv command of a STARTUP_SETENV line
+ * @return kind of the line
+ */
+enum startup_line_e startup_line_kind(struct arena_t *arena, char *cmdline, struct command_t **setenv_cmd) {
+    struct command_t **commands_arr;
+
+    int num_commands = parse_command(arena, &commands_arr, cmdline);
+    if (num_commands < 0) return STARTUP_SHELL;
+
+    // only a single pipeline of programs can be skipped, a list joined by ;, && or || may
+    // change the shell in any part and a stage run by the shell itself may have side effects
+    bool programs_only = true;
+    for (int i = 0; i < num_commands; i++) {
+        struct command_t *stage = commands_arr[i];
+
+        if (stage->next_op != LIST_PIPE && stage->next_op != LIST_END) return STARTUP_SHELL;
+        if (is_internal_command(stage) || builtin_find(stage) != NULL) programs_only = false;
+    }
+    if (programs_only) return STARTUP_PROGRAM;
+    if (num_commands != 1) return STARTUP_SHELL;
+
+    // setenv of a fixed value without redirection, its value does not depend on anything
+    struct command_t *command = commands_arr[0];
+    if (strcmp(command->cmd_name, "setenv") == 0 && command->num_tokens == 4 &&
+        command->file_in == REDIRECT_NONE && command->file_out == REDIRECT_NONE &&
+        strchr(cmdline, '$') == NULL) {
+        *setenv_cmd = command;
+        return STARTUP_SETENV;
+    }
+
+    return STARTUP_SHELL;
+}
+
+
+/**
+ * Parses a startup file and sorts its lines by what they do
+ *
+ * @param path: path of the startup file
+ * @param startup: set to the lines of the file
+ * @return status of reading the file
+ */
+int startup_parse(char *path, struct startup_file_t *startup) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return ERROR;
+
+    struct line_reader_t reader;
+    struct arena_t arena;
+    reader_init(&reader, fd);
+    arena_init(&arena, 4096);
+
+    struct startup_line_t *lines = NULL;
+    size_t lines_capacity = 0;
+    char *data = NULL;
+    size_t data_capacity = 0;
+    char *cmdline;
+
+    startup->num_lines = 0;
+    startup->data_size = 0;
+
+    while ((cmdline = reader_next_line(&reader)) != NULL) {
+        if (cmdline[0] == '\0') continue;
+
+        if (startup->num_lines == lines_capacity) {
+            lines_capacity = (lines_capacity == 0) ? 32 : lines_capacity * 2;
+            lines = realloc(lines, lines_capacity * sizeof(struct startup_line_t));
+        }
+        struct startup_line_t *line = &lines[startup->num_lines++];
+
+        // setenv lines keep the name and value, other lines their text
+        struct command_t *setenv_cmd = NULL;
+        line->kind = startup_line_kind(&arena, cmdline, &setenv_cmd);
+        if (line->kind == STARTUP_SETENV) {
+            line->text = startup_add_string(&data, &startup->data_size, &data_capacity, setenv_cmd->tokens[1]);
+            line->value = startup_add_string(&data, &startup->data_size, &data_capacity, setenv_cmd->tokens[2]);
+        } else {
+            line->text = startup_add_string(&data, &startup->data_size, &data_capacity, cmdline);
+            line->value = line->text;
+        }
+        arena_reset(&arena);
+    }
+
+    arena_free(&arena);
+    reader_free(&reader);
+    close(fd);
+
+    // lines and data are kept in one allocation laid out like the cache file
+    size_t lines_size = startup->num_lines * sizeof(struct startup_line_t);
+    startup->buffer = malloc(lines_size + startup->data_size + 1);
+    startup_set_buffer(startup);
+    if (lines_size > 0) memcpy(startup->lines, lines, lines_size);
+    if (startup->data_size > 0) memcpy(startup->data, data, startup->data_size);
+
+    free(lines);
+    free(data);
+    return SUCCESS;
+}
+
+
+/**
+ * Loads the lines of a startup file. The cache file is used if it was made from the
+ * startup file as it is now, otherwise the startup file is parsed and a new cache file
+ * is written.
+ *
+ * @param path: path of the startup file
+ * @param sfile: status of the startup file
+ * @param startup: set to the lines of the file, free with startup_free
+ * @return status of loading the file
+ */
+int startup_load(char *path, struct stat *sfile, struct startup_file_t *startup) {
+    char *cache_path = startup_cache_path(path);
+    int rc = startup_read_cache(cache_path, sfile, startup);
+
+    // startup file changed or was never cached
+    if (rc < 0) {
+        rc = startup_parse(path, startup);
+        if (rc >= 0) startup_write_cache(cache_path, sfile, startup);
+    }
+
+    free(cache_path);
+    return rc;
+}
+
+
+/**
+ * Runs the lines of a startup file in order. Consecutive variables are set together
+ * without running a command line. Lines that run programs are skipped unless
+ * run_programs is true.
+ *
+ * @param startup: lines to run
+ * @param run_programs: true to run lines that run programs
+ * @return EXIT_SHELL if exit ran, SUCCESS otherwise
+ */
+int startup_run(struct startup_file_t *startup, bool run_programs) {
+    for (uint32_t i = 0; i < startup->num_lines; i++) {
+        struct startup_line_t *line = &startup->lines[i];
+
+        // set every variable up to the next line that has to be run
+        if (line->kind == STARTUP_SETENV) {
+            for (; i < startup->num_lines && startup->lines[i].kind == STARTUP_SETENV; i++) {
+                environ_set_var(startup->data + startup->lines[i].text, startup->data + startup->lines[i].value);
+            }
+            i--;
+            continue;
+        }
+
+        if (line->kind == STARTUP_PROGRAM && !run_programs) continue;
+
+        // start queued jobs in slots freed since the last command
+        background_reap();
+        if (do_command(startup->data + line->text) == EXIT_SHELL) return EXIT_SHELL;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Frees the lines of a startup file
+ *
+ * @param startup: lines to free
+ */
+void startup_free(struct startup_file_t *startup) {
+    free(startup->buffer);
+    startup->buffer = NULL;
+    startup->lines = NULL;
+    startup->data = NULL;
+    startup->num_lines = 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file: startup.h
+ * @author: Andrew Kress
+ *
+ * @brief: Header file for the startup file
+ *
+ * Defines functions to load the lines of the .sushrc startup file already sorted by what
+ * they do, and to run them. The sorted lines are kept in a cache file next to the startup
+ * file which is used for as long as the startup file is not changed, so the startup file is
+ * only parsed once.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+// what a line of the startup file does
+enum startup_line_e {
+    STARTUP_SETENV,     // sets a variable to a fixed value, applied without running the line
+    STARTUP_SHELL,      // runs an internal command or builtin, or a list that may change the shell
+    STARTUP_PROGRAM     // a single pipeline of programs, only needed when someone sees its output
+};
+
+// line of the startup file, text and value are offsets in to the data of the file
+struct startup_line_t {
+    uint32_t kind;
+    uint32_t text;      // command line, or name of the variable for STARTUP_SETENV
+    uint32_t value;     // value of the variable for STARTUP_SETENV
+};
+
+// lines of a startup file
+struct startup_file_t {
+    struct startup_line_t *lines;
+    uint32_t num_lines;
+
+    char *data;         // strings of every line
+    uint32_t data_size;
+
+    void *buffer;       // single allocation holding the lines and data
+};
+
+/**
+ * Loads the lines of a startup file. The cache file is used if it was made from the
+ * startup file as it is now, otherwise the startup file is parsed and a new cache file
+ * is written.
+ *
+ * @param path: path of the startup file
+ * @param sfile: status of the startup file
+ * @param startup: set to the lines of the file, free with startup_free
+ * @return status of loading the file
+ */
+int startup_load(char *path, struct stat *sfile, struct startup_file_t *startup);
+
+/**
+ * Runs the lines of a startup file in order. Consecutive variables are set together
+ * without running a command line. Lines that run programs are skipped unless
+ * run_programs is true.
+ *
+ * @param startup: lines to run
+ * @param run_programs: true to run lines that run programs
+ * @return EXIT_SHELL if exit ran, SUCCESS otherwise
+ */
+int startup_run(struct startup_file_t *startup, bool run_programs);
+
+/**
+ * Frees the lines of a startup file
+ *
+ * @param startup: lines to free
+ */
+void startup_free(struct startup_file_t *startup);
+
+#endif
@@ -17,133 +17,350 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <stdbool.h>
-#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include "runner.h"
 #include "error.h"
 #include "environ.h"
 #include "background.h"
+#include "reader.h"
+#include "executor.h"
+#include "startup.h"
+#include "history.h"
+#include "eventloop.h"
 
-// max size of command line input we accept
-#define CMD_BUFFER 512 
+// environment variable which makes shells that are not interactive run programs in .sushrc
+#define RC_PROGRAMS_VAR "SUSH_RC_PROGRAMS"
 
-// typedef for the call back function pointer for signal handler
-typedef void (*signal_handler_t)(int);
+// environment variable naming the history file, empty to keep no history
+#define HISTORY_VAR "SUSH_HISTORY"
+
+// history file in SUSHHOME, or HOME without it, of an interactive shell
+#define HISTORY_FILE "/.sush_history"
+
+// set by the event loop once the input can be read
+static bool input_ready = false;
+
+
+/**
+ * Get's the value to be used for the command prompt.
+ */
+char * get_prompt() {
+    char *prompt = ">";
+
+    // get PS1 if exists
+    if (environ_var_exist("PS1")) {
+        prompt = environ_get_var("PS1")->value;
+    }
+
+    return prompt;
+}
+
+
+/**
+ * Prints the command prompt
+ */
+void print_prompt() {
+    printf("%s", get_prompt());
+    fflush(stdout);
+}
+
+
+/**
+ * Handler the event loop runs when the input can be read or the terminal went away
+ * 
+ * @param fd: file descriptor of the input
+ * @param data: unused
+ */ 
+void input_ready_handler(int fd, void *data) {
+    input_ready = true;
+}
 
 
 /**
- * Function to register a callback function to handle given signal
+ * Waits in the event loop until there is input to read from the reader. Background jobs
+ * that finish while the shell waits are reaped right away so queued jobs start without
+ * waiting for the next command, and output of jobs captured in memory is read as it
+ * arrives. Input the reader already buffered is read straight away without waiting, as is
+ * a file, which is always readable and can not be watched.
  * 
- * @param callback: function that we register to handle the signal
- * @param sig_id: signal that the callback function will handle
+ * The input is only watched while the shell waits for it, a command that waits in the
+ * loop itself is not woken by input typed ahead of the prompt.
  * 
- * @return: integer T/F if registration was successful
- **/ 
-int register_handler(signal_handler_t callback, int sig_id) {
-    if (signal(sig_id, callback) == SIG_ERR) {
-        return ERROR;
+ * @param reader: reader of the input
+ */ 
+void wait_for_input(struct line_reader_t *reader) {
+    if (reader_has_buffered(reader)) return;
+    if (eventloop_watch(reader->fd, input_ready_handler, NULL) < 0) return;
+
+    input_ready = false;
+    while (!input_ready) {
+        if (eventloop_run_once(-1) < 0) break;
     }
-    return SUCCESS;
+
+    eventloop_unwatch(reader->fd);
 }
 
 
 /**
- * If user defined startup command in the .sushrc file and has permission
- * to read and execute commands, the function executes each command
+ * Runs a command line after recalling any history entry it names with `!`, and adds
+ * the line that runs to the history. A recalled line is printed before it runs.
+ * 
+ * @param cmdline: command line to run
+ * 
+ * @return status of the command, ERROR if the line recalls an entry that does not exist
+ */ 
+int run_command_line(char *cmdline) {
+    char *expanded;
+    if (history_expand(cmdline, &expanded) < 0) return ERROR;
+
+    if (expanded != NULL) {
+        LOG_MSG(MSG_HISTORY_RECALL, expanded);
+        cmdline = expanded;
+    }
+
+    history_add(cmdline);
+    int status = do_command(cmdline);
+
+    free(expanded);
+    return status;
+}
+
+
+/**
+ * Runs each line read by the reader until the input ends or the exit command runs.
+ * Only an interactive shell prints a prompt before each line. In parse only mode each
+ * line is checked without executing it.
+ * 
+ * @param reader: reader of the lines to run
+ * @param interactive: true to prompt for each line
+ * @param parse_only: true to only check that each line parses
+ * 
+ * @return EXIT_SHELL if exit ran, ERROR if a line did not parse in parse only mode, SUCCESS otherwise
  */ 
-void run_startup_commands() {
-    if (environ_var_exist("SUSHHOME")) {
-        char *sushhome = environ_get_var("SUSHHOME")->value;
-        char *filename = malloc(strlen(sushhome) + 9);
-        strcpy(filename, sushhome);
-        strcat(filename, "/.sushrc");
-
-        // get file permissions
-        struct stat sfile;
-        stat(filename, &sfile);
-
-        // if user can read and execute
-        if ((sfile.st_mode & S_IRUSR) && (sfile.st_mode & S_IXUSR)) {
-            FILE *fp = fopen(filename, "r");
-
-            // read and execute each line
-            char cmdline[CMD_BUFFER];
-            while (fgets(cmdline, CMD_BUFFER, fp)) {
-                // if command was read, execute
-                if (cmdline != NULL && cmdline[0] != '\n' && cmdline[0] != '\0') {
-                    int rc = do_command(cmdline);
-                }
+int run_lines(struct line_reader_t *reader, bool interactive, bool parse_only) {
+    int status = SUCCESS;
+    char *cmdline;
+
+    // prompt user until exit
+    if (interactive) print_prompt();
+    wait_for_input(reader);
+    while ((cmdline = reader_next_line(reader)) != NULL) {
+        // start queued jobs in slots freed since the last command
+        background_reap();
+
+        // not empty command lines, execute or check
+        if (cmdline[0] != '\0') {
+            if (parse_only) {
+                if (check_command(cmdline) < 0) status = ERROR;
             }
+            // exit command success, stop reading lines
+            else if (run_command_line(cmdline) == EXIT_SHELL) {
+                return EXIT_SHELL;
+            }
+        }
+
+        // print prompt again
+        if (interactive) print_prompt();
+        wait_for_input(reader);
+    }
+
+    return status;
+}
 
-            //close file
-            fclose(fp);
+
+/**
+ * Runs the command given with -c. Each line of the command is run in turn.
+ * 
+ * @param command: command string given on the command line
+ * @param parse_only: true to only check that each line parses
+ * 
+ * @return EXIT_SHELL if exit ran, ERROR if a line did not parse in parse only mode, SUCCESS otherwise
+ */ 
+int run_string(char *command, bool parse_only) {
+    int status = SUCCESS;
+
+    for (char *line = command; line != NULL; ) {
+        // terminate the line in place at its newline
+        char *newline = strchr(line, '\n');
+        if (newline != NULL) *newline = '\0';
+
+        if (line[0] != '\0') {
+            background_reap();
+
+            if (parse_only) {
+                if (check_command(line) < 0) status = ERROR;
+            }
+            else if (run_command_line(line) == EXIT_SHELL) {
+                return EXIT_SHELL;
+            }
         }
+
+        line = (newline != NULL) ? newline + 1 : NULL;
     }
+
+    return status;
 }
 
 
 /**
- * Get's the value to be used for the command prompt.
- */
-char * get_prompt() {
-    char *prompt = ">";
+ * If user defined startup command in the .sushrc file and has permission
+ * to read and execute commands, the function executes each command.
+ * 
+ * Lines that are a single pipeline of programs are skipped when the shell is not interactive
+ * unless SUSH_RC_PROGRAMS is set to `always`.
+ * 
+ * @param interactive: true if the shell prompts for input
+ */ 
+void run_startup_commands(bool interactive) {
+    if (!environ_var_exist("SUSHHOME")) return;
 
-    // get PS1 if exists
-    if (environ_var_exist("PS1")) {
-        prompt = strdup(environ_get_var("PS1")->value);
+    char *sushhome = environ_get_var("SUSHHOME")->value;
+    char *filename = malloc(strlen(sushhome) + 9);
+    strcpy(filename, sushhome);
+    strcat(filename, "/.sushrc");
+
+    // get file permissions, there is nothing to run without a file
+    struct stat sfile;
+    if (stat(filename, &sfile) < 0) {
+        free(filename);
+        return;
     }
 
-    return prompt;
+    // if user can read and execute
+    struct startup_file_t startup;
+    if ((sfile.st_mode & S_IRUSR) && (sfile.st_mode & S_IXUSR) && startup_load(filename, &sfile, &startup) >= 0) {
+        struct environ_var_t *programs = environ_get_var(RC_PROGRAMS_VAR);
+        bool run_programs = interactive || (programs != NULL && strcmp(programs->value, "always") == 0);
+
+        // execute each line
+        startup_run(&startup, run_programs);
+        startup_free(&startup);
+    }
+
+    free(filename);
+}
+
+
+/**
+ * Opens the history the shell adds its command lines to. SUSH_HISTORY names the file
+ * if it is set, an empty value keeps no history. Otherwise only an interactive shell
+ * keeps a history, in .sush_history in SUSHHOME or else HOME.
+ * 
+ * @param interactive: true if the shell prompts for input
+ */ 
+void open_history(bool interactive) {
+    struct environ_var_t *var = environ_get_var(HISTORY_VAR);
+    if (var == NULL && !interactive) return;
+    if (var != NULL && var->value[0] == '\0') return;
+
+    char *filename;
+    if (var != NULL) {
+        filename = strdup(var->value);
+    } else {
+        // history lives next to .sushrc, or in the home directory without SUSHHOME
+        var = environ_get_var("SUSHHOME");
+        if (var == NULL) var = environ_get_var("HOME");
+        if (var == NULL) return;
+
+        filename = malloc(strlen(var->value) + strlen(HISTORY_FILE) + 1);
+        strcpy(filename, var->value);
+        strcat(filename, HISTORY_FILE);
+    }
+
+    if (history_open(filename) < 0) {
+        LOG_ERROR(ERROR_HISTORY_OPEN, filename, strerror(errno));
+    }
+    free(filename);
 }
 
 
 /**
  * Launches the shell by first initializing environement, executing any
- * startup command defined in .sushrc file and then enters loop to prompt
- * user for command line input
+ * startup command defined in .sushrc file and then runs commands.
+ * 
+ * usage: sush [-n] [-c command | script]
+ * 
+ * With -c the command string is run, given a script the lines of the script are run,
+ * otherwise lines are read from stdin. Only when stdin is a terminal and neither was
+ * given does the shell prompt for input. With -n lines are only parsed to check them
+ * and startup commands are not run.
+ * 
+ * A shell that is not interactive exits with the status of its last command, or 1 in
+ * parse only mode if any line did not parse.
  */ 
 int main(int argc, char *argv[], char *envp[]) {
-    int rc;
+    bool parse_only = false;
+    char *command = NULL;
+    int opt;
+
+    // options end at the script name
+    while ((opt = getopt(argc, argv, "+nc:")) != -1) {
+        switch (opt) {
+            case 'n':
+                parse_only = true;
+                break;
+            case 'c':
+                command = optarg;
+                break;
+            default:
+                LOG_ERROR(ERROR_USAGE);
+                return 2;
+        }
+    }
 
-    // register callback for child death signal, exit on failure
-    if (!register_handler(sig_handler, SIGCHLD)) return -1;
+    // lines are read from the script if one was given, otherwise stdin
+    char *script = (command == NULL && optind < argc) ? argv[optind] : NULL;
+    int input_fd = STDIN_FILENO;
+    if (script != NULL) {
+        input_fd = open(script, O_RDONLY | O_CLOEXEC);
+        if (input_fd < 0) {
+            LOG_ERROR(ERROR_SCRIPT_OPEN, script, strerror(errno));
+            return 127;
+        }
+    }
+    bool interactive = (command == NULL && script == NULL && isatty(STDIN_FILENO));
+
+    // setup queue and the event loop it reaps children in, exit on failure
+    if (background_init() < 0) return -1;
 
     // Environment Setup
     environ_init(envp);
 
-    // Run startup commands
-    run_startup_commands();
-
-    // string to hold command line input
-    char cmdline[CMD_BUFFER];
+    // record job state for other programs and pick up jobs a previous shell left queued,
+    // before the startup commands so the jobs they queue are recorded too
+    if (!parse_only) background_journal_init();
 
-    // print prompt
-    printf("%s", get_prompt());
-    fflush(stdout);
+    // Run startup commands
+    if (!parse_only) run_startup_commands(interactive);
 
-    // prompt user until exit
-    while (fgets(cmdline, CMD_BUFFER, stdin) != NULL) {
-        // not empty command lines, execute
-        if (cmdline[0] != '\n') {
-            // execute command line
-            rc = do_command(cmdline);
-
-            // exit command success, break loop and exit shell
-            if (rc == EXIT_SHELL) break;
-        }
+    // keep the command lines that run in the history
+    if (!parse_only) open_history(interactive);
 
-        // print prompt again
-        printf("%s", get_prompt());
-        fflush(stdout);
+    // run the command string or each line of input
+    int status;
+    if (command != NULL) {
+        status = run_string(command, parse_only);
+    } else {
+        struct line_reader_t reader;
+        reader_init(&reader, input_fd);
+        status = run_lines(&reader, interactive, parse_only);
+        reader_free(&reader);
     }
+    if (script != NULL) close(input_fd);
 
     // clean up after exit command
     environ_clean_up();
+    history_close();
 
     // clean and free queue
     queue_cleanup();
+    eventloop_close();
 
     // exit shell
-    exit(0);
-}
\ No newline at end of file
+    if (parse_only) exit(status == ERROR ? 1 : 0);
+    if (interactive) exit(0);
+    exit(executor_last_status());
+}